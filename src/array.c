@@ -15,8 +15,6 @@ array *array_init(void) {
 	a = calloc(1, sizeof(*a));
 	force_assert(a);
 
-	a->next_power_of_2 = 1;
-
 	return a;
 }
 
@@ -28,17 +26,22 @@ array *array_init_array(array *src) {
 
 	a->used = src->used;
 	a->size = src->size;
-	a->next_power_of_2 = src->next_power_of_2;
 	a->unique_ndx = src->unique_ndx;
 
 	a->data = malloc(sizeof(*src->data) * src->size);
+	force_assert(a->data);
 	for (i = 0; i < src->size; i++) {
 		if (src->data[i]) a->data[i] = src->data[i]->copy(src->data[i]);
 		else a->data[i] = NULL;
 	}
 
-	a->sorted = malloc(sizeof(*src->sorted)   * src->size);
-	memcpy(a->sorted, src->sorted, sizeof(*src->sorted)   * src->size);
+	if (0 != src->hash_size) {
+		a->hash_size = src->hash_size;
+		a->hash = malloc(sizeof(*src->hash) * src->hash_size);
+		force_assert(a->hash);
+		memcpy(a->hash, src->hash, sizeof(*src->hash) * src->hash_size);
+	}
+
 	return a;
 }
 
@@ -53,6 +56,7 @@ void array_free(array *a) {
 	}
 
 	if (a->data) free(a->data);
+	if (a->hash) free(a->hash);
 	if (a->sorted) free(a->sorted);
 
 	free(a);
@@ -68,7 +72,69 @@ void array_reset(array *a) {
 		}
 	}
 
+	if (a->used && a->hash) memset(a->hash, 0, sizeof(*a->hash) * a->hash_size);
+
 	a->used = 0;
+	a->is_sorted = 0;
+}
+
+/* DJB hash over the lowercased key, matching buffer_caseless_compare() */
+static size_t array_hash_key(const char *key, size_t keylen) {
+	size_t h = 5381;
+	size_t i;
+
+	for (i = 0; i < keylen; ++i) {
+		unsigned char c = key[i];
+		if (c >= 'A' && c <= 'Z') c |= 32;
+		h = ((h << 5) + h) + c;
+	}
+
+	return h;
+}
+
+static void array_hash_insert(array *a, size_t ndx) {
+	const size_t mask = a->hash_size - 1;
+	size_t h = array_hash_key(CONST_BUF_LEN(a->data[ndx]->key)) & mask;
+
+	while (0 != a->hash[h]) h = (h + 1) & mask;
+
+	a->hash[h] = ndx + 1;
+}
+
+/* remove the slot of data[ndx]; shift the following entries of the probe
+ * sequence back so lookups don't need tombstones */
+static void array_hash_remove(array *a, size_t ndx) {
+	const size_t mask = a->hash_size - 1;
+	size_t i, j;
+
+	i = array_hash_key(CONST_BUF_LEN(a->data[ndx]->key)) & mask;
+	while (a->hash[i] != ndx + 1) {
+		force_assert(0 != a->hash[i]);
+		i = (i + 1) & mask;
+	}
+
+	for (j = (i + 1) & mask; 0 != a->hash[j]; j = (j + 1) & mask) {
+		size_t k = array_hash_key(CONST_BUF_LEN(a->data[a->hash[j] - 1]->key)) & mask;
+
+		/* entry stays if its home slot k lies cyclically in (i, j] */
+		if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) continue;
+
+		a->hash[i] = a->hash[j];
+		i = j;
+	}
+
+	a->hash[i] = 0;
+}
+
+static void array_hash_resize(array *a, size_t hash_size) {
+	size_t i;
+
+	if (a->hash) free(a->hash);
+	a->hash_size = hash_size;
+	a->hash = calloc(hash_size, sizeof(*a->hash));
+	force_assert(a->hash);
+
+	for (i = 0; i < a->used; i++) array_hash_insert(a, i);
 }
 
 data_unset *array_pop(array *a) {
@@ -76,52 +142,37 @@ data_unset *array_pop(array *a) {
 
 	force_assert(a->used != 0);
 
+	array_hash_remove(a, a->used - 1);
+
 	a->used --;
 	du = a->data[a->used];
 	a->data[a->used] = NULL;
+	a->is_sorted = 0;
 
 	return du;
 }
 
-static int array_get_index(array *a, const char *key, size_t keylen, int *rndx) {
-	int ndx = -1;
-	int i, pos = 0;
-
-	if (key == NULL) return -1;
+static int array_get_index(const array *a, const char *key, size_t keylen) {
+	size_t mask, h;
 
-	/* try to find the string */
-	for (i = pos = a->next_power_of_2 / 2; ; i >>= 1) {
-		int cmp;
+	if (key == NULL || 0 == a->used) return -1;
 
-		if (pos < 0) {
-			pos += i;
-		} else if (pos >= (int)a->used) {
-			pos -= i;
-		} else {
-			cmp = buffer_caseless_compare(key, keylen, CONST_BUF_LEN(a->data[a->sorted[pos]]->key));
+	mask = a->hash_size - 1;
+	for (h = array_hash_key(key, keylen) & mask; 0 != a->hash[h]; h = (h + 1) & mask) {
+		const buffer *k = a->data[a->hash[h] - 1]->key;
 
-			if (cmp == 0) {
-				/* found */
-				ndx = a->sorted[pos];
-				break;
-			} else if (cmp < 0) {
-				pos -= i;
-			} else {
-				pos += i;
-			}
+		if (buffer_string_length(k) == keylen && 0 == buffer_caseless_compare(key, keylen, CONST_BUF_LEN(k))) {
+			return (int) (a->hash[h] - 1);
 		}
-		if (i == 0) break;
 	}
 
-	if (rndx) *rndx = pos;
-
-	return ndx;
+	return -1;
 }
 
 data_unset *array_get_element(array *a, const char *key) {
 	int ndx;
 
-	if (-1 != (ndx = array_get_index(a, key, strlen(key), NULL))) {
+	if (-1 != (ndx = array_get_index(a, key, strlen(key)))) {
 		/* found, leave here */
 
 		return a->data[ndx];
@@ -130,6 +181,44 @@ data_unset *array_get_element(array *a, const char *key) {
 	return NULL;
 }
 
+typedef struct {
+	const buffer *key;
+	size_t ndx;
+} array_sort_entry;
+
+static int array_sort_entry_cmp(const void *a, const void *b) {
+	const buffer *ka = ((const array_sort_entry *)a)->key;
+	const buffer *kb = ((const array_sort_entry *)b)->key;
+
+	return buffer_caseless_compare(CONST_BUF_LEN(ka), CONST_BUF_LEN(kb));
+}
+
+/* indices into data ordered caseless by key, built on demand for the few
+ * callers (config checks, printing) that want sorted output */
+size_t *array_get_sorted_index(array *a) {
+	array_sort_entry *entries;
+	size_t i;
+
+	if (a->is_sorted || 0 == a->used) return a->sorted;
+
+	entries = malloc(sizeof(*entries) * a->used);
+	force_assert(entries);
+	for (i = 0; i < a->used; i++) {
+		entries[i].key = a->data[i]->key;
+		entries[i].ndx = i;
+	}
+	qsort(entries, a->used, sizeof(*entries), array_sort_entry_cmp);
+
+	a->sorted = realloc(a->sorted, sizeof(*a->sorted) * a->used);
+	force_assert(a->sorted);
+	for (i = 0; i < a->used; i++) a->sorted[i] = entries[i].ndx;
+	free(entries);
+
+	a->is_sorted = 1;
+
+	return a->sorted;
+}
+
 data_unset *array_get_unused_element(array *a, data_type_t t) {
 	data_unset *ds = NULL;
 	unsigned int i;
@@ -171,7 +260,7 @@ data_unset *array_replace(array *a, data_unset *du) {
 	int ndx;
 
 	force_assert(NULL != du);
-	if (-1 == (ndx = array_get_index(a, CONST_BUF_LEN(du->key), NULL))) {
+	if (-1 == (ndx = array_get_index(a, CONST_BUF_LEN(du->key)))) {
 		array_insert_unique(a, du);
 		return NULL;
 	} else {
@@ -183,7 +272,6 @@ data_unset *array_replace(array *a, data_unset *du) {
 
 int array_insert_unique(array *a, data_unset *str) {
 	int ndx = -1;
-	int pos = 0;
 	size_t j;
 
 	/* generate unique index if neccesary */
@@ -193,7 +281,7 @@ int array_insert_unique(array *a, data_unset *str) {
 	}
 
 	/* try to find the string */
-	if (-1 != (ndx = array_get_index(a, CONST_BUF_LEN(str->key), &pos))) {
+	if (-1 != (ndx = array_get_index(a, CONST_BUF_LEN(str->key)))) {
 		/* found, leave here */
 		if (a->data[ndx]->type == str->type) {
 			str->insert_dup(a->data[ndx], str);
@@ -213,16 +301,13 @@ int array_insert_unique(array *a, data_unset *str) {
 	if (a->size == 0) {
 		a->size   = 16;
 		a->data   = malloc(sizeof(*a->data)     * a->size);
-		a->sorted = malloc(sizeof(*a->sorted)   * a->size);
 		force_assert(a->data);
-		force_assert(a->sorted);
 		for (j = a->used; j < a->size; j++) a->data[j] = NULL;
 	} else if (a->size == a->used) {
-		a->size  += 16;
+		/* grow geometrically, bulk loading large config lists stays linear */
+		a->size  += a->size;
 		a->data   = realloc(a->data,   sizeof(*a->data)   * a->size);
-		a->sorted = realloc(a->sorted, sizeof(*a->sorted) * a->size);
 		force_assert(a->data);
-		force_assert(a->sorted);
 		for (j = a->used; j < a->size; j++) a->data[j] = NULL;
 	}
 
@@ -232,23 +317,15 @@ int array_insert_unique(array *a, data_unset *str) {
 	if (a->data[ndx]) a->data[ndx]->free(a->data[ndx]);
 
 	a->data[a->used++] = str;
+	a->is_sorted = 0;
 
-	if (pos != ndx &&
-	    ((pos < 0) ||
-	     buffer_caseless_compare(CONST_BUF_LEN(str->key), CONST_BUF_LEN(a->data[a->sorted[pos]]->key)) > 0)) {
-		pos++;
-	}
-
-	/* move everything on step to the right */
-	if (pos != ndx) {
-		memmove(a->sorted + (pos + 1), a->sorted + (pos), (ndx - pos) * sizeof(*a->sorted));
+	/* keep the load factor at or below 1/2 */
+	if (a->used * 2 > a->hash_size) {
+		array_hash_resize(a, a->hash_size ? a->hash_size * 2 : 32);
+	} else {
+		array_hash_insert(a, ndx);
 	}
 
-	/* insert */
-	a->sorted[pos] = ndx;
-
-	if (a->next_power_of_2 == (size_t)ndx) a->next_power_of_2 <<= 1;
-
 	return 0;
 }
 
@@ -343,13 +420,43 @@ int array_print(array *a, int depth) {
 }
 
 #ifdef DEBUG_ARRAY
+#include <time.h>
+
+/* microbenchmark: ./array <entries>
+ * inserts <entries> keys and looks each of them up with different case */
+static int array_benchmark(size_t n) {
+	array *a = array_init();
+	char key[32];
+	clock_t start;
+	size_t i, found = 0;
+
+	start = clock();
+	for (i = 0; i < n; i++) {
+		data_string *ds = data_string_init();
+		buffer_copy_string_len(ds->key, key, snprintf(key, sizeof(key), "text/x-type-%zu", i));
+		buffer_copy_string_len(ds->value, CONST_STR_LEN("value"));
+		array_insert_unique(a, (data_unset *)ds);
+	}
+	fprintf(stdout, "insert: %zu entries in %.3fs\n", n, (double)(clock() - start) / CLOCKS_PER_SEC);
+
+	start = clock();
+	for (i = 0; i < n; i++) {
+		snprintf(key, sizeof(key), "TEXT/X-Type-%zu", i);
+		if (NULL != array_get_element(a, key)) found++;
+	}
+	fprintf(stdout, "lookup: %zu of %zu found in %.3fs\n", found, n, (double)(clock() - start) / CLOCKS_PER_SEC);
+
+	array_free(a);
+
+	return found == n ? 0 : 1;
+}
+
 int main (int argc, char **argv) {
 	array *a;
 	data_string *ds;
 	data_count *dc;
 
-	UNUSED(argc);
-	UNUSED(argv);
+	if (argc > 1) return array_benchmark(strtoul(argv[1], NULL, 10));
 
 	a = array_init();
 
@@ -31,16 +31,21 @@ typedef struct data_unset {
 } data_unset;
 
 typedef struct {
-	data_unset  **data;
+	data_unset  **data; /* in insertion order */
 
-	size_t *sorted;
+	/* open addressing with linear probing over the caseless key hash;
+	 * a slot holds (index in data + 1), 0 marks a free slot */
+	size_t *hash;
+	size_t hash_size; /* power of 2, kept at least twice as large as used */
+
+	size_t *sorted; /* see array_get_sorted_index() */
+	int is_sorted;
 
 	size_t used;
 	size_t size;
 
 	size_t unique_ndx;
 
-	size_t next_power_of_2;
 	int is_weakref; /* data is weakref, don't bother the data */
 } array;
 
@@ -126,6 +131,9 @@ struct _data_config {
 	data_config *next;
 
 	buffer *string;
+	int host_index; /* group in srv->config_host_index, -1 if not indexed */
+	int host_id;
+	struct cidr_tree *remote_ip; /* networks of $HTTP["remoteip"] ==/!= */
 #ifdef HAVE_PCRE_H
 	pcre   *regex;
 	pcre_extra *regex_study;
@@ -168,6 +176,7 @@ data_unset *array_pop(array *a);
 int array_print(array *a, int depth);
 data_unset *array_get_unused_element(array *a, data_type_t t);
 data_unset *array_get_element(array *a, const char *key);
+size_t *array_get_sorted_index(array *a);
 void array_set_key_value(array *hdrs, const char *key, size_t key_len, const char *value, size_t val_len);
 data_unset *array_replace(array *a, data_unset *du);
 int array_strcasecmp(const char *a, size_t a_len, const char *b, size_t b_len);
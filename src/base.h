@@ -168,6 +168,15 @@ typedef struct {
 	/* CONTENT */
 	size_t content_length; /* returned by strtoul() */
 
+	/* Transfer-Encoding: chunked request body decoder */
+	enum { TE_CHUNKED_UNSET,
+			TE_CHUNKED_SIZE,       /* expecting a chunk-size line */
+			TE_CHUNKED_DATA,       /* te_chunked_len bytes of chunk-data left */
+			TE_CHUNKED_DATA_END,   /* expecting the CRLF after chunk-data */
+			TE_CHUNKED_TRAILER     /* skipping trailer lines up to the empty line */
+	} te_chunked;
+	off_t te_chunked_len;
+
 	/* internal representation */
 	int     accept_encoding;
 
@@ -208,27 +217,55 @@ typedef struct {
 	buffer *etag;
 } physical;
 
-typedef struct {
+typedef struct stat_cache_entry {
 	buffer *name;
 	buffer *etag;
 
 	struct stat st;
 
 	time_t stat_ts;
+	int stat_errno; /* ENOENT or ENOTDIR for a cached miss, 0 otherwise */
+	chunk_file_fd *fdref; /* open fd of a regular file, see stat_cache_entry_get_fd() */
+	chunk_shared_mem *content; /* contents of a small file, see stat_cache_entry_get_content() */
+	struct stat_cache_entry *content_prev, *content_next;
 
 #ifdef HAVE_LSTAT
 	char is_symlink;
 #endif
 
-#ifdef HAVE_FAM_H
+#if defined(HAVE_FAM_H) || defined(HAVE_SYS_INOTIFY_H)
 	int    dir_version;
 #endif
+#ifdef HAVE_SYS_INOTIFY_H
+	struct stat_cache_notify_dir *notify_dir; /* watched directory, NULL if not watched */
+	int notify_symlink; /* the name is a symlink, changes of the target are not reported */
+#endif
 
 	buffer *content_type;
+
+	/* stat_cache bookkeeping */
+	size_t hash;
+	int follow_symlink; /* entries are kept per name and con->conf.follow_symlink */
+	time_t access_ts;   /* last lookup */
+	struct stat_cache_entry *hash_next;
+	struct stat_cache_entry *lru_prev, *lru_next;
 } stat_cache_entry;
 
 typedef struct {
-	splay_tree *files; /* the nodes of the tree are stat_cache_entry's */
+	stat_cache_entry **files; /* hash table, chained through sce->hash_next */
+	size_t files_size;        /* power of 2 */
+	size_t files_used;
+
+	/* all entries, most recently used first; access_ts never increases towards the tail */
+	stat_cache_entry *lru_head;
+	stat_cache_entry *lru_tail;
+
+	size_t fds_used; /* entries with an open fd */
+
+	/* entries with cached content, most recently used first */
+	stat_cache_entry *content_head;
+	stat_cache_entry *content_tail;
+	off_t content_bytes;
 
 	buffer *dir_name; /* for building the dirname from the filename */
 #ifdef HAVE_FAM_H
@@ -236,6 +273,13 @@ typedef struct {
 
 	FAMConnection fam;
 	int    fam_fcce_ndx;
+#endif
+#ifdef HAVE_SYS_INOTIFY_H
+	splay_tree *notify_dirs; /* watched directories, keyed by the watch descriptor */
+
+	int    notify_fd;
+	int    notify_fde_ndx;
+	int    notify_full; /* logged running out of watches */
 #endif
 	buffer *hash_key;  /* temp-store for the hash-key */
 } stat_cache;
@@ -248,6 +292,7 @@ typedef struct {
 	buffer *server_name;
 	buffer *error_handler;
 	buffer *server_tag;
+	buffer *server_tag_header; /* "\r\nServer: ..." built from server_tag at config load */
 	buffer *dirlist_encoding;
 	buffer *errorfile_prefix;
 
@@ -353,6 +398,9 @@ typedef struct {
 	comp_key_t comp_type;
 } cond_cache_t;
 
+/* opaque, see configfile-glue.c */
+typedef struct config_snapshots config_snapshots;
+
 typedef struct {
 	connection_state_t state;
 
@@ -392,6 +440,8 @@ typedef struct {
 	chunkqueue *request_content_queue; /* takes request-content into tempfile if necessary [ tempfile, mem ]*/
 
 	int traffic_limit_reached;
+	int backend_paused;           /* the backend stopped reading as the write_queue is above server.max-response-buffer */
+	int request_body_streaming;   /* 1: the backend takes the request body while it arrives, -1: it waits for all of it, 0: not decided yet */
 
 	off_t bytes_written;          /* used by mod_accesslog, mod_rrd */
 	off_t bytes_written_cur_second; /* used by mod_accesslog, mod_rrd */
@@ -416,6 +466,8 @@ typedef struct {
 
 	array  *environment; /* used to pass lighttpd internal stuff to the FastCGI/CGI apps, setenv does that */
 
+	buffer_pool *request_buffers; /* temporary buffers of the current request, taken back by connection_reset() */
+
 	/* response */
 	int    got_response;
 
@@ -427,6 +479,9 @@ typedef struct {
 
 	specific_config conf;        /* global connection specific config */
 	cond_cache_t *cond_cache;
+	int *cond_cache_set;          /* indices of the cond_cache entries with a result */
+	size_t cond_cache_set_used;
+	int *cond_host_match;        /* per srv->config_host_index: matched host id without/with port; 0: not looked up */
 
 	buffer *server_name;
 
@@ -501,6 +556,7 @@ typedef struct {
 	buffer *groupname;
 
 	buffer *pid_file;
+	buffer *config_basedir; /* directory of the config file, relative file names in it are based here */
 
 	buffer *event_handler;
 
@@ -523,10 +579,21 @@ typedef struct {
 			STAT_CACHE_ENGINE_SIMPLE
 #ifdef HAVE_FAM_H
 			, STAT_CACHE_ENGINE_FAM
+#endif
+#ifdef HAVE_SYS_INOTIFY_H
+			, STAT_CACHE_ENGINE_INOTIFY
 #endif
 	} stat_cache_engine;
 	unsigned short enable_cores;
 	unsigned short reject_expect_100_with_417;
+	unsigned short stream_request_body; /* hand the request body to the backend while it is still being received */
+	unsigned int max_response_buffer; /* kbytes of backend response buffered per connection, 0 = unlimited */
+	unsigned short response_buffer_spill; /* spill the response to tempfiles instead of pausing the backend */
+	unsigned int max_buffered_memory; /* kbytes in memory chunks of all connections, 0 = unlimited */
+	unsigned int stat_cache_max_entries; /* 0 = unlimited */
+	unsigned int stat_cache_max_fds; /* open fds kept in the stat cache, 0 = disabled */
+	unsigned int small_file_cache_memory; /* kbytes of file contents kept in the stat cache, 0 = disabled */
+	unsigned int small_file_cache_max_size; /* kbytes, larger files are not kept in memory */
 } server_config;
 
 typedef struct server_socket {
@@ -616,6 +683,9 @@ typedef struct server {
 
 	array *config_context;
 	specific_config **config_storage;
+	array **config_host_index;   /* sibling $HTTP["host"] == "..." conditionals: host => data_integer id */
+	size_t config_host_index_used;
+	config_snapshots *config_snapshots; /* merged con->conf by matching conditionals */
 
 	server_config  srvconf;
 
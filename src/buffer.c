@@ -61,6 +61,64 @@ void buffer_reset(buffer *b) {
 	b->used = 0;
 }
 
+void buffer_clear(buffer *b) {
+	if (NULL == b) return;
+
+	if (b->size > 0) b->ptr[0] = '\0';
+	b->used = 0;
+}
+
+buffer_pool* buffer_pool_init(void) {
+	buffer_pool *bp = calloc(1, sizeof(*bp));
+	force_assert(bp);
+
+	return bp;
+}
+
+void buffer_pool_free(buffer_pool *bp) {
+	size_t i;
+
+	if (NULL == bp) return;
+
+	for (i = 0; i < bp->count; i++) {
+		buffer_free(bp->ptr[i]);
+	}
+	free(bp->ptr);
+	free(bp);
+}
+
+buffer* buffer_pool_get(buffer_pool *bp) {
+	force_assert(NULL != bp);
+
+	if (bp->used == bp->count) {
+		if (bp->count == bp->size) {
+			bp->size += 16;
+			bp->ptr = realloc(bp->ptr, sizeof(*bp->ptr) * bp->size);
+			force_assert(bp->ptr);
+		}
+		bp->ptr[bp->count++] = buffer_init();
+	}
+
+	return bp->ptr[bp->used++];
+}
+
+void buffer_pool_reset(buffer_pool *bp) {
+	size_t i;
+
+	if (NULL == bp) return;
+
+	/* buffer_reset() frees the large ones */
+	for (i = 0; i < bp->used && i < BUFFER_POOL_MAX_KEEP; i++) {
+		buffer_reset(bp->ptr[i]);
+	}
+	for (i = BUFFER_POOL_MAX_KEEP; i < bp->count; i++) {
+		buffer_free(bp->ptr[i]);
+	}
+	if (bp->count > BUFFER_POOL_MAX_KEEP) bp->count = BUFFER_POOL_MAX_KEEP;
+
+	bp->used = 0;
+}
+
 void buffer_move(buffer *b, buffer *src) {
 	buffer tmp;
 
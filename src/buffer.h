@@ -47,6 +47,27 @@ void buffer_free(buffer *b); /* b can be NULL */
 /* truncates to used == 0; frees large buffers, might keep smaller ones for reuse */
 void buffer_reset(buffer *b); /* b can be NULL */
 
+/* a region of buffers for the lifetime of a request: buffers are handed out
+ * with buffer_pool_get() and all taken back by buffer_pool_reset(), which
+ * keeps some of them (and their memory) for the next request.
+ * buffers from a pool must not be freed with buffer_free().
+ */
+typedef struct {
+	buffer **ptr;
+
+	size_t used;  /* buffers handed out since the last reset */
+	size_t count; /* buffers allocated in ptr */
+	size_t size;  /* slots in ptr */
+} buffer_pool;
+
+buffer_pool* buffer_pool_init(void);
+void buffer_pool_free(buffer_pool *bp);
+buffer* buffer_pool_get(buffer_pool *bp); /* empty buffer, valid until buffer_pool_reset() */
+void buffer_pool_reset(buffer_pool *bp);
+
+/* truncates to used == 0; keeps the memory */
+void buffer_clear(buffer *b); /* b can be NULL */
+
 /* reset b. if NULL != b && NULL != src, move src content to b. reset src. */
 void buffer_move(buffer *b, buffer *src);
 
@@ -20,6 +20,91 @@
 #include <errno.h>
 #include <string.h>
 
+/* MEM_CHUNK bytes held by all queues with mem accounting (see chunkqueue_set_mem_accounting) */
+static struct {
+	off_t used;
+	off_t peak;
+	off_t limit; /* 0 = unlimited */
+} chunk_mem;
+
+void chunk_mem_set_limit(off_t limit) {
+	chunk_mem.limit = limit;
+}
+
+off_t chunk_mem_limit(void) {
+	return chunk_mem.limit;
+}
+
+off_t chunk_mem_used(void) {
+	return chunk_mem.used;
+}
+
+off_t chunk_mem_peak(void) {
+	return chunk_mem.peak;
+}
+
+int chunk_mem_over_limit(void) {
+	return 0 != chunk_mem.limit && chunk_mem.used > chunk_mem.limit;
+}
+
+static void chunkqueue_mem_add(chunkqueue *cq, off_t len) {
+	if (!cq->mem_accounted) return;
+
+	cq->mem_bytes += len;
+	chunk_mem.used += len;
+	if (chunk_mem.used > chunk_mem.peak) chunk_mem.peak = chunk_mem.used;
+}
+
+/* a chunk enters (sign = 1) or leaves (sign = -1) the queue */
+static void chunkqueue_mem_account(chunkqueue *cq, const chunk *c, int sign) {
+	if (MEM_CHUNK != c->type) return;
+
+	chunkqueue_mem_add(cq, sign * (off_t)buffer_string_length(c->mem));
+}
+
+/* spare chunks of all queues; a chunk keeps the memory of its mem buffer
+ * and is sorted into a class by its size:
+ * class 0 up to BUFFER_MAX_REUSE_SIZE, class i up to BUFFER_MAX_REUSE_SIZE << i */
+#define CHUNK_POOL_CLASSES 5 /* up to 64kbyte */
+#define CHUNK_POOL_MAX_CHUNKS 1024
+#define CHUNK_POOL_MAX_BYTES (4 * 1024 * 1024)
+
+static struct {
+	chunk *unused[CHUNK_POOL_CLASSES];
+	size_t chunks;
+	size_t bytes;
+
+	size_t hits;
+	size_t misses;
+} chunk_pool;
+
+size_t chunk_pool_chunks(void) {
+	return chunk_pool.chunks;
+}
+
+size_t chunk_pool_bytes(void) {
+	return chunk_pool.bytes;
+}
+
+size_t chunk_pool_hits(void) {
+	return chunk_pool.hits;
+}
+
+size_t chunk_pool_misses(void) {
+	return chunk_pool.misses;
+}
+
+/* -1 if the memory is too large to be kept */
+static int chunk_pool_class(size_t size) {
+	int i;
+
+	for (i = 0; i < CHUNK_POOL_CLASSES; i++) {
+		if (size <= ((size_t)BUFFER_MAX_REUSE_SIZE << i)) return i;
+	}
+
+	return -1;
+}
+
 chunkqueue *chunkqueue_init(void) {
 	chunkqueue *cq;
 
@@ -28,11 +113,55 @@ chunkqueue *chunkqueue_init(void) {
 	cq->first = NULL;
 	cq->last = NULL;
 
-	cq->unused = NULL;
-
 	return cq;
 }
 
+chunk_file_fd *chunk_file_fd_init(int fd) {
+	chunk_file_fd *ffd = calloc(1, sizeof(*ffd));
+	force_assert(NULL != ffd);
+
+	ffd->fd = fd;
+	ffd->refcount = 1;
+
+	return ffd;
+}
+
+void chunk_file_fd_ref(chunk_file_fd *ffd) {
+	++ffd->refcount;
+}
+
+void chunk_file_fd_unref(chunk_file_fd *ffd) {
+	force_assert(ffd->refcount > 0);
+
+	if (0 != --ffd->refcount) return;
+
+	close(ffd->fd);
+	free(ffd);
+}
+
+chunk_shared_mem *chunk_shared_mem_init(buffer *mem) {
+	chunk_shared_mem *sm = calloc(1, sizeof(*sm));
+	force_assert(NULL != sm);
+
+	sm->mem = mem;
+	sm->refcount = 1;
+
+	return sm;
+}
+
+void chunk_shared_mem_ref(chunk_shared_mem *sm) {
+	++sm->refcount;
+}
+
+void chunk_shared_mem_unref(chunk_shared_mem *sm) {
+	force_assert(sm->refcount > 0);
+
+	if (0 != --sm->refcount) return;
+
+	buffer_free(sm->mem);
+	free(sm);
+}
+
 static chunk *chunk_init(void) {
 	chunk *c;
 
@@ -57,7 +186,8 @@ static void chunk_reset(chunk *c) {
 
 	c->type = MEM_CHUNK;
 
-	buffer_reset(c->mem);
+	/* the memory stays with the chunk in the pool */
+	buffer_clear(c->mem);
 
 	if (c->file.is_temp && !buffer_string_is_empty(c->file.name)) {
 		unlink(c->file.name->ptr);
@@ -65,7 +195,17 @@ static void chunk_reset(chunk *c) {
 
 	buffer_reset(c->file.name);
 
-	if (c->file.fd != -1) {
+	if (NULL != c->shared.ref) {
+		chunk_shared_mem_unref(c->shared.ref);
+		c->shared.ref = NULL;
+	}
+	c->shared.start = c->shared.length = 0;
+
+	if (NULL != c->file.fdref) {
+		chunk_file_fd_unref(c->file.fdref);
+		c->file.fdref = NULL;
+		c->file.fd = -1;
+	} else if (c->file.fd != -1) {
 		close(c->file.fd);
 		c->file.fd = -1;
 	}
@@ -100,67 +240,124 @@ static off_t chunk_remaining_length(const chunk *c) {
 	case FILE_CHUNK:
 		len = c->file.length;
 		break;
+	case SHARED_CHUNK:
+		len = c->shared.length;
+		break;
 	default:
-		force_assert(c->type == MEM_CHUNK || c->type == FILE_CHUNK);
+		force_assert(c->type == MEM_CHUNK || c->type == FILE_CHUNK || c->type == SHARED_CHUNK);
 		break;
 	}
 	force_assert(c->offset <= len);
 	return len - c->offset;
 }
 
-void chunkqueue_free(chunkqueue *cq) {
-	chunk *c, *pc;
-
-	if (NULL == cq) return;
-
-	for (c = cq->first; c; ) {
-		pc = c;
-		c = c->next;
-		chunk_free(pc);
-	}
-
-	for (c = cq->unused; c; ) {
-		pc = c;
-		c = c->next;
-		chunk_free(pc);
+const char *chunk_mem_data(const chunk *c, size_t *len) {
+	switch (c->type) {
+	case MEM_CHUNK:
+		force_assert(c->offset >= 0 && c->offset <= (off_t)buffer_string_length(c->mem));
+		*len = buffer_string_length(c->mem) - c->offset;
+		return c->mem->ptr + c->offset;
+	case SHARED_CHUNK:
+		force_assert(c->offset >= 0 && c->offset <= (off_t)c->shared.length);
+		*len = c->shared.length - c->offset;
+		return c->shared.ref->mem->ptr + c->shared.start + c->offset;
+	default:
+		force_assert(c->type == MEM_CHUNK || c->type == SHARED_CHUNK);
+		return NULL;
 	}
-
-	free(cq);
 }
 
 static void chunkqueue_push_unused_chunk(chunkqueue *cq, chunk *c) {
+	int i;
+
 	force_assert(NULL != cq && NULL != c);
 
-	/* keep at max 4 chunks in the 'unused'-cache */
-	if (cq->unused_chunks > 4) {
+	chunkqueue_mem_account(cq, c, -1);
+
+	chunk_reset(c);
+
+	if (-1 == (i = chunk_pool_class(c->mem->size))) {
+		/* frees the large memory */
+		buffer_reset(c->mem);
+		i = 0;
+	}
+
+	if (chunk_pool.chunks >= CHUNK_POOL_MAX_CHUNKS
+	    || chunk_pool.bytes + c->mem->size > CHUNK_POOL_MAX_BYTES) {
 		chunk_free(c);
-	} else {
-		chunk_reset(c);
-		c->next = cq->unused;
-		cq->unused = c;
-		cq->unused_chunks++;
+		return;
 	}
+
+	c->next = chunk_pool.unused[i];
+	chunk_pool.unused[i] = c;
+	chunk_pool.chunks++;
+	chunk_pool.bytes += c->mem->size;
 }
 
-static chunk *chunkqueue_get_unused_chunk(chunkqueue *cq) {
+/* a chunk from the pool, preferably with memory for "mem_size" bytes */
+static chunk *chunkqueue_get_unused_chunk(chunkqueue *cq, size_t mem_size) {
 	chunk *c;
+	int i, k;
 
 	force_assert(NULL != cq);
 
-	/* check if we have a unused chunk */
-	if (0 == cq->unused) {
-		c = chunk_init();
-	} else {
-		/* take the first element from the list (a stack) */
-		c = cq->unused;
-		cq->unused = c->next;
-		c->next = NULL;
-		cq->unused_chunks--;
+	/* look for the class of mem_size first, then the larger and
+	 * the smaller classes */
+	if (-1 == (k = chunk_pool_class(mem_size + 1))) k = CHUNK_POOL_CLASSES - 1;
+
+	for (i = k; i < CHUNK_POOL_CLASSES && NULL == chunk_pool.unused[i]; i++) ;
+	if (CHUNK_POOL_CLASSES == i) {
+		for (i = k - 1; i >= 0 && NULL == chunk_pool.unused[i]; i--) ;
 	}
 
+	if (-1 == i) {
+		chunk_pool.misses++;
+		return chunk_init();
+	}
+
+	/* take the first element from the list (a stack) */
+	c = chunk_pool.unused[i];
+	chunk_pool.unused[i] = c->next;
+	c->next = NULL;
+	chunk_pool.chunks--;
+	chunk_pool.bytes -= c->mem->size;
+	chunk_pool.hits++;
+
 	return c;
 }
 
+void chunkqueue_free(chunkqueue *cq) {
+	chunk *c, *pc;
+
+	if (NULL == cq) return;
+
+	for (c = cq->first; c; ) {
+		pc = c;
+		c = c->next;
+		chunkqueue_push_unused_chunk(cq, pc);
+	}
+
+	free(cq);
+}
+
+void chunk_pool_free(void) {
+	int i;
+
+	for (i = 0; i < CHUNK_POOL_CLASSES; i++) {
+		chunk *c = chunk_pool.unused[i];
+
+		while (NULL != c) {
+			chunk *next = c->next;
+			chunk_free(c);
+			c = next;
+		}
+		chunk_pool.unused[i] = NULL;
+	}
+
+	chunk_pool.chunks = 0;
+	chunk_pool.bytes = 0;
+}
+
 static void chunkqueue_prepend_chunk(chunkqueue *cq, chunk *c) {
 	c->next = cq->first;
 	cq->first = c;
@@ -169,6 +366,7 @@ static void chunkqueue_prepend_chunk(chunkqueue *cq, chunk *c) {
 		cq->last = c;
 	}
 	cq->bytes_in += chunk_remaining_length(c);
+	chunkqueue_mem_account(cq, c, 1);
 }
 
 static void chunkqueue_append_chunk(chunkqueue *cq, chunk *c) {
@@ -181,6 +379,7 @@ static void chunkqueue_append_chunk(chunkqueue *cq, chunk *c) {
 		cq->first = c;
 	}
 	cq->bytes_in += chunk_remaining_length(c);
+	chunkqueue_mem_account(cq, c, 1);
 }
 
 void chunkqueue_reset(chunkqueue *cq) {
@@ -203,7 +402,7 @@ void chunkqueue_append_file(chunkqueue *cq, buffer *fn, off_t offset, off_t len)
 
 	if (0 == len) return;
 
-	c = chunkqueue_get_unused_chunk(cq);
+	c = chunkqueue_get_unused_chunk(cq, 0);
 
 	c->type = FILE_CHUNK;
 
@@ -220,7 +419,7 @@ void chunkqueue_append_buffer(chunkqueue *cq, buffer *mem) {
 
 	if (buffer_string_is_empty(mem)) return;
 
-	c = chunkqueue_get_unused_chunk(cq);
+	c = chunkqueue_get_unused_chunk(cq, 0);
 	c->type = MEM_CHUNK;
 	force_assert(NULL != c->mem);
 	buffer_move(c->mem, mem);
@@ -233,7 +432,7 @@ void chunkqueue_prepend_buffer(chunkqueue *cq, buffer *mem) {
 
 	if (buffer_string_is_empty(mem)) return;
 
-	c = chunkqueue_get_unused_chunk(cq);
+	c = chunkqueue_get_unused_chunk(cq, 0);
 	c->type = MEM_CHUNK;
 	force_assert(NULL != c->mem);
 	buffer_move(c->mem, mem);
@@ -241,13 +440,29 @@ void chunkqueue_prepend_buffer(chunkqueue *cq, buffer *mem) {
 	chunkqueue_prepend_chunk(cq, c);
 }
 
+void chunkqueue_append_shared_mem(chunkqueue *cq, chunk_shared_mem *sm, size_t offset, size_t len) {
+	chunk *c;
+
+	if (0 == len) return;
+
+	force_assert(offset + len <= buffer_string_length(sm->mem));
+
+	c = chunkqueue_get_unused_chunk(cq, 0);
+	c->type = SHARED_CHUNK;
+	chunk_shared_mem_ref(sm);
+	c->shared.ref = sm;
+	c->shared.start = offset;
+	c->shared.length = len;
+
+	chunkqueue_append_chunk(cq, c);
+}
 
 void chunkqueue_append_mem(chunkqueue *cq, const char * mem, size_t len) {
 	chunk *c;
 
 	if (0 == len) return;
 
-	c = chunkqueue_get_unused_chunk(cq);
+	c = chunkqueue_get_unused_chunk(cq, len);
 	c->type = MEM_CHUNK;
 	buffer_copy_string_len(c->mem, mem, len);
 
@@ -303,7 +518,7 @@ void chunkqueue_get_memory(chunkqueue *cq, char **mem, size_t *len, size_t min_s
 	}
 
 	/* allocate new chunk */
-	c = chunkqueue_get_unused_chunk(cq);
+	c = chunkqueue_get_unused_chunk(cq, alloc_size);
 	c->type = MEM_CHUNK;
 	chunkqueue_append_chunk(cq, c);
 
@@ -324,6 +539,7 @@ void chunkqueue_use_memory(chunkqueue *cq, size_t len) {
 	if (len > 0) {
 		buffer_commit(b, len);
 		cq->bytes_in += len;
+		chunkqueue_mem_add(cq, len);
 	} else if (buffer_string_is_empty(b)) {
 		/* unused buffer: can't remove chunk easily from
 		 * end of list, so just reset the buffer
@@ -332,6 +548,11 @@ void chunkqueue_use_memory(chunkqueue *cq, size_t len) {
 	}
 }
 
+void chunkqueue_set_mem_accounting(chunkqueue *cq) {
+	force_assert(NULL != cq && NULL == cq->first);
+	cq->mem_accounted = 1;
+}
+
 void chunkqueue_set_tempdirs(chunkqueue *cq, array *tempdirs, unsigned int upload_temp_file_size) {
 	force_assert(NULL != cq);
 	cq->tempdirs = tempdirs;
@@ -362,6 +583,7 @@ void chunkqueue_steal(chunkqueue *dest, chunkqueue *src, off_t len) {
 			src->first = c->next;
 			if (c == src->last) src->last = NULL;
 
+			chunkqueue_mem_account(src, c, -1);
 			chunkqueue_append_chunk(dest, c);
 		} else {
 			/* partial chunk with length "use" */
@@ -374,6 +596,9 @@ void chunkqueue_steal(chunkqueue *dest, chunkqueue *src, off_t len) {
 				/* tempfile flag is in "last" chunk after the split */
 				chunkqueue_append_file(dest, c->file.name, c->file.start + c->offset, use);
 				break;
+			case SHARED_CHUNK:
+				chunkqueue_append_shared_mem(dest, c->shared.ref, c->shared.start + c->offset, use);
+				break;
 			}
 
 			c->offset += use;
@@ -412,7 +637,7 @@ static chunk *chunkqueue_get_append_tempfile(chunkqueue *cq) {
 		return NULL;
 	}
 
-	c = chunkqueue_get_unused_chunk(cq);
+	c = chunkqueue_get_unused_chunk(cq, 0);
 	c->type = FILE_CHUNK;
 	c->file.fd = fd;
 	c->file.is_temp = 1;
@@ -430,7 +655,7 @@ static chunk *chunkqueue_get_append_tempfile(chunkqueue *cq) {
 #define DEFAULT_TEMPFILE_SIZE (1 * 1024 * 1024)
 #define MAX_TEMPFILE_SIZE (128 * 1024 * 1024)
 
-static int chunkqueue_append_to_tempfile(server *srv, chunkqueue *dest, const char *mem, size_t len) {
+int chunkqueue_append_mem_to_tempfile(server *srv, chunkqueue *dest, const char *mem, size_t len) {
 	/* copy everything to max max_tempfile_size sized tempfiles */
 	const off_t max_tempfile_size
 		= (0 == dest->upload_temp_file_size)                ? DEFAULT_TEMPFILE_SIZE
@@ -477,7 +702,7 @@ static int chunkqueue_append_to_tempfile(server *srv, chunkqueue *dest, const ch
 		 */
 
 		log_error_write(srv, __FILE__, __LINE__, "ss",
-			"denying upload as opening temp-file for upload failed:",
+			"opening temp-file failed:",
 			strerror(errno));
 
 		return -1;
@@ -486,7 +711,7 @@ static int chunkqueue_append_to_tempfile(server *srv, chunkqueue *dest, const ch
 	if (0 > (written = write(dst_c->file.fd, mem, len)) || (size_t) written != len) {
 		/* write failed for some reason ... disk full ? */
 		log_error_write(srv, __FILE__, __LINE__, "sbs",
-				"denying upload as writing to file failed:",
+				"writing to temp-file failed:",
 				dst_c->file.name, strerror(errno));
 
 		close(dst_c->file.fd);
@@ -502,6 +727,8 @@ static int chunkqueue_append_to_tempfile(server *srv, chunkqueue *dest, const ch
 }
 
 int chunkqueue_steal_with_tempfiles(server *srv, chunkqueue *dest, chunkqueue *src, off_t len) {
+	size_t dummy_len;
+
 	while (len > 0) {
 		chunk *c = src->first;
 		off_t clen = 0, use;
@@ -538,8 +765,9 @@ int chunkqueue_steal_with_tempfiles(server *srv, chunkqueue *dest, chunkqueue *s
 			break;
 
 		case MEM_CHUNK:
+		case SHARED_CHUNK:
 			/* store "use" bytes from memory chunk in tempfile */
-			if (0 != chunkqueue_append_to_tempfile(srv, dest, c->mem->ptr + c->offset, use)) {
+			if (0 != chunkqueue_append_mem_to_tempfile(srv, dest, chunk_mem_data(c, &dummy_len), use)) {
 				return -1;
 			}
 
@@ -4,11 +4,38 @@
 #include "buffer.h"
 #include "array.h"
 
+/* an fd shared by file chunks (and the stat cache), closed with the last reference */
+typedef struct chunk_file_fd {
+	int fd;
+	int refcount;
+} chunk_file_fd;
+
+chunk_file_fd *chunk_file_fd_init(int fd); /* takes ownership of fd, refcount 1 */
+void chunk_file_fd_ref(chunk_file_fd *ffd);
+void chunk_file_fd_unref(chunk_file_fd *ffd);
+
+/* read-only memory shared by the chunks of many queues (and the stat cache), freed with the last reference */
+typedef struct chunk_shared_mem {
+	buffer *mem;
+	int refcount;
+} chunk_shared_mem;
+
+chunk_shared_mem *chunk_shared_mem_init(buffer *mem); /* takes ownership of mem, refcount 1 */
+void chunk_shared_mem_ref(chunk_shared_mem *sm);
+void chunk_shared_mem_unref(chunk_shared_mem *sm);
+
 typedef struct chunk {
-	enum { MEM_CHUNK, FILE_CHUNK } type;
+	enum { MEM_CHUNK, FILE_CHUNK, SHARED_CHUNK } type;
 
 	buffer *mem; /* either the storage of the mem-chunk or the read-ahead buffer */
 
+	struct {
+		/* shared-mem chunk: references a part of a chunk_shared_mem, which must not be modified */
+		chunk_shared_mem *ref;
+		size_t start; /* starting offset in ref->mem */
+		size_t length; /* octets to send from the starting offset */
+	} shared;
+
 	struct {
 		/* filechunk */
 		buffer *name; /* name of the file */
@@ -16,6 +43,7 @@ typedef struct chunk {
 		off_t  length; /* octets to send from the starting offset */
 
 		int    fd;
+		chunk_file_fd *fdref; /* if set, fd is shared and owned by fdref */
 		struct {
 			char   *start; /* the start pointer of the mmap'ed area */
 			size_t length; /* size of the mmap'ed area */
@@ -28,6 +56,7 @@ typedef struct chunk {
 	/* the size of the chunk is either:
 	 * - mem-chunk: buffer_string_length(chunk::mem)
 	 * - file-chunk: chunk::file.length
+	 * - shared-mem-chunk: chunk::shared.length
 	 */
 	off_t  offset; /* octets sent from this chunk */
 
@@ -38,21 +67,26 @@ typedef struct {
 	chunk *first;
 	chunk *last;
 
-	chunk *unused;
-	size_t unused_chunks;
-
 	off_t bytes_in, bytes_out;
 
 	array *tempdirs;
 	unsigned int upload_temp_file_size;
+
+	int mem_accounted; /* count MEM_CHUNK bytes in the server-wide budget */
+	off_t mem_bytes;   /* MEM_CHUNK bytes held by this queue if accounted */
 } chunkqueue;
 
 chunkqueue *chunkqueue_init(void);
 void chunkqueue_set_tempdirs(chunkqueue *cq, array *tempdirs, unsigned int upload_temp_file_size);
+void chunkqueue_set_mem_accounting(chunkqueue *cq); /* only on an empty queue */
 void chunkqueue_append_file(chunkqueue *cq, buffer *fn, off_t offset, off_t len); /* copies "fn" */
 void chunkqueue_append_mem(chunkqueue *cq, const char *mem, size_t len); /* copies memory */
 void chunkqueue_append_buffer(chunkqueue *cq, buffer *mem); /* may reset "mem" */
 void chunkqueue_prepend_buffer(chunkqueue *cq, buffer *mem); /* may reset "mem" */
+void chunkqueue_append_shared_mem(chunkqueue *cq, chunk_shared_mem *sm, size_t offset, size_t len); /* references "sm" */
+
+/* the unsent data of a MEM_CHUNK or SHARED_CHUNK */
+const char *chunk_mem_data(const chunk *c, size_t *len);
 
 /* functions to handle buffers to read into: */
 /* return a pointer to a buffer in *mem with size *len;
@@ -78,6 +112,9 @@ void chunkqueue_remove_finished_chunks(chunkqueue *cq);
 
 void chunkqueue_steal(chunkqueue *dest, chunkqueue *src, off_t len);
 struct server;
+/* append "mem" to the last tempfile in the queue or a new one; returns 0 on success */
+int chunkqueue_append_mem_to_tempfile(struct server *srv, chunkqueue *dest, const char *mem, size_t len);
+
 int chunkqueue_steal_with_tempfiles(struct server *srv, chunkqueue *dest, chunkqueue *src, off_t len);
 
 off_t chunkqueue_length(chunkqueue *cq);
@@ -86,4 +123,19 @@ void chunkqueue_reset(chunkqueue *cq);
 
 int chunkqueue_is_empty(chunkqueue *cq);
 
+/* server-wide budget for the MEM_CHUNK bytes of the accounted queues;
+ * SHARED_CHUNKs are not counted, their memory doesn't grow with the queues */
+void chunk_mem_set_limit(off_t limit);
+off_t chunk_mem_limit(void);
+off_t chunk_mem_used(void);
+off_t chunk_mem_peak(void);
+int chunk_mem_over_limit(void);
+
+/* spare chunks are kept in a process-wide pool shared by all queues */
+size_t chunk_pool_chunks(void);
+size_t chunk_pool_bytes(void); /* memory of the mem buffers of the spare chunks */
+size_t chunk_pool_hits(void);  /* chunks taken from the pool */
+size_t chunk_pool_misses(void); /* chunks allocated as the pool was empty */
+void chunk_pool_free(void);
+
 #endif
@@ -0,0 +1,245 @@
+#include "cidr.h"
+#include "buffer.h"
+
+#include <sys/types.h>
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef __WIN32
+#include <arpa/inet.h>
+#endif
+
+static int cidr_bit(const unsigned char *addr, unsigned int i) {
+	return (addr[i >> 3] >> (7 - (i & 7))) & 1;
+}
+
+/* number of leading bits a and b have in common, at most maxlen */
+static unsigned int cidr_common_bits(const unsigned char *a, const unsigned char *b, unsigned int maxlen) {
+	unsigned int i;
+
+	for (i = 0; i < maxlen; i += 8) {
+		unsigned char x = a[i >> 3] ^ b[i >> 3];
+
+		if (0 != x) {
+			while (0 == (x & 0x80)) {
+				x <<= 1;
+				i++;
+			}
+			break;
+		}
+	}
+
+	return i < maxlen ? i : maxlen;
+}
+
+static cidr_node *cidr_node_init(const unsigned char *addr, unsigned int len, int is_network) {
+	cidr_node *n;
+	unsigned int i;
+
+	n = calloc(1, sizeof(*n));
+	force_assert(n);
+
+	memcpy(n->addr, addr, (len + 7) / 8);
+	if (len & 7) n->addr[len >> 3] &= 0xff << (8 - (len & 7));
+	for (i = (len + 7) / 8; i < sizeof(n->addr); i++) n->addr[i] = 0;
+
+	n->len = len;
+	n->is_network = is_network;
+
+	return n;
+}
+
+static void cidr_node_free(cidr_node *n) {
+	if (NULL == n) return;
+
+	cidr_node_free(n->child[0]);
+	cidr_node_free(n->child[1]);
+	free(n);
+}
+
+static void cidr_node_insert(cidr_node **pn, const unsigned char *addr, unsigned int len) {
+	for (;;) {
+		cidr_node *n = *pn, *m;
+		unsigned int common;
+
+		if (NULL == n) {
+			*pn = cidr_node_init(addr, len, 1);
+			return;
+		}
+
+		common = cidr_common_bits(n->addr, addr, len < n->len ? len : n->len);
+
+		if (common == n->len) {
+			if (len == n->len) {
+				n->is_network = 1;
+				return;
+			}
+
+			pn = &n->child[cidr_bit(addr, n->len)];
+			continue;
+		}
+
+		if (common == len) {
+			/* the new network contains n */
+			m = cidr_node_init(addr, len, 1);
+			m->child[cidr_bit(n->addr, len)] = n;
+		} else {
+			/* branch where the two differ */
+			m = cidr_node_init(addr, common, 0);
+			m->child[cidr_bit(n->addr, common)] = n;
+			m->child[cidr_bit(addr, common)] = cidr_node_init(addr, len, 1);
+		}
+
+		*pn = m;
+		return;
+	}
+}
+
+static int cidr_node_match(const cidr_node *n, const unsigned char *addr, unsigned int bits) {
+	while (n) {
+		if (n->len > 0 && cidr_common_bits(n->addr, addr, n->len) < n->len) return 0;
+
+		/* any network containing the address will do */
+		if (n->is_network) return 1;
+		if (n->len >= bits) return 0;
+
+		n = n->child[cidr_bit(addr, n->len)];
+	}
+
+	return 0;
+}
+
+cidr_tree *cidr_tree_init(void) {
+	cidr_tree *t;
+
+	t = calloc(1, sizeof(*t));
+	force_assert(t);
+
+	return t;
+}
+
+void cidr_tree_free(cidr_tree *t) {
+	if (NULL == t) return;
+
+	cidr_node_free(t->ipv4);
+	cidr_node_free(t->ipv6);
+	free(t);
+}
+
+int cidr_tree_insert(cidr_tree *t, const char *s, size_t len) {
+	char buf[64];
+	unsigned char addr[16];
+	const char *slash;
+	unsigned int bits, prefix_len;
+	int is_ipv6;
+
+	slash = memchr(s, '/', len);
+	if ((size_t)((slash ? slash : s + len) - s) >= sizeof(buf)) return -1;
+
+	memcpy(buf, s, (slash ? slash : s + len) - s);
+	buf[(slash ? slash : s + len) - s] = '\0';
+
+	is_ipv6 = (NULL != strchr(buf, ':'));
+
+	if (is_ipv6) {
+#if defined(HAVE_IPV6) && defined(HAVE_INET_PTON)
+		if (1 != inet_pton(AF_INET6, buf, addr)) return -1;
+		bits = 128;
+#else
+		return -1;
+#endif
+	} else {
+		struct in_addr a;
+#ifdef __WIN32
+		if (INADDR_NONE == (a.s_addr = inet_addr(buf))) return -1;
+#else
+		if (0 == inet_aton(buf, &a)) return -1;
+#endif
+		memcpy(addr, &a.s_addr, 4);
+		bits = 32;
+	}
+
+	prefix_len = bits;
+	if (slash) {
+		const char *p;
+
+		if (slash + 1 == s + len) return -1;
+
+		prefix_len = 0;
+		for (p = slash + 1; p < s + len; p++) {
+			if (!isdigit((unsigned char)*p)) return -1;
+			prefix_len = prefix_len * 10 + (*p - '0');
+			if (prefix_len > bits) return -1;
+		}
+	}
+
+	cidr_node_insert(is_ipv6 ? &t->ipv6 : &t->ipv4, addr, prefix_len);
+	t->used++;
+
+	return 0;
+}
+
+int cidr_tree_insert_file(cidr_tree *t, const char *fn, size_t *line) {
+	FILE *fp;
+	char buf[256];
+
+	*line = 0;
+
+	if (NULL == (fp = fopen(fn, "r"))) return -1;
+
+	while (NULL != fgets(buf, sizeof(buf), fp)) {
+		char *start = buf, *end;
+
+		++*line;
+
+		if (NULL != (end = strchr(start, '#'))) *end = '\0';
+		end = start + strlen(start);
+
+		while (start < end && isspace((unsigned char)*start)) start++;
+		while (end > start && isspace((unsigned char)end[-1])) end--;
+
+		if (start == end) continue;
+
+		if (0 != cidr_tree_insert(t, start, end - start)) {
+			fclose(fp);
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	if (ferror(fp)) {
+		*line = 0;
+		fclose(fp);
+		return -1;
+	}
+
+	fclose(fp);
+	*line = 0;
+
+	return 0;
+}
+
+int cidr_tree_match(const cidr_tree *t, const sock_addr *addr) {
+	switch (addr->plain.sa_family) {
+	case AF_INET:
+		return cidr_node_match(t->ipv4, (const unsigned char *)&addr->ipv4.sin_addr.s_addr, 32);
+#ifdef HAVE_IPV6
+	case AF_INET6: {
+		static const unsigned char mapped[12] = { 0,0,0,0, 0,0,0,0, 0,0,0xff,0xff };
+		const unsigned char *a = (const unsigned char *)addr->ipv6.sin6_addr.s6_addr;
+
+		if (0 == memcmp(a, mapped, sizeof(mapped))) {
+			return cidr_node_match(t->ipv4, a + 12, 32);
+		}
+
+		return cidr_node_match(t->ipv6, a, 128);
+	}
+#endif
+	default:
+		return 0;
+	}
+}
@@ -0,0 +1,40 @@
+#ifndef _CIDR_H_
+#define _CIDR_H_
+
+#include "base.h"
+
+/**
+ * set of IPv4 and IPv6 networks
+ *
+ * a path-compressed binary (patricia) trie per address family; a lookup
+ * walks at most one node per bit of the address
+ */
+
+typedef struct cidr_node {
+	struct cidr_node *child[2];
+	unsigned char addr[16]; /* network, bits after len are zero */
+	unsigned char len;      /* prefix length in bits */
+	unsigned char is_network; /* a listed network ends here */
+} cidr_node;
+
+typedef struct cidr_tree {
+	cidr_node *ipv4;
+	cidr_node *ipv6;
+
+	size_t used; /* number of networks inserted */
+} cidr_tree;
+
+cidr_tree *cidr_tree_init(void);
+void cidr_tree_free(cidr_tree *t);
+
+/* "a.b.c.d", "a.b.c.d/nn", "x:y::z" or "x:y::z/nnn"; -1 if it can't be parsed */
+int cidr_tree_insert(cidr_tree *t, const char *s, size_t len);
+
+/* one network per line, '#' starts a comment
+ * -1 if the file can't be read (errno) or a line can't be parsed (*line set) */
+int cidr_tree_insert_file(cidr_tree *t, const char *fn, size_t *line);
+
+/* IPv4-mapped IPv6 addresses are looked up as IPv4 */
+int cidr_tree_match(const cidr_tree *t, const sock_addr *addr);
+
+#endif
@@ -5,6 +5,7 @@
 #include "plugin.h"
 
 #include "configfile.h"
+#include "cidr.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -227,6 +228,59 @@ static unsigned short sock_addr_get_port(sock_addr *addr) {
 
 static cond_result_t config_check_cond_cached(server *srv, connection *con, data_config *dc);
 
+static int config_host_index_lookup(array *a, buffer *host) {
+	data_integer *di;
+
+	if (buffer_string_is_empty(host)) return -1;
+	if (NULL == (di = (data_integer *)array_get_element(a, host->ptr))) return -1;
+
+	return buffer_is_equal(di->key, host) ? di->value : -1;
+}
+
+/**
+ * $HTTP["host"] == "..." for conditionals grouped by config_index_host_conds()
+ *
+ * the first one of a group asked for looks up the host (as compared by
+ * config_check_cond_nocache) once; everyone else only compares the ids
+ */
+static cond_result_t config_check_cond_host_index(server *srv, connection *con, data_config *dc) {
+	int *match = con->cond_host_match + 2 * dc->host_index;
+	int with_port = (NULL != strchr(dc->string->ptr, ':'));
+	array *a = srv->config_host_index[dc->host_index];
+
+	if (0 == match[0]) {
+		buffer *l = con->uri.authority;
+
+		if (!buffer_string_is_empty(l)) {
+			char *val_colon = strchr(l->ptr, ':');
+
+			if (NULL != val_colon) {
+				match[1] = config_host_index_lookup(a, l);
+				buffer_copy_string_len(srv->cond_check_buf, l->ptr, val_colon - l->ptr);
+				match[0] = config_host_index_lookup(a, srv->cond_check_buf);
+			} else {
+				match[0] = config_host_index_lookup(a, l);
+				buffer_copy_buffer(srv->cond_check_buf, l);
+				buffer_append_string_len(srv->cond_check_buf, CONST_STR_LEN(":"));
+				buffer_append_int(srv->cond_check_buf, sock_addr_get_port(&(con->srv_socket->addr)));
+				match[1] = config_host_index_lookup(a, srv->cond_check_buf);
+			}
+		} else {
+#if defined USE_OPENSSL && ! defined OPENSSL_NO_TLSEXT
+			l = con->tlsext_server_name;
+#endif
+			match[0] = match[1] = config_host_index_lookup(a, l);
+		}
+	}
+
+	if (con->conf.log_condition_handling) {
+		log_error_write(srv, __FILE__, __LINE__,  "bsbsd", dc->comp_key,
+				"(indexed) compare to", dc->string, "in group", dc->host_index);
+	}
+
+	return (match[with_port] == dc->host_id) ? COND_RESULT_TRUE : COND_RESULT_FALSE;
+}
+
 static cond_result_t config_check_cond_nocache(server *srv, connection *con, data_config *dc) {
 	buffer *l;
 	server_socket *srv_sock = con->srv_socket;
@@ -286,6 +340,8 @@ static cond_result_t config_check_cond_nocache(server *srv, connection *con, dat
 		return COND_RESULT_UNSET;
 	}
 
+	if (dc->host_index >= 0) return config_check_cond_host_index(srv, con, dc);
+
 	/* pass the rules */
 
 	switch (dc->comp) {
@@ -331,73 +387,25 @@ static cond_result_t config_check_cond_nocache(server *srv, connection *con, dat
 		break;
 	}
 	case COMP_HTTP_REMOTE_IP: {
-		char *nm_slash;
-		/* handle remoteip limitations
-		 *
-		 * "10.0.0.1" is provided for all comparisions
-		 *
-		 * only for == and != we support
-		 *
-		 * "10.0.0.1/24"
-		 */
-
-		if ((dc->cond == CONFIG_COND_EQ ||
-		     dc->cond == CONFIG_COND_NE) &&
-		    (con->dst_addr.plain.sa_family == AF_INET) &&
-		    (NULL != (nm_slash = strchr(dc->string->ptr, '/')))) {
-			int nm_bits;
-			long nm;
-			char *err;
-			struct in_addr val_inp;
-
-			if (*(nm_slash+1) == '\0') {
-				log_error_write(srv, __FILE__, __LINE__, "sb", "ERROR: no number after / ", dc->string);
-
-				return COND_RESULT_FALSE;
+		/* "10.0.0.1", "10.0.0.0/8", "2001:db8::/32" and "file:..." with
+		 * == and != were compiled by the config parser (see cidr.h) */
+		if (NULL != dc->remote_ip) {
+			int match = cidr_tree_match(dc->remote_ip, &(con->dst_addr));
+
+			if (con->conf.log_condition_handling) {
+				log_error_write(srv, __FILE__, __LINE__,  "bsbsbs", dc->comp_key,
+						"(", con->dst_addr_buf, ") compare to ", dc->string,
+						match ? "matched" : "not matched");
 			}
 
-			nm_bits = strtol(nm_slash + 1, &err, 10);
-
-			if (*err) {
-				log_error_write(srv, __FILE__, __LINE__, "sbs", "ERROR: non-digit found in netmask:", dc->string, err);
-
-				return COND_RESULT_FALSE;
-			}
-
-			if (nm_bits > 32 || nm_bits < 0) {
-				log_error_write(srv, __FILE__, __LINE__, "sbs", "ERROR: invalid netmask:", dc->string, err);
-
-				return COND_RESULT_FALSE;
-			}
-
-			/* take IP convert to the native */
-			buffer_copy_string_len(srv->cond_check_buf, dc->string->ptr, nm_slash - dc->string->ptr);
-#ifdef __WIN32
-			if (INADDR_NONE == (val_inp.s_addr = inet_addr(srv->cond_check_buf->ptr))) {
-				log_error_write(srv, __FILE__, __LINE__, "sb", "ERROR: ip addr is invalid:", srv->cond_check_buf);
-
-				return COND_RESULT_FALSE;
-			}
-
-#else
-			if (0 == inet_aton(srv->cond_check_buf->ptr, &val_inp)) {
-				log_error_write(srv, __FILE__, __LINE__, "sb", "ERROR: ip addr is invalid:", srv->cond_check_buf);
-
-				return COND_RESULT_FALSE;
-			}
-#endif
-
-			/* build netmask */
-			nm = nm_bits ? htonl(~((1 << (32 - nm_bits)) - 1)) : 0;
-
-			if ((val_inp.s_addr & nm) == (con->dst_addr.ipv4.sin_addr.s_addr & nm)) {
+			if (match) {
 				return (dc->cond == CONFIG_COND_EQ) ? COND_RESULT_TRUE : COND_RESULT_FALSE;
 			} else {
 				return (dc->cond == CONFIG_COND_EQ) ? COND_RESULT_FALSE : COND_RESULT_TRUE;
 			}
-		} else {
-			l = con->dst_addr_buf;
 		}
+
+		l = con->dst_addr_buf;
 		break;
 	}
 	case COMP_HTTP_SCHEME:
@@ -521,11 +529,22 @@ static cond_result_t config_check_cond_nocache(server *srv, connection *con, dat
 	return COND_RESULT_FALSE;
 }
 
+/* remember which entries got a result, so resetting doesn't have to walk all of them */
+static void config_cond_cache_set_result(connection *con, int ndx, cond_result_t result) {
+	cond_cache_t *cache = &con->cond_cache[ndx];
+
+	if (COND_RESULT_UNSET == cache->result && COND_RESULT_UNSET != result) {
+		con->cond_cache_set[con->cond_cache_set_used++] = ndx;
+	}
+	cache->result = result;
+}
+
 static cond_result_t config_check_cond_cached(server *srv, connection *con, data_config *dc) {
 	cond_cache_t *caches = con->cond_cache;
 
 	if (COND_RESULT_UNSET == caches[dc->context_ndx].result) {
-		if (COND_RESULT_TRUE == (caches[dc->context_ndx].result = config_check_cond_nocache(srv, con, dc))) {
+		config_cond_cache_set_result(con, dc->context_ndx, config_check_cond_nocache(srv, con, dc));
+		if (COND_RESULT_TRUE == caches[dc->context_ndx].result) {
 			if (dc->next) {
 				data_config *c;
 				if (con->conf.log_condition_handling) {
@@ -533,7 +552,7 @@ static cond_result_t config_check_cond_cached(server *srv, connection *con, data
 							"setting remains of chaining to false");
 				}
 				for (c = dc->next; c; c = c->next) {
-					caches[c->context_ndx].result = COND_RESULT_FALSE;
+					config_cond_cache_set_result(con, c->context_ndx, COND_RESULT_FALSE);
 				}
 			}
 		}
@@ -562,16 +581,26 @@ static cond_result_t config_check_cond_cached(server *srv, connection *con, data
  * if the item is COND_LAST_ELEMENT we reset all items
  */
 void config_cond_cache_reset_item(server *srv, connection *con, comp_key_t item) {
-	size_t i;
+	size_t i, j;
+
+	if (srv->config_host_index_used && (item == COMP_LAST_ELEMENT || item == COMP_HTTP_HOST)) {
+		memset(con->cond_host_match, 0, 2 * srv->config_host_index_used * sizeof(*con->cond_host_match));
+	}
+
+	/* entries still unset have nothing to reset */
+	for (i = 0, j = 0; i < con->cond_cache_set_used; i++) {
+		cond_cache_t *cache = &con->cond_cache[con->cond_cache_set[i]];
 
-	for (i = 0; i < srv->config_context->used; i++) {
 		if (item == COMP_LAST_ELEMENT || 
-		    con->cond_cache[i].comp_type == item) {
-			con->cond_cache[i].result = COND_RESULT_UNSET;
-			con->cond_cache[i].patterncount = 0;
-			con->cond_cache[i].comp_value = NULL;
+		    cache->comp_type == item) {
+			cache->result = COND_RESULT_UNSET;
+			cache->patterncount = 0;
+			cache->comp_value = NULL;
+		} else {
+			con->cond_cache_set[j++] = con->cond_cache_set[i];
 		}
 	}
+	con->cond_cache_set_used = j;
 }
 
 /**
@@ -608,3 +637,229 @@ int config_append_cond_match_buffer(connection *con, data_config *dc, buffer *bu
 	return 1;
 }
 
+
+/**
+ * cache of merged configs
+ *
+ * a *_patch_connection() merges the global config with the options of all
+ * matching conditionals, in order; the result only depends on which of
+ * the conditionals setting one of the options matched. We remember the
+ * merged config for every combination seen so far, keyed by a bitmask
+ * over those conditionals, and hand it out instead of comparing all the
+ * option keys again for every request.
+ */
+
+#define CONFIG_SNAPSHOT_BUCKETS 256
+#define CONFIG_SNAPSHOT_KEY_BITS (sizeof(size_t) * 8)
+
+typedef struct config_snapshot {
+	struct config_snapshot *next;
+	size_t hash;
+	/* followed by the key (key_words size_t) and the merged config (conf_size bytes) */
+} config_snapshot;
+
+struct config_snapshots {
+	size_t *contexts; /* index of each conditional setting at least one of the options */
+	size_t used;
+
+	/* conditionals in srv->config_host_index are keyed by the matched host
+	 * of their group instead of one bit each */
+	int *host_groups;
+	size_t host_groups_used;
+	unsigned char *host_relevant; /* bit per host id of an indexed conditional setting an option */
+
+	size_t key_words;
+	size_t conf_size;
+
+	size_t *key; /* key of the last lookup which missed */
+	size_t key_hash;
+	int key_valid;
+
+	config_snapshot *buckets[CONFIG_SNAPSHOT_BUCKETS];
+	size_t count;
+};
+
+config_snapshots *config_snapshots_init(server *srv, const config_values_t *cv, size_t conf_size) {
+	config_snapshots *cs;
+	size_t i, j;
+
+	cs = calloc(1, sizeof(*cs));
+	force_assert(cs);
+
+	cs->contexts = calloc(srv->config_context->used, sizeof(*cs->contexts));
+	force_assert(cs->contexts);
+
+	/* skip the first, the global context */
+	for (i = 1; i < srv->config_context->used; i++) {
+		data_config *dc = (data_config *)srv->config_context->data[i];
+
+		for (j = 0; cv[j].key; j++) {
+			if (NULL != array_get_element(dc->value, cv[j].key)) break;
+		}
+
+		if (!cv[j].key) continue;
+
+		if (dc->host_index < 0) {
+			cs->contexts[cs->used++] = i;
+			continue;
+		}
+
+		if (NULL == cs->host_relevant) {
+			cs->host_groups = calloc(srv->config_host_index_used, sizeof(*cs->host_groups));
+			cs->host_relevant = calloc(srv->config_context->used / 8 + 1, 1);
+			force_assert(cs->host_groups && cs->host_relevant);
+		}
+
+		cs->host_relevant[dc->host_id / 8] |= 1 << (dc->host_id % 8);
+
+		for (j = 0; j < cs->host_groups_used; j++) {
+			if (cs->host_groups[j] == dc->host_index) break;
+		}
+		if (j == cs->host_groups_used) cs->host_groups[cs->host_groups_used++] = dc->host_index;
+	}
+
+	cs->key_words = cs->used / CONFIG_SNAPSHOT_KEY_BITS + 1 + 2 * cs->host_groups_used;
+	cs->conf_size = conf_size;
+
+	cs->key = calloc(cs->key_words, sizeof(*cs->key));
+	force_assert(cs->key);
+
+	return cs;
+}
+
+void config_snapshots_free(config_snapshots *cs) {
+	size_t i;
+
+	if (NULL == cs) return;
+
+	for (i = 0; i < CONFIG_SNAPSHOT_BUCKETS; i++) {
+		config_snapshot *e, *next;
+
+		for (e = cs->buckets[i]; e; e = next) {
+			next = e->next;
+			free(e);
+		}
+	}
+
+	free(cs->key);
+	free(cs->contexts);
+	free(cs->host_groups);
+	free(cs->host_relevant);
+	free(cs);
+}
+
+/* which host of the group (if any) matched, for the slots without and with port */
+static void config_snapshot_host_key(server *srv, connection *con, config_snapshots *cs, int group, size_t *key) {
+	int *match = con->cond_host_match + 2 * group;
+	int with_port;
+
+	key[0] = key[1] = 0;
+
+	if (0 == match[0]) {
+		/* asking any of them looks the host up, unless the parent didn't
+		 * match (or the host isn't known yet): then none of them does */
+		data_integer *di = (data_integer *)srv->config_host_index[group]->data[0];
+
+		config_check_cond(srv, con, (data_config *)srv->config_context->data[di->value]);
+		if (0 == match[0]) return;
+	}
+
+	for (with_port = 0; with_port < 2; with_port++) {
+		int id = match[with_port];
+		data_config *dc;
+
+		if (id <= 0 || !(cs->host_relevant[id / 8] & (1 << (id % 8)))) continue;
+
+		/* the host id is the index of the first conditional with that host */
+		dc = (data_config *)srv->config_context->data[id];
+		if ((NULL != strchr(dc->string->ptr, ':')) != with_port) continue;
+
+		if (config_check_cond(srv, con, dc)) key[with_port] = id;
+	}
+}
+
+/**
+ * copy the merged config for the current set of matching conditionals
+ * into conf
+ *
+ * returns 1 on a hit; on 0 the caller has to merge the config itself and
+ * should hand the result to config_snapshot_put()
+ */
+int config_snapshot_get(server *srv, connection *con, config_snapshots *cs, void *conf) {
+	config_snapshot *e;
+	size_t i, h = 0;
+
+	if (NULL == cs) return 0;
+
+	memset(cs->key, 0, cs->key_words * sizeof(*cs->key));
+
+	for (i = 0; i < cs->used; i++) {
+		data_config *dc = (data_config *)srv->config_context->data[cs->contexts[i]];
+
+		if (config_check_cond(srv, con, dc)) {
+			cs->key[i / CONFIG_SNAPSHOT_KEY_BITS] |= (size_t)1 << (i % CONFIG_SNAPSHOT_KEY_BITS);
+		}
+	}
+
+	for (i = 0; i < cs->host_groups_used; i++) {
+		config_snapshot_host_key(srv, con, cs, cs->host_groups[i],
+			cs->key + cs->used / CONFIG_SNAPSHOT_KEY_BITS + 1 + 2 * i);
+	}
+
+	for (i = 0; i < cs->key_words; i++) {
+		h = (h * 33) ^ cs->key[i];
+	}
+	h ^= h >> 16;
+
+	for (e = cs->buckets[h % CONFIG_SNAPSHOT_BUCKETS]; e; e = e->next) {
+		const size_t *key = (const size_t *)(e + 1);
+
+		if (e->hash != h) continue;
+		if (0 != memcmp(key, cs->key, cs->key_words * sizeof(*cs->key))) continue;
+
+		memcpy(conf, key + cs->key_words, cs->conf_size);
+		cs->key_valid = 0;
+		return 1;
+	}
+
+	cs->key_hash = h;
+	cs->key_valid = 1;
+
+	return 0;
+}
+
+/**
+ * remember conf as the merged config for the key of the last missed lookup
+ *
+ * once full, the oldest entry of the same bucket makes room
+ */
+void config_snapshot_put(config_snapshots *cs, const void *conf) {
+	config_snapshot *e, **pe;
+	size_t *key;
+	size_t ndx;
+
+	if (NULL == cs || !cs->key_valid) return;
+	cs->key_valid = 0;
+
+	ndx = cs->key_hash % CONFIG_SNAPSHOT_BUCKETS;
+
+	if (cs->count < CONFIG_SNAPSHOTS_MAX) {
+		e = malloc(sizeof(*e) + cs->key_words * sizeof(*cs->key) + cs->conf_size);
+		force_assert(e);
+		cs->count++;
+	} else {
+		if (NULL == cs->buckets[ndx]) return;
+
+		for (pe = &cs->buckets[ndx]; (*pe)->next; pe = &(*pe)->next) ;
+		e = *pe;
+		*pe = NULL;
+	}
+
+	key = (size_t *)(e + 1);
+	memcpy(key, cs->key, cs->key_words * sizeof(*cs->key));
+	memcpy(key + cs->key_words, conf, cs->conf_size);
+
+	e->hash = cs->key_hash;
+	e->next = cs->buckets[ndx];
+	cs->buckets[ndx] = e;
+}
@@ -6,6 +6,7 @@
 #include "configparser.h"
 #include "configfile.h"
 #include "proc_open.h"
+#include "version.h"
 
 #include <sys/stat.h>
 
@@ -108,6 +109,14 @@ static int config_insert(server *srv) {
 		{ "ssl.honor-cipher-order",            NULL, T_CONFIG_BOOLEAN, T_CONFIG_SCOPE_CONNECTION }, /* 66 */
 		{ "ssl.empty-fragments",               NULL, T_CONFIG_BOOLEAN, T_CONFIG_SCOPE_CONNECTION }, /* 67 */
 		{ "server.upload-temp-file-size",      NULL, T_CONFIG_INT,     T_CONFIG_SCOPE_SERVER     }, /* 68 */
+		{ "server.stream-request-body",        NULL, T_CONFIG_BOOLEAN, T_CONFIG_SCOPE_SERVER     }, /* 69 */
+		{ "server.max-response-buffer",        NULL, T_CONFIG_INT,     T_CONFIG_SCOPE_SERVER     }, /* 70 */
+		{ "server.response-buffer-spill",      NULL, T_CONFIG_BOOLEAN, T_CONFIG_SCOPE_SERVER     }, /* 71 */
+		{ "server.max-buffered-memory",        NULL, T_CONFIG_INT,     T_CONFIG_SCOPE_SERVER     }, /* 72 */
+		{ "server.stat-cache-max-entries",     NULL, T_CONFIG_INT,     T_CONFIG_SCOPE_SERVER     }, /* 73 */
+		{ "server.stat-cache-max-fds",         NULL, T_CONFIG_INT,     T_CONFIG_SCOPE_SERVER     }, /* 74 */
+		{ "server.small-file-cache-memory",    NULL, T_CONFIG_INT,     T_CONFIG_SCOPE_SERVER     }, /* 75 */
+		{ "server.small-file-cache-max-size",  NULL, T_CONFIG_INT,     T_CONFIG_SCOPE_SERVER     }, /* 76 */
 
 		{ "server.host",
 			"use server.bind instead",
@@ -171,6 +180,14 @@ static int config_insert(server *srv) {
 	cv[55].destination = srv->srvconf.breakagelog_file;
 
 	cv[68].destination = &(srv->srvconf.upload_temp_file_size);
+	cv[69].destination = &(srv->srvconf.stream_request_body);
+	cv[70].destination = &(srv->srvconf.max_response_buffer);
+	cv[71].destination = &(srv->srvconf.response_buffer_spill);
+	cv[72].destination = &(srv->srvconf.max_buffered_memory);
+	cv[73].destination = &(srv->srvconf.stat_cache_max_entries);
+	cv[74].destination = &(srv->srvconf.stat_cache_max_fds);
+	cv[75].destination = &(srv->srvconf.small_file_cache_memory);
+	cv[76].destination = &(srv->srvconf.small_file_cache_max_size);
 
 	srv->config_storage = calloc(1, srv->config_context->used * sizeof(specific_config *));
 
@@ -189,6 +206,7 @@ static int config_insert(server *srv) {
 		s->ssl_ca_file   = buffer_init();
 		s->error_handler = buffer_init();
 		s->server_tag    = buffer_init();
+		s->server_tag_header = buffer_init();
 		s->ssl_cipher_list = buffer_init();
 		s->ssl_dh_file   = buffer_init();
 		s->ssl_ec_curve  = buffer_init();
@@ -289,6 +307,20 @@ static int config_insert(server *srv) {
 		}
 	}
 
+	/* the Server: header only depends on server.tag, build it once per context */
+	for (i = 0; i < srv->config_context->used; i++) {
+		specific_config *s = srv->config_storage[i];
+
+		if (NULL == s) continue;
+
+		if (buffer_is_empty(s->server_tag)) {
+			buffer_copy_string_len(s->server_tag_header, CONST_STR_LEN("\r\nServer: " PACKAGE_DESC));
+		} else if (!buffer_string_is_empty(s->server_tag)) {
+			buffer_copy_string_len(s->server_tag_header, CONST_STR_LEN("\r\nServer: "));
+			buffer_append_string_encoded(s->server_tag_header, CONST_BUF_LEN(s->server_tag), ENCODING_HTTP_HEADER);
+		}
+	}
+
 	if (buffer_string_is_empty(stat_cache_string)) {
 		srv->srvconf.stat_cache_engine = STAT_CACHE_ENGINE_SIMPLE;
 	} else if (buffer_is_equal_string(stat_cache_string, CONST_STR_LEN("simple"))) {
@@ -296,6 +328,10 @@ static int config_insert(server *srv) {
 #ifdef HAVE_FAM_H
 	} else if (buffer_is_equal_string(stat_cache_string, CONST_STR_LEN("fam"))) {
 		srv->srvconf.stat_cache_engine = STAT_CACHE_ENGINE_FAM;
+#endif
+#ifdef HAVE_SYS_INOTIFY_H
+	} else if (buffer_is_equal_string(stat_cache_string, CONST_STR_LEN("inotify"))) {
+		srv->srvconf.stat_cache_engine = STAT_CACHE_ENGINE_INOTIFY;
 #endif
 	} else if (buffer_is_equal_string(stat_cache_string, CONST_STR_LEN("disable"))) {
 		srv->srvconf.stat_cache_engine = STAT_CACHE_ENGINE_NONE;
@@ -304,6 +340,9 @@ static int config_insert(server *srv) {
 				"server.stat-cache-engine can be one of \"disable\", \"simple\","
 #ifdef HAVE_FAM_H
 				" \"fam\","
+#endif
+#ifdef HAVE_SYS_INOTIFY_H
+				" \"inotify\","
 #endif
 				" but not:", stat_cache_string);
 		ret = HANDLER_ERROR;
@@ -311,6 +350,8 @@ static int config_insert(server *srv) {
 
 	buffer_free(stat_cache_string);
 
+	srv->config_snapshots = config_snapshots_init(srv, cv, sizeof(specific_config));
+
 	return ret;
 
 }
@@ -334,11 +375,13 @@ int config_setup_connection(server *srv, connection *con) {
 	PATCH(follow_symlink);
 #endif
 	PATCH(server_tag);
+	PATCH(server_tag_header);
 	PATCH(kbytes_per_second);
 	PATCH(global_kbytes_per_second);
 	PATCH(global_bytes_per_second_cnt);
 
 	con->conf.global_bytes_per_second_cnt_ptr = &s->global_bytes_per_second_cnt;
+	PATCH(server_name);
 	buffer_copy_buffer(con->server_name, s->server_name);
 
 	PATCH(log_request_header);
@@ -388,6 +431,12 @@ int config_patch_connection(server *srv, connection *con, comp_key_t comp) {
 
 	con->conditional_is_valid[comp] = 1;
 
+	if (config_snapshot_get(srv, con, srv->config_snapshots, &con->conf)) goto merged;
+
+	/* merge from the global config again, so the result only depends on
+	 * the conditionals matching now and can be cached */
+	config_setup_connection(srv, con);
+
 	/* skip the first, the global context */
 	for (i = 1; i < srv->config_context->used; i++) {
 		data_config *dc = (data_config *)srv->config_context->data[i];
@@ -458,9 +507,10 @@ int config_patch_connection(server *srv, connection *con, comp_key_t comp) {
 				PATCH(follow_symlink);
 #endif
 			} else if (buffer_is_equal_string(du->key, CONST_STR_LEN("server.name"))) {
-				buffer_copy_buffer(con->server_name, s->server_name);
+				PATCH(server_name);
 			} else if (buffer_is_equal_string(du->key, CONST_STR_LEN("server.tag"))) {
 				PATCH(server_tag);
+				PATCH(server_tag_header);
 			} else if (buffer_is_equal_string(du->key, CONST_STR_LEN("connection.kbytes-per-second"))) {
 				PATCH(kbytes_per_second);
 			} else if (buffer_is_equal_string(du->key, CONST_STR_LEN("debug.log-request-handling"))) {
@@ -501,9 +551,14 @@ int config_patch_connection(server *srv, connection *con, comp_key_t comp) {
 		}
 	}
 
-		con->etag_flags = (con->conf.etag_use_mtime ? ETAG_USE_MTIME : 0) |
-				  (con->conf.etag_use_inode ? ETAG_USE_INODE : 0) |
-				  (con->conf.etag_use_size  ? ETAG_USE_SIZE  : 0);
+	config_snapshot_put(srv->config_snapshots, &con->conf);
+
+merged:
+	buffer_copy_buffer(con->server_name, con->conf.server_name);
+
+	con->etag_flags = (con->conf.etag_use_mtime ? ETAG_USE_MTIME : 0) |
+			  (con->conf.etag_use_inode ? ETAG_USE_INODE : 0) |
+			  (con->conf.etag_use_size  ? ETAG_USE_SIZE  : 0);
 
 	return 0;
 }
@@ -1112,6 +1167,82 @@ static void context_free(config_t *context) {
 	buffer_free(context->basedir);
 }
 
+/* sibling $HTTP["host"] == "..." conditionals below the same parent
+ * are put into one hash, so configs with many vhosts only need a
+ * single lookup per request to decide all of them (see
+ * config_check_cond_host_index) */
+#define CONFIG_HOST_INDEX_MIN 8
+
+static int config_host_cond_indexable(data_config *dc) {
+	size_t i;
+
+	if (dc->comp != COMP_HTTP_HOST || dc->cond != CONFIG_COND_EQ) return 0;
+	/* else-chains decide their results among each other */
+	if (dc->prev || dc->next) return 0;
+	if (buffer_string_is_empty(dc->string)) return 0;
+
+	/* the index is caseless, the comparison is not */
+	for (i = 0; i < buffer_string_length(dc->string); i++) {
+		if (isupper((unsigned char)dc->string->ptr[i])) return 0;
+	}
+
+	return 1;
+}
+
+static void config_index_host_conds(server *srv) {
+	array *contexts = srv->config_context;
+	size_t *count;
+	int *group;
+	size_t i;
+
+	count = calloc(contexts->used, sizeof(*count));
+	group = malloc(contexts->used * sizeof(*group));
+	force_assert(count && group);
+
+	for (i = 0; i < contexts->used; i++) {
+		data_config *dc = (data_config *)contexts->data[i];
+
+		group[i] = -1;
+		if (0 == i || !config_host_cond_indexable(dc)) continue;
+		count[dc->parent->context_ndx]++;
+	}
+
+	for (i = 1; i < contexts->used; i++) {
+		data_config *dc = (data_config *)contexts->data[i];
+		int parent_ndx;
+		data_integer *di;
+		array *a;
+
+		if (!config_host_cond_indexable(dc)) continue;
+
+		parent_ndx = dc->parent->context_ndx;
+		if (count[parent_ndx] < CONFIG_HOST_INDEX_MIN) continue;
+
+		if (-1 == group[parent_ndx]) {
+			srv->config_host_index = realloc(srv->config_host_index, (srv->config_host_index_used + 1) * sizeof(*srv->config_host_index));
+			force_assert(srv->config_host_index);
+			srv->config_host_index[srv->config_host_index_used] = array_init();
+			group[parent_ndx] = srv->config_host_index_used++;
+		}
+
+		a = srv->config_host_index[group[parent_ndx]];
+
+		if (NULL == (di = (data_integer *)array_get_element(a, dc->string->ptr))) {
+			di = data_integer_init();
+			buffer_copy_buffer(di->key, dc->string);
+			/* the first conditional with the host, see config_snapshot_host_key() */
+			di->value = dc->context_ndx;
+			array_insert_unique(a, (data_unset *)di);
+		}
+
+		dc->host_index = group[parent_ndx];
+		dc->host_id = di->value;
+	}
+
+	free(group);
+	free(count);
+}
+
 int config_read(server *srv, const char *fn) {
 	config_t context;
 	data_config *dc;
@@ -1133,6 +1264,7 @@ int config_read(server *srv, const char *fn) {
 		buffer_copy_string_len(context.basedir, fn, pos - fn + 1);
 		fn = pos + 1;
 	}
+	buffer_copy_buffer(srv->srvconf.config_basedir, context.basedir);
 
 	dc = data_config_init();
 	buffer_copy_string_len(dc->key, CONST_STR_LEN("global"));
@@ -1234,6 +1366,7 @@ int config_read(server *srv, const char *fn) {
 		array_insert_unique(srv->config, (data_unset *)modules);
 	}
 
+	config_index_host_conds(srv);
 
 	if (0 != config_insert(srv)) {
 		return -1;
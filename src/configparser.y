@@ -6,8 +6,10 @@
 #include "configfile.h"
 #include "buffer.h"
 #include "array.h"
+#include "cidr.h"
 
 #include <assert.h>
+#include <errno.h>
 #include <stdio.h>
 #include <string.h>
 
@@ -33,6 +35,47 @@ static data_config *configparser_pop(config_t *ctx) {
   return old;
 }
 
+/* $HTTP["remoteip"] ==/!= "network" or "file:<list of networks>" is
+ * matched against a tree built here, instead of parsing it per request */
+static void configparser_remoteip(config_t *ctx, data_config *dc) {
+  const char *s = dc->string->ptr;
+
+  dc->remote_ip = cidr_tree_init();
+
+  if (0 == strncmp(s, "file:", sizeof("file:") - 1)) {
+    buffer *fn;
+    size_t line;
+
+    s += sizeof("file:") - 1;
+    if (buffer_string_is_empty(ctx->basedir) || s[0] == '/' || s[0] == '\\') {
+      fn = buffer_init_string(s);
+    } else {
+      fn = buffer_init_buffer(ctx->basedir);
+      buffer_append_string(fn, s);
+    }
+
+    if (0 != cidr_tree_insert_file(dc->remote_ip, fn->ptr, &line)) {
+      if (line) {
+        fprintf(stderr, "invalid network in %s line %lu\n", fn->ptr, (unsigned long)line);
+      } else {
+        fprintf(stderr, "reading %s failed: %s\n", fn->ptr, strerror(errno));
+      }
+      ctx->ok = 0;
+    }
+
+    buffer_free(fn);
+  } else if (0 != cidr_tree_insert(dc->remote_ip, CONST_BUF_LEN(dc->string))) {
+    if (NULL != strchr(s, '/')) {
+      fprintf(stderr, "invalid network in $%s: %s\n", dc->comp_key->ptr, s);
+      ctx->ok = 0;
+    }
+
+    /* not an address: compare the string as before */
+    cidr_tree_free(dc->remote_ip);
+    dc->remote_ip = NULL;
+  }
+}
+
 /* return a copied variable */
 static data_unset *configparser_get_variable(config_t *ctx, const buffer *key) {
   data_unset *du;
@@ -465,6 +508,9 @@ context ::= DOLLAR SRVVARNAME(B) LBRACKET stringop(C) RBRACKET cond(E) expressio
     case CONFIG_COND_NE:
     case CONFIG_COND_EQ:
       dc->string = buffer_init_buffer(rvalue);
+      if (COMP_HTTP_REMOTE_IP == dc->comp) {
+        configparser_remoteip(ctx, dc);
+      }
       break;
     case CONFIG_COND_NOMATCH:
     case CONFIG_COND_MATCH: {
@@ -482,7 +528,7 @@ context ::= DOLLAR SRVVARNAME(B) LBRACKET stringop(C) RBRACKET cond(E) expressio
 
         ctx->ok = 0;
       } else if (NULL == (dc->regex_study =
-          pcre_study(dc->regex, 0, &errptr)) &&
+          pcre_keyvalue_study(dc->regex, &errptr)) &&
                  errptr != NULL) {
         fprintf(stderr, "studying regex failed: %s -> %s\n",
             rvalue->ptr, errptr);
@@ -492,7 +492,7 @@ static int connection_handle_write_prepare(server *srv, connection *con) {
 			buffer_reset(con->physical.path);
 
 			con->file_finished = 1;
-			b = buffer_init();
+			b = buffer_pool_get(con->request_buffers);
 
 			/* build default error-page */
 			buffer_copy_string_len(b, CONST_STR_LEN(
@@ -521,7 +521,6 @@ static int connection_handle_write_prepare(server *srv, connection *con) {
 					     ));
 
 			http_chunk_append_buffer(srv, con, b);
-			buffer_free(b);
 			http_chunk_close(srv, con);
 
 			response_header_overwrite(srv, con, CONST_STR_LEN("Content-Type"), CONST_STR_LEN("text/html"));
@@ -693,16 +692,25 @@ connection *connection_init(server *srv) {
 		con->request_content_queue,
 		srv->srvconf.upload_tempdirs,
 		srv->srvconf.upload_temp_file_size);
+	chunkqueue_set_tempdirs(
+		con->write_queue,
+		srv->srvconf.upload_tempdirs,
+		srv->srvconf.upload_temp_file_size);
+	chunkqueue_set_mem_accounting(con->write_queue);
+	chunkqueue_set_mem_accounting(con->request_content_queue);
 
 	con->request.headers      = array_init();
 	con->response.headers     = array_init();
 	con->environment     = array_init();
+	con->request_buffers = buffer_pool_init();
 
 	/* init plugin specific connection structures */
 
 	con->plugin_ctx = calloc(1, (srv->plugins.used + 1) * sizeof(void *));
 
 	con->cond_cache = calloc(srv->config_context->used, sizeof(cond_cache_t));
+	con->cond_cache_set = calloc(srv->config_context->used, sizeof(int));
+	con->cond_host_match = calloc(2 * srv->config_host_index_used, sizeof(int));
 	config_setup_connection(srv, con);
 
 	return con;
@@ -723,6 +731,7 @@ void connections_free(server *srv) {
 		array_free(con->request.headers);
 		array_free(con->response.headers);
 		array_free(con->environment);
+		buffer_pool_free(con->request_buffers);
 
 #define CLEAN(x) \
 	buffer_free(con->x);
@@ -756,6 +765,8 @@ void connections_free(server *srv) {
 #undef CLEAN
 		free(con->plugin_ctx);
 		free(con->cond_cache);
+		free(con->cond_cache_set);
+		free(con->cond_host_match);
 
 		free(con);
 	}
@@ -775,6 +786,8 @@ int connection_reset(server *srv, connection *con) {
 	con->file_finished = 0;
 	con->file_started = 0;
 	con->got_response = 0;
+	con->backend_paused = 0;
+	con->request_body_streaming = 0;
 
 	con->parsed_response = 0;
 
@@ -840,6 +853,8 @@ int connection_reset(server *srv, connection *con) {
 	CLEAN(http_content_type);
 #undef CLEAN
 	con->request.content_length = 0;
+	con->request.te_chunked = TE_CHUNKED_UNSET;
+	con->request.te_chunked_len = 0;
 
 	array_reset(con->request.headers);
 	array_reset(con->response.headers);
@@ -848,6 +863,8 @@ int connection_reset(server *srv, connection *con) {
 	chunkqueue_reset(con->write_queue);
 	chunkqueue_reset(con->request_content_queue);
 
+	buffer_pool_reset(con->request_buffers);
+
 	/* the plugins should cleanup themself */
 	for (i = 0; i < srv->plugins.used; i++) {
 		plugin *p = ((plugin **)(srv->plugins.ptr))[i];
@@ -873,6 +890,164 @@ int connection_reset(server *srv, connection *con) {
 	return 0;
 }
 
+/* longest chunk-size or trailer line we accept in a chunked request body */
+#define MAX_CHUNKED_LINE_LENGTH 8192
+
+/**
+ * move one line (including the \n) of the read-queue into "line"
+ *
+ * returns 1 if a complete line was found, 0 if we need more data
+ * and -1 if the line gets too long
+ */
+static int connection_chunked_getline(chunkqueue *cq, buffer *line) {
+	chunk *c;
+
+	buffer_reset(line);
+
+	for (c = cq->first; c; c = c->next) {
+		const char *s = c->mem->ptr + c->offset;
+		size_t len = buffer_string_length(c->mem) - c->offset;
+		const char *nl = memchr(s, '\n', len);
+
+		if (nl) len = nl - s + 1;
+
+		if (buffer_string_length(line) + len > MAX_CHUNKED_LINE_LENGTH) return -1;
+
+		buffer_append_string_len(line, s, len);
+
+		if (nl) {
+			chunkqueue_mark_written(cq, buffer_string_length(line));
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/**
+ * decode a Transfer-Encoding: chunked request body into the request_content_queue
+ *
+ * returns 1 if the body is complete, 0 if we need more data and
+ * -1 on error (con->http_status is set)
+ */
+static int connection_handle_read_post_chunked(server *srv, connection *con) {
+	chunkqueue *cq = con->read_queue;
+	chunkqueue *dst_cq = con->request_content_queue;
+	buffer *line = srv->tmp_buf;
+
+	for (;;) {
+		off_t len;
+		size_t i;
+
+		switch (con->request.te_chunked) {
+		case TE_CHUNKED_DATA:
+			if (0 == (len = chunkqueue_length(cq))) return 0;
+			if (len > con->request.te_chunked_len) len = con->request.te_chunked_len;
+
+			if (dst_cq->bytes_in + len <= 64*1024 && !chunk_mem_over_limit()) {
+				/* don't buffer request bodies <= 64k on disk */
+				chunkqueue_steal(dst_cq, cq, len);
+			} else if (0 != chunkqueue_steal_with_tempfiles(srv, dst_cq, cq, len)) {
+				con->http_status = 413; /* Request-Entity too large */
+				return -1;
+			}
+
+			if (0 == (con->request.te_chunked_len -= len)) {
+				con->request.te_chunked = TE_CHUNKED_DATA_END;
+			}
+			break;
+		case TE_CHUNKED_SIZE:
+		case TE_CHUNKED_DATA_END:
+		case TE_CHUNKED_TRAILER:
+			switch (connection_chunked_getline(cq, line)) {
+			case 0:
+				return 0;
+			case -1:
+				log_error_write(srv, __FILE__, __LINE__, "s",
+						"chunked request body: line too long -> 400");
+				con->http_status = 400;
+				return -1;
+			default:
+				break;
+			}
+
+			if (con->request.te_chunked == TE_CHUNKED_SIZE) {
+				/* chunk-size [ chunk-ext ] CRLF */
+				for (i = 0, len = 0; light_isxdigit(line->ptr[i]); ++i) {
+					if (i == 15) break; /* don't overflow off_t */
+					len = (len << 4) + hex2int(line->ptr[i]);
+				}
+
+				if (0 == i || light_isxdigit(line->ptr[i]) ||
+				    NULL == strchr(" \t;\r\n", line->ptr[i])) {
+					log_error_write(srv, __FILE__, __LINE__, "sb",
+							"chunked request body: invalid chunk-size:", line);
+					con->http_status = 400;
+					return -1;
+				}
+
+				/* divide by 1024 as srvconf.max_request_size is in kBytes */
+				if (srv->srvconf.max_request_size != 0 &&
+				    ((dst_cq->bytes_in + len) >> 10) > srv->srvconf.max_request_size) {
+					log_error_write(srv, __FILE__, __LINE__, "sos",
+							"request-size too long:", dst_cq->bytes_in + len, "-> 413");
+					con->http_status = 413;
+					return -1;
+				}
+
+				if (0 == len) {
+					con->request.te_chunked = TE_CHUNKED_TRAILER;
+				} else {
+					con->request.te_chunked = TE_CHUNKED_DATA;
+					con->request.te_chunked_len = len;
+				}
+			} else if (buffer_is_equal_string(line, CONST_STR_LEN("\r\n")) ||
+				   buffer_is_equal_string(line, CONST_STR_LEN("\n"))) {
+				if (con->request.te_chunked == TE_CHUNKED_TRAILER) return 1;
+
+				con->request.te_chunked = TE_CHUNKED_SIZE;
+			} else if (con->request.te_chunked == TE_CHUNKED_DATA_END) {
+				log_error_write(srv, __FILE__, __LINE__, "s",
+						"chunked request body: missing CRLF after chunk-data -> 400");
+				con->http_status = 400;
+				return -1;
+			}
+			/* trailer fields are ignored */
+			break;
+		default:
+			return -1;
+		}
+	}
+}
+
+/**
+ * the chunked request body is complete: from now on it looks
+ * like a request with Content-Length to the rest of the server
+ */
+static void connection_chunked_body_done(server *srv, connection *con) {
+	data_string *ds;
+
+	con->request.content_length = con->request_content_queue->bytes_in;
+
+	if (NULL != (ds = (data_string *)array_get_element(con->request.headers, "Transfer-Encoding"))) {
+		/* headers with empty values are not passed on to backends */
+		buffer_reset(ds->value);
+	}
+
+	buffer_copy_int(srv->tmp_buf, con->request_content_queue->bytes_in);
+	array_set_key_value(con->request.headers, CONST_STR_LEN("Content-Length"), CONST_BUF_LEN(srv->tmp_buf));
+}
+
+/**
+ * a backend which takes the request body while it arrives didn't
+ * keep up with the client: stop reading until it catches up
+ */
+static int connection_request_body_throttled(connection *con) {
+	return con->state == CON_STATE_READ_POST &&
+	       1 == con->request_body_streaming &&
+	       chunkqueue_length(con->request_content_queue) > MAX_REQUEST_BODY_STREAM_BUFFER;
+}
+
 /**
  * handle all header and content read
  *
@@ -886,7 +1061,10 @@ static int connection_handle_read_state(server *srv, connection *con)  {
 	chunkqueue *dst_cq = con->request_content_queue;
 	int is_closed = 0; /* the connection got closed, if we don't have a complete header, -> error */
 
-	if (con->is_readable) {
+	if (connection_request_body_throttled(con)) {
+		/* the client isn't idle, we don't read */
+		con->read_idle_ts = srv->cur_ts;
+	} else if (con->is_readable) {
 		con->read_idle_ts = srv->cur_ts;
 
 		switch(connection_handle_read(srv, con)) {
@@ -986,14 +1164,38 @@ found_header_end:
 		}
 		break;
 	case CON_STATE_READ_POST:
-		if (con->request.content_length <= 64*1024) {
-			/* don't buffer request bodies <= 64k on disk */
+		if (con->request.te_chunked) {
+			switch (connection_handle_read_post_chunked(srv, con)) {
+			case 1:
+				connection_chunked_body_done(srv, con);
+				connection_set_state(srv, con, CON_STATE_HANDLE_REQUEST);
+				break;
+			case -1:
+				con->keep_alive = 0;
+				connection_set_state(srv, con, CON_STATE_HANDLE_REQUEST);
+				break;
+			default:
+				break;
+			}
+			break;
+		}
+
+		if (1 == con->request_body_streaming ||
+		    (0 == con->request_body_streaming && srv->srvconf.stream_request_body)) {
+			/* the backend takes the body as it arrives, we stop reading
+			 * while it is behind: see connection_request_body_throttled() */
+			chunkqueue_steal(dst_cq, cq, con->request.content_length - dst_cq->bytes_in);
+		}
+		else if (con->request.content_length <= 64*1024 && !chunk_mem_over_limit()) {
+			/* don't buffer request bodies <= 64k on disk, unless we are short on memory */
 			chunkqueue_steal(dst_cq, cq, con->request.content_length - dst_cq->bytes_in);
 		}
 		else if (0 != chunkqueue_steal_with_tempfiles(srv, dst_cq, cq, con->request.content_length - dst_cq->bytes_in )) {
 			con->http_status = 413; /* Request-Entity too large */
 			con->keep_alive = 0;
-			connection_set_state(srv, con, CON_STATE_HANDLE_REQUEST);
+			/* a streaming backend might already have got a part of the body */
+			connection_set_state(srv, con, con->mode == DIRECT ? CON_STATE_HANDLE_REQUEST : CON_STATE_ERROR);
+			break;
 		}
 
 		/* Content is ready */
@@ -1205,6 +1407,96 @@ connection *connection_accept(server *srv, server_socket *srv_socket) {
 }
 
 
+/**
+ * run the request handlers
+ *
+ * called in CON_STATE_HANDLE_REQUEST and, with server.stream-request-body,
+ * in CON_STATE_READ_POST to let a backend start on the partial request body;
+ * "come back" keeps the connection in the state we were called in
+ *
+ * returns -1 if the state-engine should run another round
+ */
+static int connection_handle_request(server *srv, connection *con) {
+	connection_state_t ostate = con->state;
+	int done = 0;
+	handler_t r;
+
+	switch (r = http_response_prepare(srv, con)) {
+	case HANDLER_FINISHED:
+		if (con->mode == DIRECT) {
+			if (con->http_status == 404 ||
+			    con->http_status == 403) {
+				/* 404 error-handler */
+
+				if (con->in_error_handler == 0 &&
+				    (!buffer_string_is_empty(con->conf.error_handler) ||
+				     !buffer_string_is_empty(con->error_handler))) {
+					/* call error-handler */
+
+					con->error_handler_saved_status = con->http_status;
+					con->http_status = 0;
+
+					if (buffer_string_is_empty(con->error_handler)) {
+						buffer_copy_buffer(con->request.uri, con->conf.error_handler);
+					} else {
+						buffer_copy_buffer(con->request.uri, con->error_handler);
+					}
+					buffer_reset(con->physical.path);
+
+					con->in_error_handler = 1;
+
+					connection_set_state(srv, con, ostate);
+
+					done = -1;
+					break;
+				} else if (con->in_error_handler) {
+					/* error-handler is a 404 */
+
+					con->http_status = con->error_handler_saved_status;
+				}
+			} else if (con->in_error_handler) {
+				/* error-handler is back and has generated content */
+				/* if Status: was set, take it otherwise use 200 */
+			}
+		}
+		if (con->http_status == 0) con->http_status = 200;
+
+		if (ostate == CON_STATE_READ_POST) {
+			/* the backend answered before we got the whole request body */
+			con->keep_alive = 0;
+		}
+
+		/* we have something to send, go on */
+		connection_set_state(srv, con, CON_STATE_RESPONSE_START);
+		break;
+	case HANDLER_WAIT_FOR_FD:
+		srv->want_fds++;
+
+		fdwaitqueue_append(srv, con);
+
+		connection_set_state(srv, con, ostate);
+
+		break;
+	case HANDLER_COMEBACK:
+		done = -1;
+		/* fallthrough */
+	case HANDLER_WAIT_FOR_EVENT:
+		/* come back here */
+		connection_set_state(srv, con, ostate);
+
+		break;
+	case HANDLER_ERROR:
+		/* something went wrong */
+		connection_set_state(srv, con, CON_STATE_ERROR);
+		break;
+	default:
+		log_error_write(srv, __FILE__, __LINE__, "sdd", "unknown ret-value: ", con->fd, r);
+		break;
+	}
+
+	return done;
+}
+
 int connection_state_machine(server *srv, connection *con) {
 	int done = 0, r;
 #ifdef USE_OPENSSL
@@ -1274,73 +1566,7 @@ int connection_state_machine(server *srv, connection *con) {
 						"state for fd", con->fd, connection_get_state(con->state));
 			}
 
-			switch (r = http_response_prepare(srv, con)) {
-			case HANDLER_FINISHED:
-				if (con->mode == DIRECT) {
-					if (con->http_status == 404 ||
-					    con->http_status == 403) {
-						/* 404 error-handler */
-
-						if (con->in_error_handler == 0 &&
-						    (!buffer_string_is_empty(con->conf.error_handler) ||
-						     !buffer_string_is_empty(con->error_handler))) {
-							/* call error-handler */
-
-							con->error_handler_saved_status = con->http_status;
-							con->http_status = 0;
-
-							if (buffer_string_is_empty(con->error_handler)) {
-								buffer_copy_buffer(con->request.uri, con->conf.error_handler);
-							} else {
-								buffer_copy_buffer(con->request.uri, con->error_handler);
-							}
-							buffer_reset(con->physical.path);
-
-							con->in_error_handler = 1;
-
-							connection_set_state(srv, con, CON_STATE_HANDLE_REQUEST);
-
-							done = -1;
-							break;
-						} else if (con->in_error_handler) {
-							/* error-handler is a 404 */
-
-							con->http_status = con->error_handler_saved_status;
-						}
-					} else if (con->in_error_handler) {
-						/* error-handler is back and has generated content */
-						/* if Status: was set, take it otherwise use 200 */
-					}
-				}
-				if (con->http_status == 0) con->http_status = 200;
-
-				/* we have something to send, go on */
-				connection_set_state(srv, con, CON_STATE_RESPONSE_START);
-				break;
-			case HANDLER_WAIT_FOR_FD:
-				srv->want_fds++;
-
-				fdwaitqueue_append(srv, con);
-
-				connection_set_state(srv, con, CON_STATE_HANDLE_REQUEST);
-
-				break;
-			case HANDLER_COMEBACK:
-				done = -1;
-				/* fallthrough */
-			case HANDLER_WAIT_FOR_EVENT:
-				/* come back here */
-				connection_set_state(srv, con, CON_STATE_HANDLE_REQUEST);
-
-				break;
-			case HANDLER_ERROR:
-				/* something went wrong */
-				connection_set_state(srv, con, CON_STATE_ERROR);
-				break;
-			default:
-				log_error_write(srv, __FILE__, __LINE__, "sdd", "unknown ret-value: ", con->fd, r);
-				break;
-			}
+			done = connection_handle_request(srv, con);
 
 			break;
 		case CON_STATE_RESPONSE_START:
@@ -1475,6 +1701,39 @@ int connection_state_machine(server *srv, connection *con) {
 			}
 
 			connection_handle_read_state(srv, con);
+
+			if (1 == con->request_body_streaming && con->mode == DIRECT) {
+				/* the backend went away */
+				if (0 == con->request_content_queue->bytes_out) {
+					/* ... before it took any of the body, pick a handler again */
+					con->request_body_streaming = 0;
+				} else if (con->state == CON_STATE_READ_POST ||
+					   con->state == CON_STATE_HANDLE_REQUEST) {
+					/* ... with a part of the body we can't send again */
+					con->http_status = 502;
+					con->keep_alive = 0;
+					con->request_body_streaming = -1;
+					connection_set_state(srv, con, CON_STATE_HANDLE_REQUEST);
+				}
+			}
+
+			if (con->state == CON_STATE_READ_POST &&
+			    srv->srvconf.stream_request_body &&
+			    !con->request.te_chunked) {
+				if (0 == con->request_body_streaming) {
+					/* pick the handler once; a backend which takes the
+					 * body while it arrives marks the connection */
+					done = connection_handle_request(srv, con);
+					if (con->state == CON_STATE_READ_POST &&
+					    1 != con->request_body_streaming) {
+						/* buffer the body, the handler runs again when it is complete */
+						con->request_body_streaming = -1;
+					}
+				} else if (1 == con->request_body_streaming) {
+					/* hand the backend what arrived so far */
+					done = connection_handle_request(srv, con);
+				}
+			}
 			break;
 		case CON_STATE_WRITE:
 			if (srv->srvconf.log_state_handling) {
@@ -1496,6 +1755,33 @@ int connection_state_machine(server *srv, connection *con) {
 				connection_set_state(srv, con, CON_STATE_RESPONSE_END);
 			}
 
+			if (con->backend_paused && con->state == CON_STATE_WRITE &&
+			    !http_chunk_backpressure_active(srv, con)) {
+				/* below the low watermark, let the backend continue;
+				 * it pauses again via http_chunk_backpressure() */
+				con->backend_paused = 0;
+
+				switch (r = plugins_call_handle_subrequest(srv, con)) {
+				case HANDLER_GO_ON:
+				case HANDLER_WAIT_FOR_EVENT:
+				case HANDLER_FINISHED: /* the response has started, file_finished marks its end */
+					break;
+				case HANDLER_WAIT_FOR_FD:
+				case HANDLER_COMEBACK:
+					/* the backend wants to restart the request, but the
+					 * response header is already out: all we can do is
+					 * to drop the connection */
+				case HANDLER_ERROR:
+					/* something went wrong */
+					connection_set_state(srv, con, CON_STATE_ERROR);
+					break;
+				default:
+					log_error_write(srv, __FILE__, __LINE__, "sdd", "unknown ret-value: ", con->fd, r);
+					connection_set_state(srv, con, CON_STATE_ERROR);
+					break;
+				}
+			}
+
 			break;
 		case CON_STATE_ERROR: /* transient */
 
@@ -1622,6 +1908,12 @@ int connection_state_machine(server *srv, connection *con) {
 
 	switch(con->state) {
 	case CON_STATE_READ_POST:
+		if (connection_request_body_throttled(con)) {
+			/* the backend wakes us up (joblist) when it took some of the body */
+			fdevent_event_del(srv->ev, &(con->fde_ndx), con->fd);
+			break;
+		}
+		/* fall through */
 	case CON_STATE_READ:
 	case CON_STATE_CLOSE:
 		fdevent_event_set(srv->ev, &(con->fde_ndx), con->fd, FDEVENT_IN);
@@ -1,4 +1,6 @@
 #include "array.h"
+#include "cidr.h"
+#include "keyvalue.h"
 
 #include <string.h>
 #include <stdio.h>
@@ -26,9 +28,10 @@ static void data_config_free(data_unset *d) {
 	array_free(ds->childs);
 
 	if (ds->string) buffer_free(ds->string);
+	cidr_tree_free(ds->remote_ip);
 #ifdef HAVE_PCRE_H
 	if (ds->regex) pcre_free(ds->regex);
-	if (ds->regex_study) pcre_free(ds->regex_study);
+	if (ds->regex_study) pcre_keyvalue_study_free(ds->regex_study);
 #endif
 
 	free(d);
@@ -126,6 +129,7 @@ data_config *data_config_init(void) {
 	ds->value = array_init();
 	ds->childs = array_init();
 	ds->childs->is_weakref = 1;
+	ds->host_index = -1;
 
 	ds->copy = data_config_copy;
 	ds->free = data_config_free;
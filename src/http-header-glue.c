@@ -121,7 +121,7 @@ int response_header_append(server *srv, connection *con, const char *key, size_t
 int http_response_redirect_to_directory(server *srv, connection *con) {
 	buffer *o;
 
-	o = buffer_init();
+	o = buffer_pool_get(con->request_buffers);
 
 	buffer_copy_buffer(o, con->uri.scheme);
 	buffer_append_string_len(o, CONST_STR_LEN("://"));
@@ -144,7 +144,6 @@ int http_response_redirect_to_directory(server *srv, connection *con) {
 			log_error_write(srv, __FILE__, __LINE__, "ss",
 					"can't get sockname", strerror(errno));
 
-			buffer_free(o);
 			return 0;
 		}
 
@@ -186,7 +185,6 @@ int http_response_redirect_to_directory(server *srv, connection *con) {
 			log_error_write(srv, __FILE__, __LINE__,
 					"S", "ERROR: unsupported address-type");
 
-			buffer_free(o);
 			return -1;
 		}
 
@@ -213,8 +211,6 @@ int http_response_redirect_to_directory(server *srv, connection *con) {
 	con->http_status = 301;
 	con->file_finished = 1;
 
-	buffer_free(o);
-
 	return 0;
 }
 
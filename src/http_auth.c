@@ -157,163 +157,276 @@ static unsigned char * base64_decode(buffer *out, const char *in) {
 	return result;
 }
 
-static int http_auth_get_password(server *srv, mod_auth_plugin_data *p, buffer *username, buffer *realm, buffer *password) {
-	int ret = -1;
-
-	if (buffer_is_empty(username) || buffer_is_empty(realm)) return -1;
+static size_t http_auth_user_hash(const char *s, size_t len) {
+	size_t i, h = 5381;
 
-	if (p->conf.auth_backend == AUTH_BACKEND_HTDIGEST) {
-		stream f;
-		char * f_line;
+	for (i = 0; i < len; i++) {
+		h = ((h << 5) + h) ^ (unsigned char)s[i];
+	}
 
-		if (buffer_string_is_empty(p->conf.auth_htdigest_userfile)) return -1;
+	return h;
+}
 
-		if (0 != stream_open(&f, p->conf.auth_htdigest_userfile)) {
-			log_error_write(srv, __FILE__, __LINE__, "sbss", "opening digest-userfile", p->conf.auth_htdigest_userfile, "failed:", strerror(errno));
+static void http_auth_userfile_reset(http_auth_userfile *uf) {
+	size_t i;
 
-			return -1;
+	for (i = 0; i < uf->ptr_size; i++) {
+		http_auth_user *u, *next;
+		for (u = uf->ptr[i]; u; u = next) {
+			next = u->next;
+			buffer_free(u->key);
+			buffer_free(u->password);
+			free(u);
 		}
+		uf->ptr[i] = NULL;
+	}
 
-		f_line = f.start;
+	uf->used = 0;
+	uf->loaded = 0;
+}
 
-		while (f_line - f.start != f.size) {
-			char *f_user, *f_pwd, *e, *f_realm;
-			size_t u_len, pwd_len, r_len;
+void http_auth_userfiles_free(mod_auth_plugin_data *p) {
+	size_t i;
 
-			f_user = f_line;
+	for (i = 0; i < p->userfiles_used; i++) {
+		http_auth_userfile *uf = p->userfiles[i];
 
-			/*
-			 * htdigest format
-			 *
-			 * user:realm:md5(user:realm:password)
-			 */
+		http_auth_userfile_reset(uf);
+		free(uf->ptr);
+		buffer_free(uf->fn);
+		free(uf);
+	}
 
-			if (NULL == (f_realm = memchr(f_user, ':', f.size - (f_user - f.start) ))) {
-				log_error_write(srv, __FILE__, __LINE__, "sbs",
-						"parsed error in", p->conf.auth_htdigest_userfile,
-						"expected 'username:realm:hashed password'");
+	free(p->userfiles);
+}
 
-				stream_close(&f);
+static http_auth_user *http_auth_userfile_find(http_auth_userfile *uf, const char *key, size_t len) {
+	size_t h = http_auth_user_hash(key, len);
+	http_auth_user *u;
 
-				return -1;
-			}
+	for (u = uf->ptr[h % uf->ptr_size]; u; u = u->next) {
+		if (u->hash == h && buffer_is_equal_string(u->key, key, len)) return u;
+	}
 
-			if (NULL == (f_pwd = memchr(f_realm + 1, ':', f.size - (f_realm + 1 - f.start)))) {
-				log_error_write(srv, __FILE__, __LINE__, "sbs",
-						"parsed error in", p->conf.auth_plain_userfile,
-						"expected 'username:realm:hashed password'");
+	return NULL;
+}
 
-				stream_close(&f);
+static void http_auth_userfile_insert(http_auth_userfile *uf, const char *key, size_t key_len, const char *pwd, size_t pwd_len) {
+	http_auth_user *u;
 
-				return -1;
-			}
+	/* the first line for a user wins, as with a linear search */
+	if (NULL != http_auth_userfile_find(uf, key, key_len)) return;
 
-			/* get pointers to the fields */
-			u_len = f_realm - f_user;
-			f_realm++;
-			r_len = f_pwd - f_realm;
-			f_pwd++;
+	if (uf->used >= uf->ptr_size) {
+		size_t i, size = uf->ptr_size * 2;
+		http_auth_user **ptr = calloc(size, sizeof(*ptr));
 
-			if (NULL != (e = memchr(f_pwd, '\n', f.size - (f_pwd - f.start)))) {
-				pwd_len = e - f_pwd;
-			} else {
-				pwd_len = f.size - (f_pwd - f.start);
+		force_assert(NULL != ptr);
+
+		for (i = 0; i < uf->ptr_size; i++) {
+			http_auth_user *next;
+			for (u = uf->ptr[i]; u; u = next) {
+				next = u->next;
+				u->next = ptr[u->hash % size];
+				ptr[u->hash % size] = u;
 			}
+		}
 
-			if (buffer_string_length(username) == u_len &&
-			    (buffer_string_length(realm) == r_len) &&
-			    (0 == strncmp(username->ptr, f_user, u_len)) &&
-			    (0 == strncmp(realm->ptr, f_realm, r_len))) {
-				/* found */
+		free(uf->ptr);
+		uf->ptr = ptr;
+		uf->ptr_size = size;
+	}
 
-				buffer_copy_string_len(password, f_pwd, pwd_len);
+	u = calloc(1, sizeof(*u));
+	force_assert(NULL != u);
+	u->key = buffer_init();
+	buffer_copy_string_len(u->key, key, key_len);
+	u->password = buffer_init();
+	buffer_copy_string_len(u->password, pwd, pwd_len);
+	u->hash = http_auth_user_hash(key, key_len);
+
+	u->next = uf->ptr[u->hash % uf->ptr_size];
+	uf->ptr[u->hash % uf->ptr_size] = u;
+	uf->used++;
+}
 
-				ret = 0;
-				break;
-			}
+/* parse the whole file; a broken line ends the file as it ended the search before */
+static int http_auth_userfile_load(server *srv, http_auth_userfile *uf) {
+	stream f;
+	char * f_line;
 
-			/* EOL */
-			if (!e) break;
+	http_auth_userfile_reset(uf);
 
-			f_line = e + 1;
+	if (0 != stream_open(&f, uf->fn)) {
+		if (uf->backend == AUTH_BACKEND_HTDIGEST) {
+			log_error_write(srv, __FILE__, __LINE__, "sbss", "opening digest-userfile", uf->fn, "failed:", strerror(errno));
+		} else {
+			log_error_write(srv, __FILE__, __LINE__, "sbss",
+					"opening plain-userfile", uf->fn, "failed:", strerror(errno));
 		}
 
-		stream_close(&f);
-	} else if (p->conf.auth_backend == AUTH_BACKEND_HTPASSWD ||
-		   p->conf.auth_backend == AUTH_BACKEND_PLAIN) {
-		stream f;
-		char * f_line;
-		buffer *auth_fn;
+		return -1;
+	}
 
-		auth_fn = (p->conf.auth_backend == AUTH_BACKEND_HTPASSWD) ? p->conf.auth_htpasswd_userfile : p->conf.auth_plain_userfile;
+	uf->loaded = 1;
 
-		if (buffer_string_is_empty(auth_fn)) return -1;
+	f_line = f.start;
 
-		if (0 != stream_open(&f, auth_fn)) {
-			log_error_write(srv, __FILE__, __LINE__, "sbss",
-					"opening plain-userfile", auth_fn, "failed:", strerror(errno));
+	while (f_line - f.start != f.size) {
+		char *f_user, *f_pwd, *e;
+		size_t u_len, pwd_len;
 
-			return -1;
-		}
-
-		f_line = f.start;
+		f_user = f_line;
 
-		while (f_line - f.start != f.size) {
-			char *f_user, *f_pwd, *e;
-			size_t u_len, pwd_len;
+		if (NULL == (f_pwd = memchr(f_user, ':', f.size - (f_user - f.start) ))) {
+			log_error_write(srv, __FILE__, __LINE__, "sbs",
+					"parsed error in", uf->fn,
+					uf->backend == AUTH_BACKEND_HTDIGEST
+					? "expected 'username:realm:hashed password'"
+					: "expected 'username:hashed password'");
 
-			f_user = f_line;
+			break;
+		}
 
+		if (uf->backend == AUTH_BACKEND_HTDIGEST) {
 			/*
-			 * htpasswd format
+			 * htdigest format
+			 *
+			 * user:realm:md5(user:realm:password)
 			 *
-			 * user:crypted passwd
+			 * the key is user:realm
 			 */
 
-			if (NULL == (f_pwd = memchr(f_user, ':', f.size - (f_user - f.start) ))) {
+			if (NULL == (f_pwd = memchr(f_pwd + 1, ':', f.size - (f_pwd + 1 - f.start)))) {
 				log_error_write(srv, __FILE__, __LINE__, "sbs",
-						"parsed error in", auth_fn,
-						"expected 'username:hashed password'");
-
-				stream_close(&f);
+						"parsed error in", uf->fn,
+						"expected 'username:realm:hashed password'");
 
-				return -1;
+				break;
 			}
+		}
 
-			/* get pointers to the fields */
-			u_len = f_pwd - f_user;
-			f_pwd++;
+		/*
+		 * htpasswd format
+		 *
+		 * user:crypted passwd
+		 */
 
-			if (NULL != (e = memchr(f_pwd, '\n', f.size - (f_pwd - f.start)))) {
-				pwd_len = e - f_pwd;
-			} else {
-				pwd_len = f.size - (f_pwd - f.start);
-			}
+		/* get pointers to the fields */
+		u_len = f_pwd - f_user;
+		f_pwd++;
 
-			if (buffer_string_length(username) == u_len &&
-			    (0 == strncmp(username->ptr, f_user, u_len))) {
-				/* found */
+		if (NULL != (e = memchr(f_pwd, '\n', f.size - (f_pwd - f.start)))) {
+			pwd_len = e - f_pwd;
+		} else {
+			pwd_len = f.size - (f_pwd - f.start);
+		}
 
-				buffer_copy_string_len(password, f_pwd, pwd_len);
+		http_auth_userfile_insert(uf, f_user, u_len, f_pwd, pwd_len);
 
-				ret = 0;
-				break;
-			}
+		/* EOL */
+		if (!e) break;
+
+		f_line = e + 1;
+	}
 
-			/* EOL */
-			if (!e) break;
+	stream_close(&f);
 
-			f_line = e + 1;
+	return 0;
+}
+
+/* the parsed user file, re-read when it changed on disk (checked once a second) */
+static http_auth_userfile *http_auth_userfile_get(server *srv, mod_auth_plugin_data *p, buffer *fn) {
+	http_auth_userfile *uf = NULL;
+	struct stat st;
+	size_t i;
+
+	for (i = 0; i < p->userfiles_used; i++) {
+		if (p->userfiles[i]->backend == p->conf.auth_backend &&
+		    buffer_is_equal(p->userfiles[i]->fn, fn)) {
+			uf = p->userfiles[i];
+			break;
 		}
+	}
 
-		stream_close(&f);
-	} else if (p->conf.auth_backend == AUTH_BACKEND_LDAP) {
-		ret = 0;
-	} else {
+	if (NULL == uf) {
+		uf = calloc(1, sizeof(*uf));
+		force_assert(NULL != uf);
+		uf->fn = buffer_init_buffer(fn);
+		uf->backend = p->conf.auth_backend;
+		uf->ptr_size = 64;
+		uf->ptr = calloc(uf->ptr_size, sizeof(*uf->ptr));
+		force_assert(NULL != uf->ptr);
+
+		p->userfiles = realloc(p->userfiles, (p->userfiles_used + 1) * sizeof(*p->userfiles));
+		force_assert(NULL != p->userfiles);
+		p->userfiles[p->userfiles_used++] = uf;
+	} else if (uf->loaded && uf->last_check == srv->cur_ts) {
+		return uf;
+	}
+
+	uf->last_check = srv->cur_ts;
+
+	if (-1 == stat(fn->ptr, &st)) {
+		log_error_write(srv, __FILE__, __LINE__, "sbss", "opening userfile", fn, "failed:", strerror(errno));
+		http_auth_userfile_reset(uf);
+		return NULL;
+	}
+
+	if (uf->loaded && uf->mtime == st.st_mtime && uf->size == st.st_size && uf->ino == st.st_ino) {
+		return uf;
+	}
+
+	if (0 != http_auth_userfile_load(srv, uf)) return NULL;
+
+	/* the mtime only has a resolution of one second: a file written in
+	 * this second might change again without changing mtime, size and
+	 * inode (htpasswd rewrites it in place), read it again next time */
+	uf->mtime = (st.st_mtime >= srv->cur_ts) ? (time_t)-1 : st.st_mtime;
+	uf->size = st.st_size;
+	uf->ino = st.st_ino;
+
+	return uf;
+}
+
+static int http_auth_get_password(server *srv, mod_auth_plugin_data *p, buffer *username, buffer *realm, buffer *password) {
+	http_auth_userfile *uf;
+	http_auth_user *u;
+	buffer *auth_fn;
+
+	if (buffer_is_empty(username) || buffer_is_empty(realm)) return -1;
+
+	switch (p->conf.auth_backend) {
+	case AUTH_BACKEND_HTDIGEST:
+		auth_fn = p->conf.auth_htdigest_userfile;
+		break;
+	case AUTH_BACKEND_HTPASSWD:
+		auth_fn = p->conf.auth_htpasswd_userfile;
+		break;
+	case AUTH_BACKEND_PLAIN:
+		auth_fn = p->conf.auth_plain_userfile;
+		break;
+	case AUTH_BACKEND_LDAP:
+		return 0;
+	default:
 		return -1;
 	}
 
-	return ret;
+	if (buffer_string_is_empty(auth_fn)) return -1;
+
+	if (NULL == (uf = http_auth_userfile_get(srv, p, auth_fn))) return -1;
+
+	buffer_copy_buffer(p->tmp_buf, username);
+	if (p->conf.auth_backend == AUTH_BACKEND_HTDIGEST) {
+		buffer_append_string_len(p->tmp_buf, CONST_STR_LEN(":"));
+		buffer_append_string_buffer(p->tmp_buf, realm);
+	}
+
+	if (NULL == (u = http_auth_userfile_find(uf, CONST_BUF_LEN(p->tmp_buf)))) return -1;
+
+	buffer_copy_buffer(password, u->password);
+
+	return 0;
 }
 
 int http_auth_match_rules(server *srv, array *req, const char *username, const char *group, const char *host) {
@@ -842,9 +955,38 @@ static int http_auth_basic_password_compare(server *srv, mod_auth_plugin_data *p
 	return -1;
 }
 
+/**
+ * cache of successful htpasswd verifications, to skip crypt() and friends
+ *
+ * the slot is picked by md5(realm, username, password, stored hash); the
+ * stored hash is part of it so a changed user file invalidates the entry.
+ */
+
+static http_auth_cache_entry *http_auth_cache_slot(mod_auth_plugin_data *p, buffer *username, buffer *realm, buffer *password, const char *pw, unsigned char digest[16]) {
+	li_MD5_CTX Md5Ctx;
+	size_t ndx;
+
+	li_MD5_Init(&Md5Ctx);
+	li_MD5_Update(&Md5Ctx, CONST_BUF_LEN(realm));
+	li_MD5_Update(&Md5Ctx, CONST_STR_LEN("\0"));
+	li_MD5_Update(&Md5Ctx, CONST_BUF_LEN(username));
+	li_MD5_Update(&Md5Ctx, CONST_STR_LEN("\0"));
+	li_MD5_Update(&Md5Ctx, (unsigned char *)pw, strlen(pw));
+	li_MD5_Update(&Md5Ctx, CONST_STR_LEN("\0"));
+	li_MD5_Update(&Md5Ctx, CONST_BUF_LEN(password));
+	li_MD5_Final(digest, &Md5Ctx);
+	safe_memclear(&Md5Ctx, sizeof(Md5Ctx));
+
+	ndx = ((size_t)digest[0] << 8 | digest[1]) % AUTH_CACHE_SIZE;
+
+	return &p->cache[ndx];
+}
+
 int http_auth_basic_check(server *srv, connection *con, mod_auth_plugin_data *p, array *req, const char *realm_str) {
 	buffer *username, *password;
 	char *pw;
+	http_auth_cache_entry *ce = NULL;
+	unsigned char digest[16];
 
 	data_string *realm;
 
@@ -885,8 +1027,15 @@ int http_auth_basic_check(server *srv, connection *con, mod_auth_plugin_data *p,
 		return 0;
 	}
 
+	if (p->conf.auth_backend == AUTH_BACKEND_HTPASSWD && p->conf.auth_cache_ttl > 0) {
+		ce = http_auth_cache_slot(p, username, realm->value, password, pw, digest);
+
+		/* not verified recently */
+		if (ce->expires <= srv->cur_ts || 0 != memcmp(ce->digest, digest, sizeof(digest))) ce = NULL;
+	}
+
 	/* password doesn't match */
-	if (http_auth_basic_password_compare(srv, p, req, username, realm->value, password, pw)) {
+	if (NULL == ce && http_auth_basic_password_compare(srv, p, req, username, realm->value, password, pw)) {
 		log_error_write(srv, __FILE__, __LINE__, "sbsBss", "password doesn't match for", con->uri.path, "username:", username, ", IP:", inet_ntop_cache_get_ip(srv, &(con->dst_addr)));
 
 		buffer_free(username);
@@ -895,6 +1044,13 @@ int http_auth_basic_check(server *srv, connection *con, mod_auth_plugin_data *p,
 		return 0;
 	}
 
+	if (NULL == ce && p->conf.auth_backend == AUTH_BACKEND_HTPASSWD && p->conf.auth_cache_ttl > 0) {
+		ce = http_auth_cache_slot(p, username, realm->value, password, pw, digest);
+		memcpy(ce->digest, digest, sizeof(digest));
+		ce->expires = srv->cur_ts + p->conf.auth_cache_ttl;
+	}
+	safe_memclear(digest, sizeof(digest));
+
 	/* value is our allow-rules */
 	if (http_auth_match_rules(srv, req, username->ptr, NULL, NULL)) {
 		buffer_free(username);
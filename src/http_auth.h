@@ -39,6 +39,7 @@ typedef struct {
 	unsigned short auth_ldap_allow_empty_pw;
 
 	unsigned short auth_debug;
+	unsigned short auth_cache_ttl;
 
 	/* generated */
 	auth_backend_t auth_backend;
@@ -51,10 +52,48 @@ typedef struct {
 #endif
 } mod_auth_plugin_config;
 
+/* a user file parsed into a hash: user (htdigest: user:realm) => password */
+typedef struct http_auth_user {
+	struct http_auth_user *next;
+
+	buffer *key;
+	buffer *password;
+	size_t hash;
+} http_auth_user;
+
+typedef struct {
+	buffer *fn;
+	auth_backend_t backend;
+
+	/* the file the users were read from */
+	time_t mtime;
+	off_t size;
+	ino_t ino;
+	time_t last_check;
+	int loaded;
+
+	http_auth_user **ptr;
+	size_t ptr_size;
+	size_t used;
+} http_auth_userfile;
+
+/* a successful basic auth: md5 of realm, user, password and stored hash */
+typedef struct {
+	unsigned char digest[16];
+	time_t expires;
+} http_auth_cache_entry;
+
+#define AUTH_CACHE_SIZE 1024
+
 typedef struct {
 	PLUGIN_DATA;
 	buffer *tmp_buf;
 
+	http_auth_userfile **userfiles;
+	size_t userfiles_used;
+
+	http_auth_cache_entry *cache; /* AUTH_CACHE_SIZE slots */
+
 	buffer *auth_user;
 
 #ifdef USE_LDAP
@@ -70,5 +109,6 @@ int http_auth_basic_check(server *srv, connection *con, mod_auth_plugin_data *p,
 int http_auth_digest_check(server *srv, connection *con, mod_auth_plugin_data *p, array *req, const char *realm_str);
 int http_auth_digest_generate_nonce(server *srv, mod_auth_plugin_data *p, buffer *fn, char hh[33]);
 int http_auth_match_rules(server *srv, array *req, const char *username, const char *group, const char *host);
+void http_auth_userfiles_free(mod_auth_plugin_data *p);
 
 #endif
@@ -55,6 +55,74 @@ void http_chunk_append_file(server *srv, connection *con, buffer *fn, off_t offs
 	}
 }
 
+void http_chunk_append_shared_mem(server *srv, connection *con, chunk_shared_mem *sm, size_t offset, size_t len) {
+	chunkqueue *cq;
+
+	force_assert(NULL != con);
+	if (0 == len) return;
+
+	cq = con->write_queue;
+
+	/* shared memory doesn't count for the buffer limits, there is nothing to spill */
+	if (con->response.transfer_encoding & HTTP_TRANSFER_ENCODING_CHUNKED) {
+		http_chunk_append_len(srv, con, len);
+	}
+
+	chunkqueue_append_shared_mem(cq, sm, offset, len);
+
+	if (con->response.transfer_encoding & HTTP_TRANSFER_ENCODING_CHUNKED) {
+		chunkqueue_append_mem(cq, CONST_STR_LEN("\r\n"));
+	}
+}
+
+/* the write_queue is above server.max-response-buffer */
+static int http_chunk_queue_full(server *srv, connection *con) {
+	return 0 != srv->srvconf.max_response_buffer
+		&& chunkqueue_length(con->write_queue) > ((off_t)srv->srvconf.max_response_buffer << 10);
+}
+
+/* server.max-buffered-memory is exceeded and the connection holds
+ * at least the average share of it: the largest consumers get throttled first */
+static int http_chunk_over_budget(server *srv, connection *con) {
+	if (!chunk_mem_over_limit()) return 0;
+
+	return con->write_queue->mem_bytes >= chunk_mem_used() / (off_t)(srv->conns->used ? srv->conns->used : 1);
+}
+
+/* new data should go to a tempfile instead of memory */
+static int http_chunk_spill(server *srv, connection *con) {
+	return (srv->srvconf.response_buffer_spill && http_chunk_queue_full(srv, con))
+		|| http_chunk_over_budget(srv, con);
+}
+
+static void http_chunk_spill_mem(server *srv, chunkqueue *cq, const char *mem, size_t len) {
+	/* keep the data in memory if we can't write the tempfile */
+	if (0 != chunkqueue_append_mem_to_tempfile(srv, cq, mem, len)) {
+		chunkqueue_append_mem(cq, mem, len);
+	}
+}
+
+/* put the data behind the tempfiles of the write_queue */
+static void http_chunk_append_mem_tempfile(server *srv, connection *con, const char *mem, size_t len) {
+	chunkqueue *cq = con->write_queue;
+
+	if (con->response.transfer_encoding & HTTP_TRANSFER_ENCODING_CHUNKED) {
+		buffer *b = srv->tmp_chunk_len;
+
+		buffer_string_set_length(b, 0);
+		buffer_append_uint_hex(b, len);
+		buffer_append_string_len(b, CONST_STR_LEN("\r\n"));
+
+		http_chunk_spill_mem(srv, cq, CONST_BUF_LEN(b));
+	}
+
+	http_chunk_spill_mem(srv, cq, mem, len);
+
+	if (con->response.transfer_encoding & HTTP_TRANSFER_ENCODING_CHUNKED) {
+		http_chunk_spill_mem(srv, cq, CONST_STR_LEN("\r\n"));
+	}
+}
+
 void http_chunk_append_buffer(server *srv, connection *con, buffer *mem) {
 	chunkqueue *cq;
 
@@ -62,6 +130,11 @@ void http_chunk_append_buffer(server *srv, connection *con, buffer *mem) {
 
 	if (buffer_string_is_empty(mem)) return;
 
+	if (http_chunk_spill(srv, con)) {
+		http_chunk_append_mem_tempfile(srv, con, CONST_BUF_LEN(mem));
+		return;
+	}
+
 	cq = con->write_queue;
 
 	if (con->response.transfer_encoding & HTTP_TRANSFER_ENCODING_CHUNKED) {
@@ -83,6 +156,11 @@ void http_chunk_append_mem(server *srv, connection *con, const char * mem, size_
 
 	if (NULL == mem || 0 == len) return;
 
+	if (http_chunk_spill(srv, con)) {
+		http_chunk_append_mem_tempfile(srv, con, mem, len);
+		return;
+	}
+
 	cq = con->write_queue;
 
 	if (con->response.transfer_encoding & HTTP_TRANSFER_ENCODING_CHUNKED) {
@@ -96,6 +174,27 @@ void http_chunk_append_mem(server *srv, connection *con, const char * mem, size_
 	}
 }
 
+int http_chunk_backpressure(server *srv, connection *con) {
+	force_assert(NULL != con);
+
+	if ((srv->srvconf.response_buffer_spill || !http_chunk_queue_full(srv, con))
+	    && !http_chunk_over_budget(srv, con)) return 0;
+
+	con->backend_paused = 1;
+
+	return 1;
+}
+
+int http_chunk_backpressure_active(server *srv, connection *con) {
+	force_assert(NULL != con);
+
+	/* low watermark: half of server.max-response-buffer */
+	if (0 != srv->srvconf.max_response_buffer &&
+	    chunkqueue_length(con->write_queue) > ((off_t)srv->srvconf.max_response_buffer << 10) / 2) return 1;
+
+	return http_chunk_over_budget(srv, con);
+}
+
 void http_chunk_close(server *srv, connection *con) {
 	UNUSED(srv);
 	force_assert(NULL != con);
@@ -7,6 +7,15 @@
 void http_chunk_append_mem(server *srv, connection *con, const char * mem, size_t len); /* copies memory */
 void http_chunk_append_buffer(server *srv, connection *con, buffer *mem); /* may reset "mem" */
 void http_chunk_append_file(server *srv, connection *con, buffer *fn, off_t offset, off_t len); /* copies "fn" */
+void http_chunk_append_shared_mem(server *srv, connection *con, chunk_shared_mem *sm, size_t offset, size_t len); /* references "sm" */
 void http_chunk_close(server *srv, connection *con);
 
+/* returns 1 if the write_queue is above server.max-response-buffer or
+ * takes more than its share of server.max-buffered-memory:
+ * the backend should stop reading; once http_chunk_backpressure_active()
+ * is false the core clears con->backend_paused and calls the subrequest
+ * handler, which has to resume reading from the backend */
+int http_chunk_backpressure(server *srv, connection *con);
+int http_chunk_backpressure_active(server *srv, connection *con);
+
 #endif
@@ -1,7 +1,10 @@
 #include "server.h"
 #include "keyvalue.h"
+#include "plugin.h"
 #include "log.h"
+#include "strtrie.h"
 
+#include <ctype.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -97,6 +100,7 @@ static keyvalue http_status[] = {
 	{ 423, "Locked" }, /* WebDAV */
 	{ 424, "Failed Dependency" }, /* WebDAV */
 	{ 426, "Upgrade Required" }, /* TLS */
+	{ 429, "Too Many Requests" },
 	{ 500, "Internal Server Error" },
 	{ 501, "Not Implemented" },
 	{ 502, "Bad Gateway" },
@@ -321,10 +325,391 @@ http_method_t get_http_method_key(const char *s) {
 
 
 
+struct pcre_prefilter {
+	strtrie *tree;  /* rules by their literal prefix */
+
+	size_t *always; /* rules without literal prefix, ascending */
+	size_t always_used;
+
+	/* scratch space for pcre_prefilter_candidates() */
+	size_t *tree_ndx;
+	size_t tree_ndx_size;
+	size_t *cand;
+	size_t cand_size;
+};
+
+/* the literal text every match of pattern has to start with; only for
+ * patterns compiled without options and matched from offset 0 */
+static void pcre_prefilter_literal_prefix(const char *p, buffer *b) {
+	size_t i, j;
+	int depth = 0, in_class = 0;
+
+	buffer_reset(b);
+
+	if (p[0] == '^') {
+		i = 1;
+	} else if (p[0] == '\\' && p[1] == 'A') {
+		i = 2;
+	} else {
+		return;
+	}
+
+	/* a top-level alternative could match anything */
+	for (j = 0; p[j]; j++) {
+		if (p[j] == '\\') {
+			if (p[j+1] == 'Q') {
+				const char *e = strstr(p + j + 2, "\\E");
+				if (NULL == e) break;
+				j = e - p + 1;
+			} else if (p[j+1] != '\0') {
+				j++;
+			}
+		} else if (in_class) {
+			if (p[j] == ']' && j > (size_t)in_class) in_class = 0;
+		} else if (p[j] == '[') {
+			/* a ']' right after '[' or '[^' is a literal */
+			in_class = (p[j+1] == '^') ? (int)j + 2 : (int)j + 1;
+		} else if (p[j] == '(') {
+			depth++;
+		} else if (p[j] == ')') {
+			depth--;
+		} else if (p[j] == '|' && depth == 0) {
+			return;
+		}
+	}
+
+	for (;;) {
+		char c = p[i];
+		size_t width = 1;
+
+		if (c == '\\') {
+			c = p[i+1];
+			/* \d, \x41, \Q, ... are no single literals */
+			if (c == '\0' || isalnum((unsigned char)c)) break;
+			width = 2;
+		} else if (c == '\0' || NULL != strchr(".[](){}*+?|^$", c)) {
+			break;
+		}
+
+		i += width;
+
+		/* a quantified literal may be absent */
+		if (p[i] == '*' || p[i] == '?' || p[i] == '{') break;
+
+		buffer_append_string_len(b, &c, 1);
+
+		if (p[i] == '+') break;
+	}
+}
+
+pcre_prefilter *pcre_prefilter_init(void) {
+	pcre_prefilter *pf = calloc(1, sizeof(*pf));
+	force_assert(NULL != pf);
+
+	pf->tree = strtrie_init(0, 0);
+
+	return pf;
+}
+
+void pcre_prefilter_free(pcre_prefilter *pf) {
+	if (NULL == pf) return;
+
+	strtrie_free(pf->tree);
+	free(pf->always);
+	free(pf->tree_ndx);
+	free(pf->cand);
+	free(pf);
+}
+
+/* rules have to be inserted in the order they are tried */
+void pcre_prefilter_insert(pcre_prefilter *pf, const char *pattern, size_t ndx) {
+	buffer *prefix = buffer_init();
+
+	pcre_prefilter_literal_prefix(pattern, prefix);
+
+	if (buffer_string_is_empty(prefix)) {
+		pf->always = realloc(pf->always, (pf->always_used + 1) * sizeof(*pf->always));
+		force_assert(NULL != pf->always);
+		pf->always[pf->always_used++] = ndx;
+	} else {
+		strtrie_insert(pf->tree, CONST_BUF_LEN(prefix), ndx);
+	}
+
+	buffer_free(prefix);
+}
+
+static int pcre_prefilter_ndx_cmp(const void *a, const void *b) {
+	size_t x = *(const size_t *)a, y = *(const size_t *)b;
+	return (x > y) - (x < y);
+}
+
+/* returns the ascending list of rules which can match s */
+size_t pcre_prefilter_candidates(pcre_prefilter *pf, const char *s, size_t slen, const size_t **ndx) {
+	size_t used, i, j, k;
+
+	used = strtrie_match_all(pf->tree, s, slen, &pf->tree_ndx, &pf->tree_ndx_size);
+
+	if (0 == used) {
+		*ndx = pf->always;
+		return pf->always_used;
+	}
+
+	/* each node is sorted, the nodes on the path are not */
+	if (used > 1) qsort(pf->tree_ndx, used, sizeof(*pf->tree_ndx), pcre_prefilter_ndx_cmp);
+
+	if (0 == pf->always_used) {
+		*ndx = pf->tree_ndx;
+		return used;
+	}
+
+	if (used + pf->always_used > pf->cand_size) {
+		pf->cand_size = used + pf->always_used;
+		pf->cand = realloc(pf->cand, pf->cand_size * sizeof(*pf->cand));
+		force_assert(NULL != pf->cand);
+	}
+
+	for (i = 0, j = 0, k = 0; i < used || j < pf->always_used; k++) {
+		if (j == pf->always_used || (i < used && pf->tree_ndx[i] < pf->always[j])) {
+			pf->cand[k] = pf->tree_ndx[i++];
+		} else {
+			pf->cand[k] = pf->always[j++];
+		}
+	}
+
+	*ndx = pf->cand;
+	return k;
+}
+
+#define PCRE_RESULT_CACHE_BUCKETS 256
+/* longer urls are not worth remembering */
+#define PCRE_RESULT_CACHE_KEY_MAX 1024
+
+typedef struct pcre_result_cache_entry {
+	struct pcre_result_cache_entry *next; /* hash chain */
+	struct pcre_result_cache_entry *lru_prev, *lru_next;
+
+	size_t hash;
+	int ndx;
+	buffer *key;
+	buffer *result;
+} pcre_result_cache_entry;
+
+struct pcre_result_cache {
+	pcre_result_cache_entry *buckets[PCRE_RESULT_CACHE_BUCKETS];
+	pcre_result_cache_entry *lru_head, *lru_tail; /* most/least recently used */
+	size_t used;
+};
+
+static size_t pcre_result_cache_hash(const buffer *key) {
+	size_t i, len = buffer_string_length(key), h = 5381;
+
+	for (i = 0; i < len; i++) {
+		h = (h * 33) ^ (unsigned char)key->ptr[i];
+	}
+
+	return h;
+}
+
+static void pcre_result_cache_lru_unlink(pcre_result_cache *rc, pcre_result_cache_entry *e) {
+	if (e->lru_prev) e->lru_prev->lru_next = e->lru_next; else rc->lru_head = e->lru_next;
+	if (e->lru_next) e->lru_next->lru_prev = e->lru_prev; else rc->lru_tail = e->lru_prev;
+}
+
+static void pcre_result_cache_lru_push(pcre_result_cache *rc, pcre_result_cache_entry *e) {
+	e->lru_prev = NULL;
+	e->lru_next = rc->lru_head;
+	if (rc->lru_head) rc->lru_head->lru_prev = e; else rc->lru_tail = e;
+	rc->lru_head = e;
+}
+
+pcre_result_cache *pcre_result_cache_init(void) {
+	pcre_result_cache *rc = calloc(1, sizeof(*rc));
+	force_assert(NULL != rc);
+
+	return rc;
+}
+
+void pcre_result_cache_free(pcre_result_cache *rc) {
+	pcre_result_cache_entry *e, *next;
+
+	if (NULL == rc) return;
+
+	for (e = rc->lru_head; e; e = next) {
+		next = e->lru_next;
+		buffer_free(e->key);
+		buffer_free(e->result);
+		free(e);
+	}
+
+	free(rc);
+}
+
+/* returns the cached rule index (result is set if >= 0),
+ * PCRE_RESULT_CACHE_NOMATCH or PCRE_RESULT_CACHE_MISS */
+int pcre_result_cache_get(pcre_result_cache *rc, const buffer *key, buffer *result) {
+	pcre_result_cache_entry *e;
+	size_t h;
+
+	if (NULL == rc) return PCRE_RESULT_CACHE_MISS;
+
+	h = pcre_result_cache_hash(key);
+
+	for (e = rc->buckets[h % PCRE_RESULT_CACHE_BUCKETS]; e; e = e->next) {
+		if (e->hash != h) continue;
+		if (!buffer_is_equal(e->key, key)) continue;
+
+		if (e != rc->lru_head) {
+			pcre_result_cache_lru_unlink(rc, e);
+			pcre_result_cache_lru_push(rc, e);
+		}
+
+		if (e->ndx >= 0) buffer_copy_buffer(result, e->result);
+
+		return e->ndx;
+	}
+
+	return PCRE_RESULT_CACHE_MISS;
+}
+
+void pcre_result_cache_put(pcre_result_cache *rc, const buffer *key, int ndx, const buffer *result) {
+	pcre_result_cache_entry *e, **pe;
+	size_t h;
+
+	if (buffer_string_length(key) > PCRE_RESULT_CACHE_KEY_MAX) return;
+
+	h = pcre_result_cache_hash(key);
+
+	if (rc->used < PCRE_RESULT_CACHE_MAX) {
+		e = calloc(1, sizeof(*e));
+		force_assert(NULL != e);
+		e->key = buffer_init();
+		e->result = buffer_init();
+		rc->used++;
+	} else {
+		/* reuse the least recently used entry */
+		e = rc->lru_tail;
+		pcre_result_cache_lru_unlink(rc, e);
+
+		for (pe = &rc->buckets[e->hash % PCRE_RESULT_CACHE_BUCKETS]; *pe != e; pe = &(*pe)->next) ;
+		*pe = e->next;
+	}
+
+	e->hash = h;
+	e->ndx = ndx;
+	buffer_copy_buffer(e->key, key);
+	if (ndx >= 0) {
+		buffer_copy_buffer(e->result, result);
+	} else {
+		buffer_reset(e->result);
+	}
+
+	e->next = rc->buckets[h % PCRE_RESULT_CACHE_BUCKETS];
+	rc->buckets[h % PCRE_RESULT_CACHE_BUCKETS] = e;
+	pcre_result_cache_lru_push(rc, e);
+}
+
+/* the substitution of value depends on the captures of the conditional */
+int pcre_value_has_cond_refs(const char *value) {
+	for (; *value; value++) {
+		if (value[0] == '%' && value[1] >= '0' && value[1] <= '9') return 1;
+		/* "%%" is an escaped '%' */
+		if (value[0] == '%' && value[1] == '%') value++;
+	}
+
+	return 0;
+}
+
+void pcre_rule_index_init(pcre_rule_index *ri) {
+	ri->prefilter = pcre_prefilter_init();
+	ri->results = NULL;
+	ri->cond_refs = 0;
+}
+
+/* register rule ndx (pattern -> value) of the list */
+void pcre_rule_index_append(pcre_rule_index *ri, const char *pattern, const char *value, size_t ndx) {
+	pcre_prefilter_insert(ri->prefilter, pattern, ndx);
+	if (pcre_value_has_cond_refs(value)) ri->cond_refs = 1;
+}
+
+void pcre_rule_index_free(pcre_rule_index *ri) {
+	pcre_prefilter_free(ri->prefilter);
+	pcre_result_cache_free(ri->results);
+}
+
+/* the outcome of a rule list only depends on the url and, if a value
+ * references %0-%9, on the captures of the conditional */
+const buffer *pcre_result_cache_key(connection *con, data_config *context, const pcre_rule_index *ri, const buffer *url, buffer *key) {
+	int num;
+
+	if (!ri->cond_refs || NULL == context) return url;
+
+	buffer_copy_buffer(key, url);
+	for (num = 0; num < 10; num++) {
+		buffer_append_string_len(key, CONST_STR_LEN("\0"));
+		config_append_cond_match_buffer(con, context, key, num);
+	}
+
+	return key;
+}
+
+#ifdef HAVE_PCRE_H
+#ifdef PCRE_STUDY_JIT_COMPILE
+/* lighttpd matches from a single thread, so all JIT compiled patterns can
+ * share one machine stack; it is allocated with the first JIT pattern and
+ * released with the last one */
+#define PCRE_JIT_STACK_START_SIZE (32 * 1024)
+#define PCRE_JIT_STACK_MAX_SIZE   (512 * 1024)
+
+static pcre_jit_stack *pcre_jit_stack_shared = NULL;
+static size_t pcre_jit_stack_refs = 0;
+#endif
+
+pcre_extra *pcre_keyvalue_study(pcre *re, const char **errptr) {
+	pcre_extra *extra;
+#ifdef PCRE_STUDY_JIT_COMPILE
+	int jit = 0;
+
+	*errptr = NULL;
+	if (NULL == (extra = pcre_study(re, PCRE_STUDY_JIT_COMPILE, errptr))) return NULL;
+
+	if (0 == pcre_fullinfo(re, extra, PCRE_INFO_JIT, &jit) && jit) {
+		if (NULL == pcre_jit_stack_shared) {
+			pcre_jit_stack_shared = pcre_jit_stack_alloc(PCRE_JIT_STACK_START_SIZE, PCRE_JIT_STACK_MAX_SIZE);
+		}
+		if (NULL != pcre_jit_stack_shared) {
+			pcre_assign_jit_stack(extra, NULL, pcre_jit_stack_shared);
+		}
+	}
+	/* every studied pattern holds a reference, see pcre_keyvalue_study_free() */
+	pcre_jit_stack_refs++;
+#else
+	*errptr = NULL;
+	extra = pcre_study(re, 0, errptr);
+#endif
+
+	return extra;
+}
+
+void pcre_keyvalue_study_free(pcre_extra *extra) {
+	if (NULL == extra) return;
+#ifdef PCRE_STUDY_JIT_COMPILE
+	pcre_free_study(extra);
+
+	if (pcre_jit_stack_refs > 0 && 0 == --pcre_jit_stack_refs && NULL != pcre_jit_stack_shared) {
+		pcre_jit_stack_free(pcre_jit_stack_shared);
+		pcre_jit_stack_shared = NULL;
+	}
+#else
+	pcre_free(extra);
+#endif
+}
+#endif
+
 pcre_keyvalue_buffer *pcre_keyvalue_buffer_init(void) {
 	pcre_keyvalue_buffer *kvb;
 
 	kvb = calloc(1, sizeof(*kvb));
+	pcre_rule_index_init(&kvb->index);
 
 	return kvb;
 }
@@ -368,13 +753,15 @@ int pcre_keyvalue_buffer_append(server *srv, pcre_keyvalue_buffer *kvb, const ch
 		return -1;
 	}
 
-	if (NULL == (kv->key_extra = pcre_study(kv->key, 0, &errptr)) &&
+	if (NULL == (kv->key_extra = pcre_keyvalue_study(kv->key, &errptr)) &&
 			errptr != NULL) {
 		return -1;
 	}
 
 	kv->value = buffer_init_string(value);
 
+	pcre_rule_index_append(&kvb->index, key, value, kvb->used);
+
 	kvb->used++;
 
 	return 0;
@@ -394,7 +781,7 @@ void pcre_keyvalue_buffer_free(pcre_keyvalue_buffer *kvb) {
 	for (i = 0; i < kvb->size; i++) {
 		kv = kvb->kv[i];
 		if (kv->key) pcre_free(kv->key);
-		if (kv->key_extra) pcre_free(kv->key_extra);
+		if (kv->key_extra) pcre_keyvalue_study_free(kv->key_extra);
 		if (kv->value) buffer_free(kv->value);
 		free(kv);
 	}
@@ -402,5 +789,6 @@ void pcre_keyvalue_buffer_free(pcre_keyvalue_buffer *kvb) {
 	if (kvb->kv) free(kvb->kv);
 #endif
 
+	pcre_rule_index_free(&kvb->index);
 	free(kvb);
 }
@@ -105,7 +105,33 @@ typedef struct {\
 KVB(keyvalue);
 KVB(s_keyvalue);
 KVB(httpauth_keyvalue);
-KVB(pcre_keyvalue);
+
+/* candidate filter for an ordered list of regexes: rules whose pattern
+ * starts with an anchored literal ("^/old/...") are stored in a radix tree
+ * keyed by that literal, all other rules are always candidates */
+typedef struct pcre_prefilter pcre_prefilter;
+
+/* bounded LRU of the outcome of a rule list (index of the matching rule and
+ * the substituted value) keyed by the input url and conditional captures */
+typedef struct pcre_result_cache pcre_result_cache;
+
+#define PCRE_RESULT_CACHE_MISS    -2
+#define PCRE_RESULT_CACHE_NOMATCH -1
+
+/* lookup state shared by the rule lists of mod_redirect and mod_rewrite */
+typedef struct {
+	pcre_prefilter *prefilter;
+	pcre_result_cache *results; /* created on the first miss */
+	int cond_refs; /* a value references %0-%9 */
+} pcre_rule_index;
+
+typedef struct {
+	pcre_keyvalue **kv;
+	size_t used;
+	size_t size;
+
+	pcre_rule_index index;
+} pcre_keyvalue_buffer;
 
 const char *get_http_status_name(int i);
 const char *get_http_version_name(int i);
@@ -133,4 +159,26 @@ pcre_keyvalue_buffer *pcre_keyvalue_buffer_init(void);
 int pcre_keyvalue_buffer_append(struct server *srv, pcre_keyvalue_buffer *kvb, const char *key, const char *value);
 void pcre_keyvalue_buffer_free(pcre_keyvalue_buffer *kvb);
 
+pcre_prefilter *pcre_prefilter_init(void);
+void pcre_prefilter_free(pcre_prefilter *pf);
+void pcre_prefilter_insert(pcre_prefilter *pf, const char *pattern, size_t ndx);
+size_t pcre_prefilter_candidates(pcre_prefilter *pf, const char *s, size_t slen, const size_t **ndx);
+
+pcre_result_cache *pcre_result_cache_init(void);
+void pcre_result_cache_free(pcre_result_cache *rc);
+int pcre_result_cache_get(pcre_result_cache *rc, const buffer *key, buffer *result);
+void pcre_result_cache_put(pcre_result_cache *rc, const buffer *key, int ndx, const buffer *result);
+int pcre_value_has_cond_refs(const char *value);
+
+void pcre_rule_index_init(pcre_rule_index *ri);
+void pcre_rule_index_append(pcre_rule_index *ri, const char *pattern, const char *value, size_t ndx);
+void pcre_rule_index_free(pcre_rule_index *ri);
+
+#ifdef HAVE_PCRE_H
+/* study a compiled pattern for repeated per-request matching;
+ * uses the PCRE JIT (with a shared JIT stack) when available */
+pcre_extra *pcre_keyvalue_study(pcre *re, const char **errptr);
+void pcre_keyvalue_study_free(pcre_extra *extra);
+#endif
+
 #endif
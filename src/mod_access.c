@@ -3,13 +3,23 @@
 #include "buffer.h"
 
 #include "plugin.h"
+#include "cidr.h"
+#include "strtrie.h"
 
 #include <ctype.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 
 typedef struct {
 	array *access_deny;
+	array *access_deny_remoteip;
+
+	cidr_tree *deny_remoteip; /* built from access_deny_remoteip */
+
+	/* access_deny suffixes, mapping to their position in access_deny */
+	strtrie *deny_suffixes;
+	strtrie *deny_suffixes_nocase; /* server.force-lowercase-filenames */
 } plugin_config;
 
 typedef struct {
@@ -17,6 +27,7 @@ typedef struct {
 
 	plugin_config **config_storage;
 
+	config_snapshots *snapshots;
 	plugin_config conf;
 } plugin_data;
 
@@ -43,12 +54,18 @@ FREE_FUNC(mod_access_free) {
 			if (NULL == s) continue;
 
 			array_free(s->access_deny);
+			array_free(s->access_deny_remoteip);
+			cidr_tree_free(s->deny_remoteip);
+			strtrie_free(s->deny_suffixes);
+			strtrie_free(s->deny_suffixes_nocase);
 
 			free(s);
 		}
 		free(p->config_storage);
 	}
 
+	config_snapshots_free(p->snapshots);
+
 	free(p);
 
 	return HANDLER_GO_ON;
@@ -59,7 +76,8 @@ SETDEFAULTS_FUNC(mod_access_set_defaults) {
 	size_t i = 0;
 
 	config_values_t cv[] = {
-		{ "url.access-deny",             NULL, T_CONFIG_ARRAY, T_CONFIG_SCOPE_CONNECTION },
+		{ "url.access-deny",             NULL, T_CONFIG_ARRAY, T_CONFIG_SCOPE_CONNECTION },       /* 0 */
+		{ "access.deny-remoteip",        NULL, T_CONFIG_ARRAY, T_CONFIG_SCOPE_CONNECTION },       /* 1 */
 		{ NULL,                          NULL, T_CONFIG_UNSET, T_CONFIG_SCOPE_UNSET }
 	};
 
@@ -68,19 +86,86 @@ SETDEFAULTS_FUNC(mod_access_set_defaults) {
 	for (i = 0; i < srv->config_context->used; i++) {
 		data_config const* config = (data_config const*)srv->config_context->data[i];
 		plugin_config *s;
+		size_t k;
 
 		s = calloc(1, sizeof(plugin_config));
 		s->access_deny    = array_init();
+		s->access_deny_remoteip = array_init();
 
 		cv[0].destination = s->access_deny;
+		cv[1].destination = s->access_deny_remoteip;
 
 		p->config_storage[i] = s;
 
 		if (0 != config_insert_values_global(srv, config->value, cv, i == 0 ? T_CONFIG_SCOPE_SERVER : T_CONFIG_SCOPE_CONNECTION)) {
 			return HANDLER_ERROR;
 		}
+
+		s->deny_suffixes = strtrie_init(0, 1);
+		s->deny_suffixes_nocase = strtrie_init(1, 1);
+		for (k = 0; k < s->access_deny->used; k++) {
+			data_string *ds = (data_string *)s->access_deny->data[k];
+
+			if (ds->type != TYPE_STRING) {
+				log_error_write(srv, __FILE__, __LINE__, "s",
+						"unexpected type for key: url.access-deny, expected list of strings");
+				return HANDLER_ERROR;
+			}
+
+			/* unset values are skipped; "" is the empty suffix and matches everything */
+			if (buffer_is_empty(ds->value)) continue;
+
+			strtrie_insert(s->deny_suffixes, CONST_BUF_LEN(ds->value), k);
+			strtrie_insert(s->deny_suffixes_nocase, CONST_BUF_LEN(ds->value), k);
+		}
+
+		if (0 == s->access_deny_remoteip->used) continue;
+
+		/* networks and "file:<one network per line>" */
+		s->deny_remoteip = cidr_tree_init();
+
+		for (k = 0; k < s->access_deny_remoteip->used; k++) {
+			data_string *ds = (data_string *)s->access_deny_remoteip->data[k];
+
+			if (ds->type != TYPE_STRING) {
+				log_error_write(srv, __FILE__, __LINE__, "s",
+						"unexpected type for key: access.deny-remoteip, expected list of networks");
+				return HANDLER_ERROR;
+			}
+
+			if (0 == strncmp(ds->value->ptr, "file:", sizeof("file:") - 1)) {
+				const char *fn = ds->value->ptr + sizeof("file:") - 1;
+				buffer *path = srv->tmp_buf;
+				size_t line;
+
+				/* relative to the config file, like "file:" in $HTTP["remoteip"] */
+				if (buffer_string_is_empty(srv->srvconf.config_basedir) || fn[0] == '/' || fn[0] == '\\') {
+					buffer_copy_string(path, fn);
+				} else {
+					buffer_copy_buffer(path, srv->srvconf.config_basedir);
+					buffer_append_string(path, fn);
+				}
+
+				if (0 != cidr_tree_insert_file(s->deny_remoteip, path->ptr, &line)) {
+					if (line) {
+						log_error_write(srv, __FILE__, __LINE__, "sbsd",
+								"access.deny-remoteip: invalid network in", path, "line", (int)line);
+					} else {
+						log_error_write(srv, __FILE__, __LINE__, "sbss",
+								"access.deny-remoteip: reading", path, "failed:", strerror(errno));
+					}
+					return HANDLER_ERROR;
+				}
+			} else if (0 != cidr_tree_insert(s->deny_remoteip, CONST_BUF_LEN(ds->value))) {
+				log_error_write(srv, __FILE__, __LINE__, "sb",
+						"access.deny-remoteip: invalid network:", ds->value);
+				return HANDLER_ERROR;
+			}
+		}
 	}
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 }
 
@@ -90,7 +175,12 @@ static int mod_access_patch_connection(server *srv, connection *con, plugin_data
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH(access_deny);
+	PATCH(deny_suffixes);
+	PATCH(deny_suffixes_nocase);
+	PATCH(deny_remoteip);
 
 	/* skip the first, the global context */
 	for (i = 1; i < srv->config_context->used; i++) {
@@ -106,10 +196,16 @@ static int mod_access_patch_connection(server *srv, connection *con, plugin_data
 
 			if (buffer_is_equal_string(du->key, CONST_STR_LEN("url.access-deny"))) {
 				PATCH(access_deny);
+				PATCH(deny_suffixes);
+				PATCH(deny_suffixes_nocase);
+			} else if (buffer_is_equal_string(du->key, CONST_STR_LEN("access.deny-remoteip"))) {
+				PATCH(deny_remoteip);
 			}
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 #undef PATCH
@@ -125,52 +221,45 @@ static int mod_access_patch_connection(server *srv, connection *con, plugin_data
  */
 URIHANDLER_FUNC(mod_access_uri_handler) {
 	plugin_data *p = p_d;
-	int s_len;
-	size_t k;
+	ssize_t k;
 
 	if (buffer_is_empty(con->uri.path)) return HANDLER_GO_ON;
 
 	mod_access_patch_connection(srv, con, p);
 
-	s_len = buffer_string_length(con->uri.path);
-
 	if (con->conf.log_request_handling) {
 		log_error_write(srv, __FILE__, __LINE__, "s",
 				"-- mod_access_uri_handler called");
 	}
 
-	for (k = 0; k < p->conf.access_deny->used; k++) {
-		data_string *ds = (data_string *)p->conf.access_deny->data[k];
-		int ct_len = buffer_string_length(ds->value);
-		int denied = 0;
-
-
-		if (ct_len > s_len) continue;
-		if (buffer_is_empty(ds->value)) continue;
+	if (NULL != p->conf.deny_remoteip && cidr_tree_match(p->conf.deny_remoteip, &(con->dst_addr))) {
+		con->http_status = 403;
+		con->mode = DIRECT;
 
-		/* if we have a case-insensitive FS we have to lower-case the URI here too */
-
-		if (con->conf.force_lowercase_filenames) {
-			if (0 == strncasecmp(con->uri.path->ptr + s_len - ct_len, ds->value->ptr, ct_len)) {
-				denied = 1;
-			}
-		} else {
-			if (0 == strncmp(con->uri.path->ptr + s_len - ct_len, ds->value->ptr, ct_len)) {
-				denied = 1;
-			}
+		if (con->conf.log_request_handling) {
+			log_error_write(srv, __FILE__, __LINE__, "sb",
+				"remote ip denied:", con->dst_addr_buf);
 		}
 
-		if (denied) {
-			con->http_status = 403;
-			con->mode = DIRECT;
+		return HANDLER_FINISHED;
+	}
 
-			if (con->conf.log_request_handling) {
-	 			log_error_write(srv, __FILE__, __LINE__, "sb", 
-					"url denied as we match:", ds->value);
-			}
+	/* if we have a case-insensitive FS we have to lower-case the URI here too */
+	k = strtrie_match_first(con->conf.force_lowercase_filenames ?
+				p->conf.deny_suffixes_nocase : p->conf.deny_suffixes,
+				CONST_BUF_LEN(con->uri.path));
+
+	if (k >= 0) {
+		con->http_status = 403;
+		con->mode = DIRECT;
 
-			return HANDLER_FINISHED;
+		if (con->conf.log_request_handling) {
+			data_string *ds = (data_string *)p->conf.access_deny->data[k];
+			log_error_write(srv, __FILE__, __LINE__, "sb",
+				"url denied as we match:", ds->value);
 		}
+
+		return HANDLER_FINISHED;
 	}
 
 	/* not found */
@@ -146,6 +146,7 @@ typedef struct {
 	PLUGIN_DATA;
 
 	plugin_config **config_storage;
+	config_snapshots *snapshots;
 	plugin_config conf;
 
 	buffer *syslog_logbuffer; /* syslog has global buffer. no caching, always written directly */
@@ -454,6 +455,9 @@ FREE_FUNC(mod_accesslog_free) {
 	}
 
 	if (p->syslog_logbuffer) buffer_free(p->syslog_logbuffer);
+
+	config_snapshots_free(p->snapshots);
+
 	free(p);
 
 	return HANDLER_GO_ON;
@@ -587,6 +591,8 @@ SETDEFAULTS_FUNC(log_access_open) {
 
 	}
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 }
 
@@ -633,6 +639,8 @@ static int mod_accesslog_patch_connection(server *srv, connection *con, plugin_d
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH(access_logfile);
 	PATCH(format);
 	PATCH(log_access_fd);
@@ -676,6 +684,8 @@ static int mod_accesslog_patch_connection(server *srv, connection *con, plugin_d
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 #undef PATCH
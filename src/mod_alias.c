@@ -3,6 +3,7 @@
 #include "buffer.h"
 
 #include "plugin.h"
+#include "strtrie.h"
 
 #include <ctype.h>
 #include <stdlib.h>
@@ -12,6 +13,10 @@
 /* plugin config for all request/connections */
 typedef struct {
 	array *alias;
+
+	/* alias keys, mapping to their position in alias */
+	strtrie *alias_prefixes;
+	strtrie *alias_prefixes_nocase; /* server.force-lowercase-filenames */
 } plugin_config;
 
 typedef struct {
@@ -19,6 +24,7 @@ typedef struct {
 
 	plugin_config **config_storage;
 
+	config_snapshots *snapshots;
 	plugin_config conf;
 } plugin_data;
 
@@ -48,12 +54,16 @@ FREE_FUNC(mod_alias_free) {
 			if (NULL == s) continue;
 
 			array_free(s->alias);
+			strtrie_free(s->alias_prefixes);
+			strtrie_free(s->alias_prefixes_nocase);
 
 			free(s);
 		}
 		free(p->config_storage);
 	}
 
+	config_snapshots_free(p->snapshots);
+
 	free(p);
 
 	return HANDLER_GO_ON;
@@ -63,7 +73,7 @@ FREE_FUNC(mod_alias_free) {
 
 SETDEFAULTS_FUNC(mod_alias_set_defaults) {
 	plugin_data *p = p_d;
-	size_t i = 0;
+	size_t i = 0, n;
 
 	config_values_t cv[] = {
 		{ "alias.url",                  NULL, T_CONFIG_ARRAY, T_CONFIG_SCOPE_CONNECTION },       /* 0 */
@@ -89,12 +99,13 @@ SETDEFAULTS_FUNC(mod_alias_set_defaults) {
 		}
 		if (s->alias->used >= 2) {
 			const array *a = s->alias;
+			const size_t *sorted = array_get_sorted_index(s->alias);
 			size_t j, k;
 
 			for (j = 0; j < a->used; j ++) {
-				const buffer *prefix = a->data[a->sorted[j]]->key;
+				const buffer *prefix = a->data[sorted[j]]->key;
 				for (k = j + 1; k < a->used; k ++) {
-					const buffer *key = a->data[a->sorted[k]]->key;
+					const buffer *key = a->data[sorted[k]]->key;
 
 					if (buffer_string_length(key) < buffer_string_length(prefix)) {
 						break;
@@ -103,7 +114,7 @@ SETDEFAULTS_FUNC(mod_alias_set_defaults) {
 						break;
 					}
 					/* ok, they have same prefix. check position */
-					if (a->sorted[j] < a->sorted[k]) {
+					if (sorted[j] < sorted[k]) {
 						log_error_write(srv, __FILE__, __LINE__, "SBSBS",
 							"url.alias: `", key, "' will never match as `", prefix, "' matched first");
 						return HANDLER_ERROR;
@@ -111,8 +122,22 @@ SETDEFAULTS_FUNC(mod_alias_set_defaults) {
 				}
 			}
 		}
+
+		/* the first alias in the list which is a prefix of the url wins */
+		s->alias_prefixes = strtrie_init(0, 0);
+		s->alias_prefixes_nocase = strtrie_init(1, 0);
+		for (n = 0; n < s->alias->used; n++) {
+			const buffer *key = s->alias->data[n]->key;
+
+			if (buffer_is_empty(key)) continue;
+
+			strtrie_insert(s->alias_prefixes, CONST_BUF_LEN(key), n);
+			strtrie_insert(s->alias_prefixes_nocase, CONST_BUF_LEN(key), n);
+		}
 	}
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 }
 
@@ -122,7 +147,11 @@ static int mod_alias_patch_connection(server *srv, connection *con, plugin_data
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH(alias);
+	PATCH(alias_prefixes);
+	PATCH(alias_prefixes_nocase);
 
 	/* skip the first, the global context */
 	for (i = 1; i < srv->config_context->used; i++) {
@@ -138,10 +167,14 @@ static int mod_alias_patch_connection(server *srv, connection *con, plugin_data
 
 			if (buffer_is_equal_string(du->key, CONST_STR_LEN("alias.url"))) {
 				PATCH(alias);
+				PATCH(alias_prefixes);
+				PATCH(alias_prefixes_nocase);
 			}
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 #undef PATCH
@@ -150,7 +183,8 @@ PHYSICALPATH_FUNC(mod_alias_physical_handler) {
 	plugin_data *p = p_d;
 	int uri_len, basedir_len;
 	char *uri_ptr;
-	size_t k;
+	ssize_t k;
+	data_string *ds;
 
 	if (buffer_is_empty(con->physical.path)) return HANDLER_GO_ON;
 
@@ -162,28 +196,22 @@ PHYSICALPATH_FUNC(mod_alias_physical_handler) {
 	uri_len = buffer_string_length(con->physical.path) - basedir_len;
 	uri_ptr = con->physical.path->ptr + basedir_len;
 
-	for (k = 0; k < p->conf.alias->used; k++) {
-		data_string *ds = (data_string *)p->conf.alias->data[k];
-		int alias_len = buffer_string_length(ds->key);
+	if (uri_len < 0) return HANDLER_GO_ON;
 
-		if (alias_len > uri_len) continue;
-		if (buffer_is_empty(ds->key)) continue;
+	k = strtrie_match_first(con->conf.force_lowercase_filenames ?
+				p->conf.alias_prefixes_nocase : p->conf.alias_prefixes,
+				uri_ptr, uri_len);
 
-		if (0 == (con->conf.force_lowercase_filenames ?
-					strncasecmp(uri_ptr, ds->key->ptr, alias_len) :
-					strncmp(uri_ptr, ds->key->ptr, alias_len))) {
-			/* matched */
+	/* not found */
+	if (k < 0) return HANDLER_GO_ON;
 
-			buffer_copy_buffer(con->physical.basedir, ds->value);
-			buffer_copy_buffer(srv->tmp_buf, ds->value);
-			buffer_append_string(srv->tmp_buf, uri_ptr + alias_len);
-			buffer_copy_buffer(con->physical.path, srv->tmp_buf);
+	ds = (data_string *)p->conf.alias->data[k];
 
-			return HANDLER_GO_ON;
-		}
-	}
+	buffer_copy_buffer(con->physical.basedir, ds->value);
+	buffer_copy_buffer(srv->tmp_buf, ds->value);
+	buffer_append_string(srv->tmp_buf, uri_ptr + buffer_string_length(ds->key));
+	buffer_copy_buffer(con->physical.path, srv->tmp_buf);
 
-	/* not found */
 	return HANDLER_GO_ON;
 }
 
@@ -33,6 +33,8 @@ INIT_FUNC(mod_auth_init) {
 	p = calloc(1, sizeof(*p));
 
 	p->tmp_buf = buffer_init();
+	p->cache = calloc(AUTH_CACHE_SIZE, sizeof(*p->cache));
+	force_assert(NULL != p->cache);
 
 	p->auth_user = buffer_init();
 #ifdef USE_LDAP
@@ -50,6 +52,8 @@ FREE_FUNC(mod_auth_free) {
 	if (!p) return HANDLER_GO_ON;
 
 	buffer_free(p->tmp_buf);
+	http_auth_userfiles_free(p);
+	free(p->cache);
 	buffer_free(p->auth_user);
 #ifdef USE_LDAP
 	buffer_free(p->ldap_filter);
@@ -106,6 +110,7 @@ static int mod_auth_patch_connection(server *srv, connection *con, mod_auth_plug
 	PATCH(auth_htpasswd_userfile);
 	PATCH(auth_require);
 	PATCH(auth_debug);
+	PATCH(auth_cache_ttl);
 	PATCH(auth_ldap_hostname);
 	PATCH(auth_ldap_basedn);
 	PATCH(auth_ldap_binddn);
@@ -146,6 +151,8 @@ static int mod_auth_patch_connection(server *srv, connection *con, mod_auth_plug
 				PATCH(auth_require);
 			} else if (buffer_is_equal_string(du->key, CONST_STR_LEN("auth.debug"))) {
 				PATCH(auth_debug);
+			} else if (buffer_is_equal_string(du->key, CONST_STR_LEN("auth.cache-ttl"))) {
+				PATCH(auth_cache_ttl);
 			} else if (buffer_is_equal_string(du->key, CONST_STR_LEN("auth.backend.ldap.hostname"))) {
 				PATCH(auth_ldap_hostname);
 #ifdef USE_LDAP
@@ -361,6 +368,7 @@ SETDEFAULTS_FUNC(mod_auth_set_defaults) {
 		{ "auth.backend.htdigest.userfile", NULL, T_CONFIG_STRING, T_CONFIG_SCOPE_CONNECTION }, /* 12 */
 		{ "auth.backend.htpasswd.userfile", NULL, T_CONFIG_STRING, T_CONFIG_SCOPE_CONNECTION }, /* 13 */
 		{ "auth.debug",                     NULL, T_CONFIG_SHORT, T_CONFIG_SCOPE_CONNECTION },  /* 14 */
+		{ "auth.cache-ttl",                 NULL, T_CONFIG_SHORT, T_CONFIG_SCOPE_CONNECTION },  /* 15 */
 		{ NULL,                             NULL, T_CONFIG_UNSET, T_CONFIG_SCOPE_UNSET }
 	};
 
@@ -387,6 +395,7 @@ SETDEFAULTS_FUNC(mod_auth_set_defaults) {
 		s->auth_ldap_cafile = buffer_init();
 		s->auth_ldap_starttls = 0;
 		s->auth_debug = 0;
+		s->auth_cache_ttl = 60;
 
 		s->auth_require = array_init();
 
@@ -411,6 +420,7 @@ SETDEFAULTS_FUNC(mod_auth_set_defaults) {
 		cv[12].destination = s->auth_htdigest_userfile;
 		cv[13].destination = s->auth_htpasswd_userfile;
 		cv[14].destination = &(s->auth_debug);
+		cv[15].destination = &(s->auth_cache_ttl);
 
 		p->config_storage[i] = s;
 
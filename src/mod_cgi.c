@@ -68,6 +68,7 @@ typedef struct {
 
 	plugin_config **config_storage;
 
+	config_snapshots *snapshots;
 	plugin_config conf;
 } plugin_data;
 
@@ -83,21 +84,19 @@ typedef struct {
 	buffer *response_header;
 } handler_ctx;
 
-static handler_ctx * cgi_handler_ctx_init(void) {
+static handler_ctx * cgi_handler_ctx_init(connection *con) {
 	handler_ctx *hctx = calloc(1, sizeof(*hctx));
 
 	force_assert(hctx);
 
-	hctx->response = buffer_init();
-	hctx->response_header = buffer_init();
+	/* released with the request */
+	hctx->response = buffer_pool_get(con->request_buffers);
+	hctx->response_header = buffer_pool_get(con->request_buffers);
 
 	return hctx;
 }
 
 static void cgi_handler_ctx_free(handler_ctx *hctx) {
-	buffer_free(hctx->response);
-	buffer_free(hctx->response_header);
-
 	free(hctx);
 }
 
@@ -143,6 +142,8 @@ FREE_FUNC(mod_cgi_free) {
 	buffer_free(p->tmp_buf);
 	buffer_free(p->parse_response);
 
+	config_snapshots_free(p->snapshots);
+
 	free(p);
 
 	return HANDLER_GO_ON;
@@ -183,6 +184,8 @@ SETDEFAULTS_FUNC(mod_fastcgi_set_defaults) {
 		}
 	}
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 }
 
@@ -1137,7 +1140,11 @@ static int cgi_create_env(server *srv, connection *con, plugin_data *p, buffer *
 					break;
 
 				case MEM_CHUNK:
-					if ((r = write(to_cgi_fds[1], c->mem->ptr + c->offset, buffer_string_length(c->mem) - c->offset)) < 0) {
+				case SHARED_CHUNK: {
+					size_t len;
+					const char *data = chunk_mem_data(c, &len);
+
+					if ((r = write(to_cgi_fds[1], data, len)) < 0) {
 						switch(errno) {
 						case EAGAIN:
 						case EINTR:
@@ -1160,6 +1167,7 @@ static int cgi_create_env(server *srv, connection *con, plugin_data *p, buffer *
 					}
 					break;
 				}
+				}
 
 				switch (r) {
 				case -1:
@@ -1185,7 +1193,7 @@ static int cgi_create_env(server *srv, connection *con, plugin_data *p, buffer *
 		con->mode = p->id;
 		buffer_reset(con->physical.path);
 
-		hctx = cgi_handler_ctx_init();
+		hctx = cgi_handler_ctx_init(con);
 
 		hctx->remote_conn = con;
 		hctx->plugin_data = p;
@@ -1231,6 +1239,8 @@ static int mod_cgi_patch_connection(server *srv, connection *con, plugin_data *p
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH(cgi);
 	PATCH(execute_x_only);
 
@@ -1254,6 +1264,8 @@ static int mod_cgi_patch_connection(server *srv, connection *con, plugin_data *p
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 #undef PATCH
@@ -1284,6 +1296,9 @@ URIHANDLER_FUNC(cgi_is_handled) {
 		if (s_len < ct_len) continue;
 
 		if (0 == strncmp(fn->ptr + s_len - ct_len, ds->key->ptr, ct_len)) {
+			/* the CGI gets the request body in one go; wait until it is complete */
+			if (con->state == CON_STATE_READ_POST) return HANDLER_WAIT_FOR_EVENT;
+
 			if (cgi_create_env(srv, con, p, ds->value)) {
 				con->mode = DIRECT;
 				con->http_status = 500;
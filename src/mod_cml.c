@@ -64,6 +64,8 @@ FREE_FUNC(mod_cml_free) {
 	buffer_free(p->basedir);
 	buffer_free(p->baseurl);
 
+	config_snapshots_free(p->snapshots);
+
 	free(p);
 
 	return HANDLER_GO_ON;
@@ -135,6 +137,8 @@ SETDEFAULTS_FUNC(mod_cml_set_defaults) {
 		}
 	}
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 }
 
@@ -144,6 +148,8 @@ static int mod_cml_patch_connection(server *srv, connection *con, plugin_data *p
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH(ext);
 #if defined(HAVE_MEMCACHE_H)
 	PATCH(mc);
@@ -177,6 +183,8 @@ static int mod_cml_patch_connection(server *srv, connection *con, plugin_data *p
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 #undef PATCH
@@ -35,6 +35,7 @@ typedef struct {
 
 	plugin_config **config_storage;
 
+	config_snapshots *snapshots;
 	plugin_config conf;
 } plugin_data;
 
@@ -61,6 +61,7 @@ typedef struct {
 	buffer *b;
 
 	plugin_config **config_storage;
+	config_snapshots *snapshots;
 	plugin_config conf;
 } plugin_data;
 
@@ -100,6 +101,7 @@ FREE_FUNC(mod_compress_free) {
 		free(p->config_storage);
 	}
 
+	config_snapshots_free(p->snapshots);
 
 	free(p);
 
@@ -236,6 +238,8 @@ SETDEFAULTS_FUNC(mod_compress_setdefaults) {
 		}
 	}
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 
 }
@@ -669,6 +673,8 @@ static int mod_compress_patch_connection(server *srv, connection *con, plugin_da
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH(compress_cache_dir);
 	PATCH(compress);
 	PATCH(compress_max_filesize);
@@ -698,6 +704,8 @@ static int mod_compress_patch_connection(server *srv, connection *con, plugin_da
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 #undef PATCH
@@ -37,6 +37,7 @@
 typedef struct {
 #ifdef HAVE_PCRE_H
 	pcre *regex;
+	pcre_extra *regex_extra;
 #endif
 	buffer *string;
 } excludes;
@@ -74,6 +75,7 @@ typedef struct {
 
 	plugin_config **config_storage;
 
+	config_snapshots *snapshots;
 	plugin_config conf;
 } plugin_data;
 
@@ -118,6 +120,11 @@ static int excludes_buffer_append(excludes_buffer *exb, buffer *string) {
 		return -1;
 	}
 
+	if (NULL == (exb->ptr[exb->used]->regex_extra = pcre_keyvalue_study(exb->ptr[exb->used]->regex, &errptr)) &&
+			errptr != NULL) {
+		return -1;
+	}
+
 	exb->ptr[exb->used]->string = buffer_init();
 	buffer_copy_buffer(exb->ptr[exb->used]->string, string);
 
@@ -138,6 +145,7 @@ static void excludes_buffer_free(excludes_buffer *exb) {
 
 	for (i = 0; i < exb->size; i++) {
 		if (exb->ptr[i]->regex) pcre_free(exb->ptr[i]->regex);
+		if (exb->ptr[i]->regex_extra) pcre_keyvalue_study_free(exb->ptr[i]->regex_extra);
 		if (exb->ptr[i]->string) buffer_free(exb->ptr[i]->string);
 		free(exb->ptr[i]);
 	}
@@ -188,6 +196,8 @@ FREE_FUNC(mod_dirlisting_free) {
 	buffer_free(p->tmp_buf);
 	buffer_free(p->content_charset);
 
+	config_snapshots_free(p->snapshots);
+
 	free(p);
 
 	return HANDLER_GO_ON;
@@ -319,6 +329,8 @@ SETDEFAULTS_FUNC(mod_dirlisting_set_defaults) {
 		}
 	}
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 }
 
@@ -328,6 +340,8 @@ static int mod_dirlisting_patch_connection(server *srv, connection *con, plugin_
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH(dir_listing);
 	PATCH(external_css);
 	PATCH(hide_dot_files);
@@ -385,6 +399,8 @@ static int mod_dirlisting_patch_connection(server *srv, connection *con, plugin_
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 #undef PATCH
@@ -718,8 +734,9 @@ static int http_list_directory(server *srv, connection *con, plugin_data *p, buf
 #define N 10
 			int ovec[N * 3];
 			pcre *regex = p->conf.excludes->ptr[i]->regex;
+			pcre_extra *regex_extra = p->conf.excludes->ptr[i]->regex_extra;
 
-			if ((n = pcre_exec(regex, NULL, dent->d_name,
+			if ((n = pcre_exec(regex, regex_extra, dent->d_name,
 				    strlen(dent->d_name), 0, 0, ovec, 3 * N)) < 0) {
 				if (n != PCRE_ERROR_NOMATCH) {
 					log_error_write(srv, __FILE__, __LINE__, "sd",
@@ -20,6 +20,20 @@
  * - provide a white-list of ips/network which is not affected by the limit
  *   (hmm, conditionals might be enough)
  * - provide a bandwidth limiter per IP
+ * - limit the request rate per IP and per subnet (token bucket)
+ *
+ * Config example:
+ *
+ *       evasive.max-conns-per-ip        = 10  # requests served at the same time
+ *       evasive.max-requests-per-ip     = 20  # per second ...
+ *       evasive.burst-per-ip            = 100 # ... with a burst of 100
+ *       evasive.max-requests-per-subnet = 200
+ *       evasive.burst-per-subnet        = 1000
+ *       evasive.subnet-ipv4             = 24  # prefix length of a subnet
+ *       evasive.subnet-ipv6             = 64
+ *
+ * connections and buckets are accounted in a hash keyed by the binary
+ * address, so the checks don't depend on the number of connections.
  *
  * started by:
  * - w1zzard@techpowerup.com
@@ -28,13 +42,51 @@
 typedef struct {
 	unsigned short max_conns;
 	unsigned short silent;
+
+	unsigned short ip_rate;
+	unsigned short ip_burst;
+	unsigned short subnet_rate;
+	unsigned short subnet_burst;
+	unsigned short subnet_ipv4;
+	unsigned short subnet_ipv6;
 } plugin_config;
 
+/* a client address or a subnet */
+typedef struct evasive_entry {
+	struct evasive_entry *next;
+
+	unsigned char addr[16]; /* bits after the prefix are zero */
+	unsigned short family;
+	unsigned short prefix;  /* 32 / 128 for single addresses */
+	unsigned short subnet;  /* a subnet bucket, kept apart even for a /32 or /128 */
+	size_t hash;
+
+	size_t active;       /* requests in progress */
+	size_t tokens;       /* token bucket */
+	time_t last_refill;
+	time_t idle_until;   /* the bucket is full again */
+} evasive_entry;
+
+typedef struct {
+	evasive_entry **buckets;
+	size_t size;
+	size_t used;
+} evasive_table;
+
+typedef struct {
+	evasive_entry *ip; /* holds one of ip->active */
+	int rate_checked;
+} handler_ctx;
+
 typedef struct {
 	PLUGIN_DATA;
 
+	evasive_table clients;
+	time_t last_cleanup;
+
 	plugin_config **config_storage;
 
+	config_snapshots *snapshots;
 	plugin_config conf;
 } plugin_data;
 
@@ -43,6 +95,10 @@ INIT_FUNC(mod_evasive_init) {
 
 	p = calloc(1, sizeof(*p));
 
+	p->clients.size = 64;
+	p->clients.buckets = calloc(p->clients.size, sizeof(*p->clients.buckets));
+	force_assert(NULL != p->clients.buckets);
+
 	return p;
 }
 
@@ -65,6 +121,20 @@ FREE_FUNC(mod_evasive_free) {
 		free(p->config_storage);
 	}
 
+	if (p->clients.buckets) {
+		size_t i;
+		for (i = 0; i < p->clients.size; i++) {
+			evasive_entry *e, *next;
+			for (e = p->clients.buckets[i]; e; e = next) {
+				next = e->next;
+				free(e);
+			}
+		}
+		free(p->clients.buckets);
+	}
+
+	config_snapshots_free(p->snapshots);
+
 	free(p);
 
 	return HANDLER_GO_ON;
@@ -77,6 +147,12 @@ SETDEFAULTS_FUNC(mod_evasive_set_defaults) {
 	config_values_t cv[] = {
 		{ "evasive.max-conns-per-ip",    NULL, T_CONFIG_SHORT, T_CONFIG_SCOPE_CONNECTION },   /* 0 */
 		{ "evasive.silent",              NULL, T_CONFIG_BOOLEAN, T_CONFIG_SCOPE_CONNECTION }, /* 1 */
+		{ "evasive.max-requests-per-ip", NULL, T_CONFIG_SHORT, T_CONFIG_SCOPE_CONNECTION },   /* 2 */
+		{ "evasive.burst-per-ip",        NULL, T_CONFIG_SHORT, T_CONFIG_SCOPE_CONNECTION },   /* 3 */
+		{ "evasive.max-requests-per-subnet", NULL, T_CONFIG_SHORT, T_CONFIG_SCOPE_CONNECTION }, /* 4 */
+		{ "evasive.burst-per-subnet",    NULL, T_CONFIG_SHORT, T_CONFIG_SCOPE_CONNECTION },   /* 5 */
+		{ "evasive.subnet-ipv4",         NULL, T_CONFIG_SHORT, T_CONFIG_SCOPE_CONNECTION },   /* 6 */
+		{ "evasive.subnet-ipv6",         NULL, T_CONFIG_SHORT, T_CONFIG_SCOPE_CONNECTION },   /* 7 */
 		{ NULL,                          NULL, T_CONFIG_UNSET, T_CONFIG_SCOPE_UNSET }
 	};
 
@@ -89,17 +165,41 @@ SETDEFAULTS_FUNC(mod_evasive_set_defaults) {
 		s = calloc(1, sizeof(plugin_config));
 		s->max_conns       = 0;
 		s->silent          = 0;
+		s->ip_rate         = 0;
+		s->ip_burst        = 0;
+		s->subnet_rate     = 0;
+		s->subnet_burst    = 0;
+		s->subnet_ipv4     = 24;
+		s->subnet_ipv6     = 64;
 
 		cv[0].destination = &(s->max_conns);
 		cv[1].destination = &(s->silent);
+		cv[2].destination = &(s->ip_rate);
+		cv[3].destination = &(s->ip_burst);
+		cv[4].destination = &(s->subnet_rate);
+		cv[5].destination = &(s->subnet_burst);
+		cv[6].destination = &(s->subnet_ipv4);
+		cv[7].destination = &(s->subnet_ipv6);
 
 		p->config_storage[i] = s;
 
 		if (0 != config_insert_values_global(srv, config->value, cv, i == 0 ? T_CONFIG_SCOPE_SERVER : T_CONFIG_SCOPE_CONNECTION)) {
 			return HANDLER_ERROR;
 		}
+
+		if (s->subnet_ipv4 > 32 || s->subnet_ipv6 > 128) {
+			log_error_write(srv, __FILE__, __LINE__, "s",
+					"evasive.subnet-ipv4 has to be <= 32 and evasive.subnet-ipv6 <= 128");
+			return HANDLER_ERROR;
+		}
+
+		/* without a burst the bucket holds one second worth of requests */
+		if (0 == s->ip_burst) s->ip_burst = s->ip_rate;
+		if (0 == s->subnet_burst) s->subnet_burst = s->subnet_rate;
 	}
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 }
 
@@ -109,8 +209,16 @@ static int mod_evasive_patch_connection(server *srv, connection *con, plugin_dat
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH(max_conns);
 	PATCH(silent);
+	PATCH(ip_rate);
+	PATCH(ip_burst);
+	PATCH(subnet_rate);
+	PATCH(subnet_burst);
+	PATCH(subnet_ipv4);
+	PATCH(subnet_ipv6);
 
 	/* skip the first, the global context */
 	for (i = 1; i < srv->config_context->used; i++) {
@@ -128,25 +236,176 @@ static int mod_evasive_patch_connection(server *srv, connection *con, plugin_dat
 				PATCH(max_conns);
 			} else if (buffer_is_equal_string(du->key, CONST_STR_LEN("evasive.silent"))) {
 				PATCH(silent);
+			} else if (buffer_is_equal_string(du->key, CONST_STR_LEN("evasive.max-requests-per-ip"))) {
+				PATCH(ip_rate);
+				PATCH(ip_burst);
+			} else if (buffer_is_equal_string(du->key, CONST_STR_LEN("evasive.burst-per-ip"))) {
+				PATCH(ip_burst);
+			} else if (buffer_is_equal_string(du->key, CONST_STR_LEN("evasive.max-requests-per-subnet"))) {
+				PATCH(subnet_rate);
+				PATCH(subnet_burst);
+			} else if (buffer_is_equal_string(du->key, CONST_STR_LEN("evasive.burst-per-subnet"))) {
+				PATCH(subnet_burst);
+			} else if (buffer_is_equal_string(du->key, CONST_STR_LEN("evasive.subnet-ipv4"))) {
+				PATCH(subnet_ipv4);
+			} else if (buffer_is_equal_string(du->key, CONST_STR_LEN("evasive.subnet-ipv6"))) {
+				PATCH(subnet_ipv6);
 			}
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 #undef PATCH
 
+static size_t evasive_hash(const unsigned char *addr, unsigned short prefix, unsigned short subnet) {
+	size_t i, h = 5381 ^ prefix ^ (subnet << 8);
+
+	for (i = 0; i < 16; i++) {
+		h = (h * 33) ^ addr[i];
+	}
+
+	return h;
+}
+
+static void evasive_table_grow(evasive_table *t) {
+	size_t i, size = t->size * 2;
+	evasive_entry **buckets = calloc(size, sizeof(*buckets));
+
+	force_assert(NULL != buckets);
+
+	for (i = 0; i < t->size; i++) {
+		evasive_entry *e, *next;
+		for (e = t->buckets[i]; e; e = next) {
+			next = e->next;
+			e->next = buckets[e->hash % size];
+			buckets[e->hash % size] = e;
+		}
+	}
+
+	free(t->buckets);
+	t->buckets = buckets;
+	t->size = size;
+}
+
+/* the entry for the first prefix bits of the client address; the subnet
+ * buckets are separate from the per-IP entry for every prefix length */
+static evasive_entry *evasive_table_get(evasive_table *t, const sock_addr *addr, unsigned short prefix, unsigned short subnet, time_t now) {
+	unsigned char key[16];
+	unsigned short family = addr->plain.sa_family;
+	evasive_entry *e;
+	size_t h, i;
+
+	memset(key, 0, sizeof(key));
+	switch (family) {
+	case AF_INET:
+		memcpy(key, &(addr->ipv4.sin_addr.s_addr), 4);
+		if (prefix > 32) prefix = 32;
+		break;
+#ifdef HAVE_IPV6
+	case AF_INET6:
+		memcpy(key, addr->ipv6.sin6_addr.s6_addr, 16);
+		if (prefix > 128) prefix = 128;
+		break;
+#endif
+	default:
+		return NULL;
+	}
+
+	/* clear the host part */
+	for (i = prefix; i < 128; i++) {
+		key[i / 8] &= ~(0x80 >> (i % 8));
+	}
+
+	h = evasive_hash(key, prefix, subnet) ^ family;
+
+	for (e = t->buckets[h % t->size]; e; e = e->next) {
+		if (e->hash == h && e->family == family && e->prefix == prefix && e->subnet == subnet && 0 == memcmp(e->addr, key, 16)) return e;
+	}
+
+	if (t->used >= t->size) evasive_table_grow(t);
+
+	e = calloc(1, sizeof(*e));
+	force_assert(NULL != e);
+	memcpy(e->addr, key, 16);
+	e->family = family;
+	e->prefix = prefix;
+	e->subnet = subnet;
+	e->hash = h;
+	e->tokens = (size_t)-1; /* full, see evasive_take_token() */
+	e->last_refill = now;
+	e->idle_until = now;
+
+	e->next = t->buckets[h % t->size];
+	t->buckets[h % t->size] = e;
+	t->used++;
+
+	return e;
+}
+
+/* returns 0 if the bucket is empty */
+static int evasive_take_token(evasive_entry *e, unsigned short rate, unsigned short burst, time_t now) {
+	if (now > e->last_refill) {
+		size_t refill = (size_t)(now - e->last_refill) * rate;
+		e->tokens = (e->tokens + refill < e->tokens) ? (size_t)-1 : e->tokens + refill;
+	}
+	e->last_refill = now;
+	if (e->tokens > burst) e->tokens = burst;
+
+	if (0 == e->tokens) return 0;
+
+	e->tokens--;
+	/* the entry can be dropped once the bucket would be full again */
+	e->idle_until = now + (time_t)((burst - e->tokens + rate - 1) / rate);
+
+	return 1;
+}
+
+/* drop entries which neither count requests nor hold a partly used bucket */
+static void evasive_table_cleanup(evasive_table *t, time_t now) {
+	size_t i;
+
+	for (i = 0; i < t->size; i++) {
+		evasive_entry **pe = &t->buckets[i];
+
+		while (*pe) {
+			evasive_entry *e = *pe;
+
+			if (0 == e->active && e->idle_until <= now) {
+				*pe = e->next;
+				free(e);
+				t->used--;
+			} else {
+				pe = &e->next;
+			}
+		}
+	}
+}
+
+static void evasive_release(plugin_data *p, connection *con) {
+	handler_ctx *hctx = con->plugin_ctx[p->id];
+
+	if (NULL == hctx) return;
+
+	if (NULL != hctx->ip) hctx->ip->active--;
+
+	free(hctx);
+	con->plugin_ctx[p->id] = NULL;
+}
+
 URIHANDLER_FUNC(mod_evasive_uri_handler) {
 	plugin_data *p = p_d;
-	size_t conns_by_ip = 0;
-	size_t j;
+	handler_ctx *hctx;
+	evasive_entry *e;
 
 	if (buffer_is_empty(con->uri.path)) return HANDLER_GO_ON;
 
 	mod_evasive_patch_connection(srv, con, p);
 
 	/* no limit set, nothing to block */
-	if (p->conf.max_conns == 0) return HANDLER_GO_ON;
+	if (p->conf.max_conns == 0 && p->conf.ip_rate == 0 && p->conf.subnet_rate == 0) return HANDLER_GO_ON;
 
 	switch (con->dst_addr.plain.sa_family) {
 		case AF_INET:
@@ -158,30 +417,19 @@ URIHANDLER_FUNC(mod_evasive_uri_handler) {
 			return HANDLER_GO_ON;
 	};
 
-	for (j = 0; j < srv->conns->used; j++) {
-		connection *c = srv->conns->ptr[j];
-
-		/* check if other connections are already actively serving data for the same IP
-		 * we can only ban connections which are already behind the 'read request' state
-		 * */
-		if (c->dst_addr.plain.sa_family != con->dst_addr.plain.sa_family) continue;
-		if (c->state <= CON_STATE_REQUEST_END) continue;
+	/* the uri handlers run again after a rewrite, account each request once */
+	if (NULL == (hctx = con->plugin_ctx[p->id])) {
+		hctx = calloc(1, sizeof(*hctx));
+		force_assert(NULL != hctx);
+		con->plugin_ctx[p->id] = hctx;
+	}
 
-		switch (con->dst_addr.plain.sa_family) {
-			case AF_INET:
-				if (c->dst_addr.ipv4.sin_addr.s_addr != con->dst_addr.ipv4.sin_addr.s_addr) continue;
-				break;
-#ifdef HAVE_IPV6
-			case AF_INET6:
-				if (0 != memcmp(c->dst_addr.ipv6.sin6_addr.s6_addr, con->dst_addr.ipv6.sin6_addr.s6_addr, 16)) continue;
-				break;
-#endif
-			default: /* Address family not supported, should never be reached */
-				continue;
-		};
-		conns_by_ip++;
+	if (p->conf.max_conns > 0 && NULL == hctx->ip) {
+		/* the requests which are already behind the 'read request' state */
+		hctx->ip = evasive_table_get(&p->clients, &(con->dst_addr), 128, 0, srv->cur_ts);
+		hctx->ip->active++;
 
-		if (conns_by_ip > p->conf.max_conns) {
+		if (hctx->ip->active > p->conf.max_conns) {
 			if (!p->conf.silent) {
 				log_error_write(srv, __FILE__, __LINE__, "ss",
 					inet_ntop_cache_get_ip(srv, &(con->dst_addr)),
@@ -194,6 +442,65 @@ URIHANDLER_FUNC(mod_evasive_uri_handler) {
 		}
 	}
 
+	if (hctx->rate_checked) return HANDLER_GO_ON;
+	hctx->rate_checked = 1;
+
+	if (p->conf.ip_rate > 0) {
+		e = evasive_table_get(&p->clients, &(con->dst_addr), 128, 0, srv->cur_ts);
+
+		if (!evasive_take_token(e, p->conf.ip_rate, p->conf.ip_burst, srv->cur_ts)) {
+			if (!p->conf.silent) {
+				log_error_write(srv, __FILE__, __LINE__, "ss",
+					inet_ntop_cache_get_ip(srv, &(con->dst_addr)),
+					"turned away. Too many requests.");
+			}
+
+			con->http_status = 429;
+			con->mode = DIRECT;
+			return HANDLER_FINISHED;
+		}
+	}
+
+	if (p->conf.subnet_rate > 0) {
+		e = evasive_table_get(&p->clients, &(con->dst_addr),
+			AF_INET == con->dst_addr.plain.sa_family ? p->conf.subnet_ipv4 : p->conf.subnet_ipv6,
+			1, srv->cur_ts);
+
+		if (!evasive_take_token(e, p->conf.subnet_rate, p->conf.subnet_burst, srv->cur_ts)) {
+			if (!p->conf.silent) {
+				log_error_write(srv, __FILE__, __LINE__, "ss",
+					inet_ntop_cache_get_ip(srv, &(con->dst_addr)),
+					"turned away. Too many requests from its subnet.");
+			}
+
+			con->http_status = 429;
+			con->mode = DIRECT;
+			return HANDLER_FINISHED;
+		}
+	}
+
+	return HANDLER_GO_ON;
+}
+
+CONNECTION_FUNC(mod_evasive_request_done) {
+	plugin_data *p = p_d;
+
+	UNUSED(srv);
+
+	evasive_release(p, con);
+
+	return HANDLER_GO_ON;
+}
+
+TRIGGER_FUNC(mod_evasive_trigger) {
+	plugin_data *p = p_d;
+
+	/* idle entries can wait a few seconds */
+	if (srv->cur_ts - p->last_cleanup < 16) return HANDLER_GO_ON;
+	p->last_cleanup = srv->cur_ts;
+
+	evasive_table_cleanup(&p->clients, srv->cur_ts);
+
 	return HANDLER_GO_ON;
 }
 
@@ -206,6 +513,9 @@ int mod_evasive_plugin_init(plugin *p) {
 	p->init        = mod_evasive_init;
 	p->set_defaults = mod_evasive_set_defaults;
 	p->handle_uri_clean  = mod_evasive_uri_handler;
+	p->handle_request_done = mod_evasive_request_done;
+	p->connection_reset = mod_evasive_request_done;
+	p->handle_trigger = mod_evasive_trigger;
 	p->cleanup     = mod_evasive_free;
 
 	p->data        = NULL;
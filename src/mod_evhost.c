@@ -21,6 +21,7 @@ typedef struct {
 	buffer *tmp_buf;
 
 	plugin_config **config_storage;
+	config_snapshots *snapshots;
 	plugin_config conf;
 } plugin_data;
 
@@ -66,6 +67,8 @@ FREE_FUNC(mod_evhost_free) {
 
 	buffer_free(p->tmp_buf);
 
+	config_snapshots_free(p->snapshots);
+
 	free(p);
 
 	return HANDLER_GO_ON;
@@ -152,6 +155,8 @@ SETDEFAULTS_FUNC(mod_evhost_set_defaults) {
 		}
 	}
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 }
 
@@ -229,6 +234,8 @@ static int mod_evhost_patch_connection(server *srv, connection *con, plugin_data
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH(path_pieces);
 	PATCH(len);
 
@@ -251,6 +258,8 @@ static int mod_evhost_patch_connection(server *srv, connection *con, plugin_data
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 #undef PATCH
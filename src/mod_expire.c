@@ -32,6 +32,7 @@ typedef struct {
 
 	plugin_config **config_storage;
 
+	config_snapshots *snapshots;
 	plugin_config conf;
 } plugin_data;
 
@@ -71,6 +72,8 @@ FREE_FUNC(mod_expire_free) {
 		free(p->config_storage);
 	}
 
+	config_snapshots_free(p->snapshots);
+
 	free(p);
 
 	return HANDLER_GO_ON;
@@ -251,6 +254,7 @@ SETDEFAULTS_FUNC(mod_expire_set_defaults) {
 		}
 	}
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
 
 	return HANDLER_GO_ON;
 }
@@ -261,6 +265,8 @@ static int mod_expire_patch_connection(server *srv, connection *con, plugin_data
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH(expire_url);
 
 	/* skip the first, the global context */
@@ -281,6 +287,8 @@ static int mod_expire_patch_connection(server *srv, connection *con, plugin_data
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 #undef PATCH
@@ -6,6 +6,7 @@
 
 #include "inet_ntop_cache.h"
 #include "configfile.h"
+#include "cidr.h"
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -17,6 +18,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <netinet/in.h>
+#include <arpa/inet.h>
 #include <errno.h>
 
 /**
@@ -30,6 +32,10 @@
  *       extforward.forwarder = ( "10.0.0.232" => "trust",
  *                                "10.0.0.233" => "trust" )
  *
+ *       Trust whole networks
+ *       extforward.forwarder = ( "10.0.0.0/24" => "trust",
+ *                                "2001:db8::/32" => "trust" )
+ *
  *       Trust all proxies  (NOT RECOMMENDED!)
  *       extforward.forwarder = ( "all" => "trust")
  *
@@ -83,13 +89,20 @@
 typedef struct {
 	array *forwarder;
 	array *headers;
+
+	/* built from forwarder */
+	cidr_tree *forward_trusted;
+	int forward_all; /* "all": -1 unset, 1 trust, 0 don't trust */
 } plugin_config;
 
 typedef struct {
 	PLUGIN_DATA;
 
+	buffer *tmp_buf;
+
 	plugin_config **config_storage;
 
+	config_snapshots *snapshots;
 	plugin_config conf;
 } plugin_data;
 
@@ -118,6 +131,7 @@ static void handler_ctx_free(handler_ctx *hctx) {
 INIT_FUNC(mod_extforward_init) {
 	plugin_data *p;
 	p = calloc(1, sizeof(*p));
+	p->tmp_buf = buffer_init();
 	return p;
 }
 
@@ -139,12 +153,16 @@ FREE_FUNC(mod_extforward_free) {
 
 			array_free(s->forwarder);
 			array_free(s->headers);
+			cidr_tree_free(s->forward_trusted);
 
 			free(s);
 		}
 		free(p->config_storage);
 	}
 
+	config_snapshots_free(p->snapshots);
+
+	buffer_free(p->tmp_buf);
 
 	free(p);
 
@@ -155,7 +173,7 @@ FREE_FUNC(mod_extforward_free) {
 
 SETDEFAULTS_FUNC(mod_extforward_set_defaults) {
 	plugin_data *p = p_d;
-	size_t i = 0;
+	size_t i = 0, j;
 
 	config_values_t cv[] = {
 		{ "extforward.forwarder",       NULL, T_CONFIG_ARRAY, T_CONFIG_SCOPE_CONNECTION },       /* 0 */
@@ -183,8 +201,26 @@ SETDEFAULTS_FUNC(mod_extforward_set_defaults) {
 		if (0 != config_insert_values_global(srv, config->value, cv, i == 0 ? T_CONFIG_SCOPE_SERVER : T_CONFIG_SCOPE_CONNECTION)) {
 			return HANDLER_ERROR;
 		}
+
+		/* addresses and networks of trusted proxies */
+		s->forward_trusted = cidr_tree_init();
+		s->forward_all = -1;
+
+		for (j = 0; j < s->forwarder->used; j++) {
+			data_string *ds = (data_string *)s->forwarder->data[j];
+
+			if (buffer_is_equal_caseless_string(ds->key, CONST_STR_LEN("all"))) {
+				s->forward_all = (0 == strcasecmp(ds->value->ptr, "trust")) ? 1 : 0;
+			} else if (0 != cidr_tree_insert(s->forward_trusted, CONST_BUF_LEN(ds->key))) {
+				log_error_write(srv, __FILE__, __LINE__, "sb",
+						"extforward.forwarder: invalid address or network:", ds->key);
+				return HANDLER_ERROR;
+			}
+		}
 	}
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 }
 
@@ -194,7 +230,11 @@ static int mod_extforward_patch_connection(server *srv, connection *con, plugin_
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH(forwarder);
+	PATCH(forward_trusted);
+	PATCH(forward_all);
 	PATCH(headers);
 
 	/* skip the first, the global context */
@@ -211,146 +251,89 @@ static int mod_extforward_patch_connection(server *srv, connection *con, plugin_
 
 			if (buffer_is_equal_string(du->key, CONST_STR_LEN("extforward.forwarder"))) {
 				PATCH(forwarder);
+				PATCH(forward_trusted);
+				PATCH(forward_all);
 			} else if (buffer_is_equal_string(du->key, CONST_STR_LEN("extforward.headers"))) {
 				PATCH(headers);
 			}
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 #undef PATCH
 
 
-static void put_string_into_array_len(array *ary, const char *str, int len)
-{
-	data_string *tempdata;
-	if (len == 0)
-		return;
-	tempdata = data_string_init();
-	buffer_copy_string_len(tempdata->value,str,len);
-	array_insert_unique(ary,(data_unset *)tempdata);
-}
-/*
-   extract a forward array from the environment
-*/
-static array *extract_forward_array(buffer *pbuffer)
-{
-	array *result = array_init();
-	if (!buffer_string_is_empty(pbuffer)) {
-		char *base, *curr;
-		/* state variable, 0 means not in string, 1 means in string */
-		int in_str = 0;
-		for (base = pbuffer->ptr, curr = pbuffer->ptr; *curr; curr++) {
-			if (in_str) {
-				if ((*curr > '9' || *curr < '0') && *curr != '.' && *curr != ':' && (*curr < 'a' || *curr > 'f') && (*curr < 'A' || *curr > 'F')) {
-					/* found an separator , insert value into result array */
-					put_string_into_array_len(result, base, curr - base);
-					/* change state to not in string */
-					in_str = 0;
-				}
-			} else {
-				if ((*curr >= '0' && *curr <= '9') || *curr == ':' || (*curr >= 'a' && *curr <= 'f') || (*curr >= 'A' && *curr <= 'F')) {
-					/* found leading char of an IP address, move base pointer and change state */
-					base = curr;
-					in_str = 1;
-				}
-			}
-		}
-		/* if breaking out while in str, we got to the end of string, so add it */
-		if (in_str) {
-			put_string_into_array_len(result, base, curr - base);
-		}
-	}
-	return result;
-}
-
 #define IP_TRUSTED 1
 #define IP_UNTRUSTED 0
 /*
- * check whether ip is trusted, return 1 for trusted , 0 for untrusted
+ * check whether the connecting ip is trusted, return 1 for trusted , 0 for untrusted
  */
-static int is_proxy_trusted(const char *ipstr, plugin_data *p)
+static int is_proxy_trusted(const sock_addr *addr, plugin_data *p)
 {
-	data_string* allds = (data_string *)array_get_element(p->conf.forwarder, "all");
+	if (-1 != p->conf.forward_all) {
+		return p->conf.forward_all ? IP_TRUSTED : IP_UNTRUSTED;
+	}
 
-	if (allds) {
-		if (strcasecmp(allds->value->ptr, "trust") == 0) {
-			return IP_TRUSTED;
-		} else {
-			return IP_UNTRUSTED;
-		}
+	return cidr_tree_match(p->conf.forward_trusted, addr) ? IP_TRUSTED : IP_UNTRUSTED;
+}
+
+static int is_forward_char(char c) {
+	return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F') || c == '.' || c == ':';
+}
+
+static int ipstr_to_sockaddr(const char *host, sock_addr *sock) {
+	memset(sock, 0, sizeof(*sock));
+
+	if (1 == inet_pton(AF_INET, host, &sock->ipv4.sin_addr)) {
+		sock->plain.sa_family = AF_INET;
+		return 0;
 	}
+#ifdef HAVE_IPV6
+	if (1 == inet_pton(AF_INET6, host, &sock->ipv6.sin6_addr)) {
+		sock->plain.sa_family = AF_INET6;
+		return 0;
+	}
+#endif
 
-	return (data_string *)array_get_element(p->conf.forwarder, ipstr) ? IP_TRUSTED : IP_UNTRUSTED;
+	sock->plain.sa_family = AF_UNSPEC;
+	return -1;
 }
 
 /*
- * Return char *ip of last address of proxy that is not trusted.
+ * walk the forward header from right to left (the address added by the
+ * proxy closest to us comes last) and copy the first address which is
+ * not a trusted proxy into ip, parsed into sock.
  * Do not accept "all" keyword here.
+ *
+ * returns 0 if no such address was found
  */
-static const char *last_not_in_array(array *a, plugin_data *p)
+static int last_not_trusted(const buffer *forwarded, plugin_data *p, buffer *ip, sock_addr *sock)
 {
-	array *forwarder = p->conf.forwarder;
-	int i;
+	const char *s = forwarded->ptr;
+	size_t i = buffer_string_length(forwarded);
 
-	for (i = a->used - 1; i >= 0; i--) {
-		data_string *ds = (data_string *)a->data[i];
-		const char *ip = ds->value->ptr;
+	while (i > 0) {
+		size_t start, end;
 
-		if (!array_get_element(forwarder, ip)) {
-			return ip;
-		}
-	}
-	return NULL;
-}
+		while (i > 0 && !is_forward_char(s[i-1])) i--;
+		end = i;
+		while (i > 0 && is_forward_char(s[i-1])) i--;
+		/* an address doesn't start with '.' */
+		for (start = i; start < end && s[start] == '.'; start++) ;
 
-#ifdef HAVE_IPV6
-static void ipstr_to_sockaddr(server *srv, const char *host, sock_addr *sock) {
-	struct addrinfo hints, *addrlist = NULL;
-	int result;
+		if (start == end) continue;
 
-	memset(&hints, 0, sizeof(hints));
-	sock->plain.sa_family = AF_UNSPEC;
+		buffer_copy_string_len(ip, s + start, end - start);
 
-#ifndef AI_NUMERICSERV
-	/**
-	  * quoting $ man getaddrinfo
-	  *
-	  * NOTES
-	  *        AI_ADDRCONFIG, AI_ALL, and AI_V4MAPPED are available since glibc 2.3.3.
-	  *        AI_NUMERICSERV is available since glibc 2.3.4.
-	  */
-#define AI_NUMERICSERV 0
-#endif
-	hints.ai_flags = AI_NUMERICHOST | AI_NUMERICSERV;
-
-	errno = 0;
-	result = getaddrinfo(host, NULL, &hints, &addrlist);
-
-	if (result != 0) {
-		log_error_write(srv, __FILE__, __LINE__, "SSSs(S)",
-			"could not parse ip address ", host, " because ", gai_strerror(result), strerror(errno));
-	} else if (addrlist == NULL) {
-		log_error_write(srv, __FILE__, __LINE__, "SSS",
-			"Problem in parsing ip address ", host, ": succeeded, but no information returned");
-	} else switch (addrlist->ai_family) {
-	case AF_INET:
-		memcpy(&sock->ipv4, addrlist->ai_addr, sizeof(sock->ipv4));
-		force_assert(AF_INET == sock->plain.sa_family);
-		break;
-	case AF_INET6:
-		memcpy(&sock->ipv6, addrlist->ai_addr, sizeof(sock->ipv6));
-		force_assert(AF_INET6 == sock->plain.sa_family);
-		break;
-	default:
-		log_error_write(srv, __FILE__, __LINE__, "SSS",
-			"Problem in parsing ip address ", host, ": succeeded, but unknown family");
+		if (0 != ipstr_to_sockaddr(ip->ptr, sock)) return 1;
+		if (!cidr_tree_match(p->conf.forward_trusted, sock)) return 1;
 	}
 
-	freeaddrinfo(addrlist);
+	return 0;
 }
-#endif
 
 static void clean_cond_cache(server *srv, connection *con) {
 	config_cond_cache_reset_item(srv, con, COMP_HTTP_REMOTE_IP);
@@ -359,14 +342,7 @@ static void clean_cond_cache(server *srv, connection *con) {
 URIHANDLER_FUNC(mod_extforward_uri_handler) {
 	plugin_data *p = p_d;
 	data_string *forwarded = NULL;
-#ifdef HAVE_IPV6
-	char b2[INET6_ADDRSTRLEN + 1];
-#endif
-	const char *dst_addr_str = NULL;
-	array *forward_array = NULL;
-	const char *real_remote_addr = NULL;
-#ifdef HAVE_IPV6
-#endif
+	sock_addr sock;
 
 	if (!con->request.headers) return HANDLER_GO_ON;
 
@@ -398,32 +374,17 @@ URIHANDLER_FUNC(mod_extforward_uri_handler) {
 		return HANDLER_GO_ON;
 	}
 
-#ifdef HAVE_IPV6
-	dst_addr_str = inet_ntop(con->dst_addr.plain.sa_family,
-		con->dst_addr.plain.sa_family == AF_INET6 ?
-			(struct sockaddr *)&(con->dst_addr.ipv6.sin6_addr) :
-			(struct sockaddr *)&(con->dst_addr.ipv4.sin_addr),
-		b2, (sizeof b2) - 1);
-#else
-	dst_addr_str = inet_ntoa(con->dst_addr.ipv4.sin_addr);
-#endif
-
 	/* if the remote ip itself is not trusted, then do nothing */
-	if (IP_UNTRUSTED == is_proxy_trusted(dst_addr_str, p)) {
+	if (IP_UNTRUSTED == is_proxy_trusted(&(con->dst_addr), p)) {
 		if (con->conf.log_request_handling) {
-			log_error_write(srv, __FILE__, __LINE__, "sss",
-					"remote address", dst_addr_str, "is NOT a trusted proxy, skipping");
+			log_error_write(srv, __FILE__, __LINE__, "sbs",
+					"remote address", con->dst_addr_buf, "is NOT a trusted proxy, skipping");
 		}
 
 		return HANDLER_GO_ON;
 	}
 
-	/* build forward_array from forwarded data_string */
-	forward_array = extract_forward_array(forwarded->value);
-	real_remote_addr = last_not_in_array(forward_array, p);
-
-	if (real_remote_addr != NULL) { /* parsed */
-		sock_addr sock;
+	if (last_not_trusted(forwarded->value, p, p->tmp_buf, &sock)) { /* parsed */
 		data_string *forwarded_proto = (data_string *)array_get_element(con->request.headers, "X-Forwarded-Proto");
 
 		if (NULL != forwarded_proto) {
@@ -435,15 +396,13 @@ URIHANDLER_FUNC(mod_extforward_uri_handler) {
 		}
 
 		if (con->conf.log_request_handling) {
-			log_error_write(srv, __FILE__, __LINE__, "ss", "using address:", real_remote_addr);
+			log_error_write(srv, __FILE__, __LINE__, "sb", "using address:", p->tmp_buf);
 		}
-#ifdef HAVE_IPV6
-		ipstr_to_sockaddr(srv, real_remote_addr, &sock);
-#else
-		sock.ipv4.sin_addr.s_addr = inet_addr(real_remote_addr);
-		sock.plain.sa_family = (sock.ipv4.sin_addr.s_addr == 0xFFFFFFFF) ? AF_UNSPEC : AF_INET;
-#endif
-		if (sock.plain.sa_family != AF_UNSPEC) {
+
+		if (sock.plain.sa_family == AF_UNSPEC) {
+			log_error_write(srv, __FILE__, __LINE__, "SB",
+				"could not parse ip address ", p->tmp_buf);
+		} else {
 			/* we found the remote address, modify current connection and save the old address */
 			if (con->plugin_ctx[p->id]) {
 				if (con->conf.log_request_handling) {
@@ -458,17 +417,16 @@ URIHANDLER_FUNC(mod_extforward_uri_handler) {
 			/* patch connection address */
 			con->dst_addr = sock;
 			con->dst_addr_buf = buffer_init();
-			buffer_copy_string(con->dst_addr_buf, real_remote_addr);
+			buffer_copy_buffer(con->dst_addr_buf, p->tmp_buf);
 
 			if (con->conf.log_request_handling) {
-				log_error_write(srv, __FILE__, __LINE__, "ss",
-						"patching con->dst_addr_buf for the accesslog:", real_remote_addr);
+				log_error_write(srv, __FILE__, __LINE__, "sb",
+						"patching con->dst_addr_buf for the accesslog:", p->tmp_buf);
 			}
 			/* Now, clean the conf_cond cache, because we may have changed the results of tests */
 			clean_cond_cache(srv, con);
 		}
 	}
-	array_free(forward_array);
 
 	/* not found */
 	return HANDLER_GO_ON;
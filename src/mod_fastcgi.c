@@ -316,6 +316,7 @@ typedef struct {
 
 	plugin_config **config_storage;
 
+	config_snapshots *snapshots;
 	plugin_config conf; /* this is only used as long as no handler_ctx is setup */
 } plugin_data;
 
@@ -352,6 +353,7 @@ typedef struct {
 	int       got_proc;
 
 	int       send_content_body;
+	int       stdin_closed; /* the empty FCGI_STDIN record has been queued */
 
 	plugin_config conf;
 
@@ -475,7 +477,7 @@ static int fastcgi_status_init(server *srv, buffer *b, fcgi_extension_host *host
 	return 0;
 }
 
-static handler_ctx * handler_ctx_init(void) {
+static handler_ctx * handler_ctx_init(connection *con) {
 	handler_ctx * hctx;
 
 	hctx = calloc(1, sizeof(*hctx));
@@ -483,7 +485,7 @@ static handler_ctx * handler_ctx_init(void) {
 
 	hctx->fde_ndx = -1;
 
-	hctx->response_header = buffer_init();
+	hctx->response_header = buffer_pool_get(con->request_buffers);
 
 	hctx->request_id = 0;
 	hctx->state = FCGI_STATE_INIT;
@@ -505,8 +507,6 @@ static void handler_ctx_free(server *srv, handler_ctx *hctx) {
 		fcgi_host_reset(srv, hctx);
 	}
 
-	buffer_free(hctx->response_header);
-
 	chunkqueue_free(hctx->rb);
 	chunkqueue_free(hctx->wb);
 
@@ -739,6 +739,8 @@ FREE_FUNC(mod_fastcgi_free) {
 		free(p->config_storage);
 	}
 
+	config_snapshots_free(p->snapshots);
+
 	free(p);
 
 	return HANDLER_GO_ON;
@@ -1453,6 +1455,9 @@ SETDEFAULTS_FUNC(mod_fastcgi_set_defaults) {
 	}
 
 	buffer_free(fcgi_mode);
+
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 
 error:
@@ -1538,6 +1543,7 @@ static int fcgi_reconnect(server *srv, handler_ctx *hctx) {
 	fcgi_set_state(srv, hctx, FCGI_STATE_INIT);
 
 	hctx->request_id = 0;
+	hctx->stdin_closed = 0;
 	hctx->reconnects++;
 
 	if (p->conf.debug > 2) {
@@ -1795,6 +1801,65 @@ static int fcgi_env_add_request_headers(server *srv, connection *con, plugin_dat
 	return 0;
 }
 
+/* wrap the request body received so far into FCGI_STDIN records
+ *
+ * with server.stream-request-body the body might still be arriving;
+ * STDIN is only terminated once the connection has left CON_STATE_READ_POST
+ */
+static void fcgi_stdin_append(server *srv, handler_ctx *hctx, size_t request_id) {
+	FCGI_Header header;
+	plugin_data *p = hctx->plugin_data;
+	connection *con = hctx->remote_conn;
+	chunkqueue *req_cq = con->request_content_queue;
+	off_t len;
+
+	if (hctx->stdin_closed) return;
+
+	/* the authorizer doesn't get CONTENT_LENGTH, keep the body for the responder */
+	if (hctx->host->mode != FCGI_AUTHORIZER) {
+		len = req_cq->bytes_in - req_cq->bytes_out;
+
+		if (1 == con->request_body_streaming) {
+			/* the body is in memory: take only what the backend can swallow */
+			off_t room = MAX_REQUEST_BODY_STREAM_BUFFER - chunkqueue_length(hctx->wb);
+
+			if (len > room) len = room > 0 ? room : 0;
+
+			if (len > 0 && chunkqueue_length(req_cq) > MAX_REQUEST_BODY_STREAM_BUFFER) {
+				/* the core stopped reading from the client, wake it up */
+				joblist_append(srv, con);
+			}
+		}
+
+		for (; len > 0; ) {
+			off_t weWant = len > FCGI_MAX_LENGTH ? FCGI_MAX_LENGTH : len;
+
+			/* we announce toWrite octets
+			 * now take all the request_content chunks that we need to fill this request
+			 * */
+
+			fcgi_header(&(header), FCGI_STDIN, request_id, weWant, 0);
+			chunkqueue_append_mem(hctx->wb, (const char *)&header, sizeof(header));
+
+			if (p->conf.debug > 10) {
+				log_error_write(srv, __FILE__, __LINE__, "soso", "tosend:", req_cq->bytes_out, "/", (off_t)con->request.content_length);
+			}
+
+			chunkqueue_steal(hctx->wb, req_cq, weWant);
+
+			len -= weWant;
+		}
+
+		if (con->state == CON_STATE_READ_POST) return;
+		if (req_cq->bytes_out != req_cq->bytes_in) return;
+	}
+
+	/* terminate STDIN */
+	fcgi_header(&(header), FCGI_STDIN, request_id, 0, 0);
+	chunkqueue_append_mem(hctx->wb, (const char *)&header, sizeof(header));
+	hctx->stdin_closed = 1;
+}
+
 static int fcgi_create_env(server *srv, handler_ctx *hctx, size_t request_id) {
 	FCGI_BeginRequestRecord beginRecord;
 	FCGI_Header header;
@@ -2010,7 +2075,7 @@ static int fcgi_create_env(server *srv, handler_ctx *hctx, size_t request_id) {
 	FCGI_ENV_ADD_CHECK(fcgi_env_add_request_headers(srv, con, p), con);
 
 	{
-		buffer *b = buffer_init();
+		buffer *b = buffer_pool_get(con->request_buffers);
 
 		buffer_copy_string_len(b, (const char *)&beginRecord, sizeof(beginRecord));
 
@@ -2022,37 +2087,9 @@ static int fcgi_create_env(server *srv, handler_ctx *hctx, size_t request_id) {
 		buffer_append_string_len(b, (const char *)&header, sizeof(header));
 
 		chunkqueue_append_buffer(hctx->wb, b);
-		buffer_free(b);
-	}
-
-	if (con->request.content_length) {
-		chunkqueue *req_cq = con->request_content_queue;
-		off_t offset;
-
-		/* something to send ? */
-		for (offset = 0; offset != req_cq->bytes_in; ) {
-			off_t weWant = req_cq->bytes_in - offset > FCGI_MAX_LENGTH ? FCGI_MAX_LENGTH : req_cq->bytes_in - offset;
-
-			/* we announce toWrite octets
-			 * now take all the request_content chunks that we need to fill this request
-			 * */
-
-			fcgi_header(&(header), FCGI_STDIN, request_id, weWant, 0);
-			chunkqueue_append_mem(hctx->wb, (const char *)&header, sizeof(header));
-
-			if (p->conf.debug > 10) {
-				log_error_write(srv, __FILE__, __LINE__, "soso", "tosend:", offset, "/", req_cq->bytes_in);
-			}
-
-			chunkqueue_steal(hctx->wb, req_cq, weWant);
-
-			offset += weWant;
-		}
 	}
 
-	/* terminate STDIN */
-	fcgi_header(&(header), FCGI_STDIN, request_id, 0, 0);
-	chunkqueue_append_mem(hctx->wb, (const char *)&header, sizeof(header));
+	fcgi_stdin_append(srv, hctx, request_id);
 
 	return 0;
 }
@@ -2542,6 +2579,11 @@ static int fcgi_demux_response(server *srv, handler_ctx *hctx) {
 		buffer_free(packet.b);
 	}
 
+	if (0 == fin && http_chunk_backpressure(srv, con)) {
+		/* the client is slower than the backend, wait until the write_queue drained */
+		fdevent_event_del(srv->ev, &(hctx->fde_ndx), hctx->fd);
+	}
+
 	return fin;
 }
 
@@ -2896,6 +2938,9 @@ static handler_t fcgi_write_request(server *srv, handler_ctx *hctx) {
 		fcgi_set_state(srv, hctx, FCGI_STATE_WRITE);
 		/* fall through */
 	case FCGI_STATE_WRITE:
+		/* pick up request body which arrived since the last round */
+		fcgi_stdin_append(srv, hctx, hctx->request_id);
+
 		ret = srv->network_backend_write(srv, con, hctx->fd, hctx->wb, MAX_WRITE_LIMIT);
 
 		chunkqueue_remove_finished_chunks(hctx->wb);
@@ -2926,6 +2971,16 @@ static handler_t fcgi_write_request(server *srv, handler_ctx *hctx) {
 		if (hctx->wb->bytes_out == hctx->wb->bytes_in) {
 			/* we don't need the out event anymore */
 			fdevent_event_del(srv->ev, &(hctx->fde_ndx), hctx->fd);
+
+			if (!hctx->stdin_closed) {
+				if (con->request_content_queue->bytes_out != con->request_content_queue->bytes_in) {
+					/* the rest of the body waits in the request_content_queue */
+					fdevent_event_set(srv->ev, &(hctx->fde_ndx), hctx->fd, FDEVENT_OUT);
+				}
+				/* else wait for more of the request body, the client connection wakes us up */
+				return HANDLER_WAIT_FOR_EVENT;
+			}
+
 			fdevent_event_set(srv->ev, &(hctx->fde_ndx), hctx->fd, FDEVENT_IN);
 			fcgi_set_state(srv, hctx, FCGI_STATE_READ);
 		} else {
@@ -2937,6 +2992,10 @@ static handler_t fcgi_write_request(server *srv, handler_ctx *hctx) {
 		break;
 	case FCGI_STATE_READ:
 		/* waiting for a response */
+		if (!http_chunk_backpressure_active(srv, con)) {
+			/* (again) room in the write_queue, read from the backend */
+			fdevent_event_set(srv->ev, &(hctx->fde_ndx), hctx->fd, FDEVENT_IN);
+		}
 		break;
 	default:
 		log_error_write(srv, __FILE__, __LINE__, "s", "(debug) unknown state");
@@ -3018,6 +3077,11 @@ SUBREQUEST_FUNC(mod_fastcgi_handle_subrequest) {
 		host = hctx->host;
 	}
 
+	if (con->state == CON_STATE_READ_POST && host->mode != FCGI_AUTHORIZER) {
+		/* server.stream-request-body: we take the body while it arrives */
+		con->request_body_streaming = 1;
+	}
+
 	/* ok, create the request */
 	switch(fcgi_write_request(srv, hctx)) {
 	case HANDLER_ERROR:
@@ -3265,6 +3329,8 @@ static int fcgi_patch_connection(server *srv, connection *con, plugin_data *p) {
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH(exts);
 	PATCH(debug);
 	PATCH(ext_mapping);
@@ -3291,6 +3357,8 @@ static int fcgi_patch_connection(server *srv, connection *con, plugin_data *p) {
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 #undef PATCH
@@ -3434,7 +3502,7 @@ static handler_t fcgi_check_extension(server *srv, connection *con, void *p_d, i
 			handler_ctx *hctx;
 			char *pathinfo;
 
-			hctx = handler_ctx_init();
+			hctx = handler_ctx_init(con);
 
 			hctx->remote_conn      = con;
 			hctx->plugin_data      = p;
@@ -3499,7 +3567,7 @@ static handler_t fcgi_check_extension(server *srv, connection *con, void *p_d, i
 		}
 	} else {
 		handler_ctx *hctx;
-		hctx = handler_ctx_init();
+		hctx = handler_ctx_init(con);
 
 		hctx->remote_conn      = con;
 		hctx->plugin_data      = p;
@@ -25,6 +25,7 @@ typedef struct {
 
 	plugin_config **config_storage;
 
+	config_snapshots *snapshots;
 	plugin_config conf;
 } plugin_data;
 
@@ -66,6 +67,8 @@ FREE_FUNC(mod_flv_streaming_free) {
 	buffer_free(p->query_str);
 	array_free(p->get_params);
 
+	config_snapshots_free(p->snapshots);
+
 	free(p);
 
 	return HANDLER_GO_ON;
@@ -102,6 +105,8 @@ SETDEFAULTS_FUNC(mod_flv_streaming_set_defaults) {
 		}
 	}
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 }
 
@@ -111,6 +116,8 @@ static int mod_flv_streaming_patch_connection(server *srv, connection *con, plug
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH(extensions);
 
 	/* skip the first, the global context */
@@ -131,6 +138,8 @@ static int mod_flv_streaming_patch_connection(server *srv, connection *con, plug
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 #undef PATCH
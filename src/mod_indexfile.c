@@ -24,6 +24,7 @@ typedef struct {
 
 	plugin_config **config_storage;
 
+	config_snapshots *snapshots;
 	plugin_config conf;
 } plugin_data;
 
@@ -62,6 +63,8 @@ FREE_FUNC(mod_indexfile_free) {
 
 	buffer_free(p->tmp_buf);
 
+	config_snapshots_free(p->snapshots);
+
 	free(p);
 
 	return HANDLER_GO_ON;
@@ -100,6 +103,8 @@ SETDEFAULTS_FUNC(mod_indexfile_set_defaults) {
 		}
 	}
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 }
 
@@ -109,6 +114,8 @@ static int mod_indexfile_patch_connection(server *srv, connection *con, plugin_d
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH(indexfiles);
 
 	/* skip the first, the global context */
@@ -131,6 +138,8 @@ static int mod_indexfile_patch_connection(server *srv, connection *con, plugin_d
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 #undef PATCH
@@ -42,6 +42,7 @@ typedef struct {
 
 	plugin_config **config_storage;
 
+	config_snapshots *snapshots;
 	plugin_config conf;
 } plugin_data;
 
@@ -84,6 +85,8 @@ FREE_FUNC(mod_magnet_free) {
 	script_cache_free(p->cache);
 	buffer_free(p->encode_buf);
 
+	config_snapshots_free(p->snapshots);
+
 	free(p);
 
 	return HANDLER_GO_ON;
@@ -123,6 +126,8 @@ SETDEFAULTS_FUNC(mod_magnet_set_defaults) {
 		}
 	}
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 }
 
@@ -132,6 +137,8 @@ static int mod_magnet_patch_connection(server *srv, connection *con, plugin_data
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH(url_raw);
 	PATCH(physical_path);
 
@@ -155,6 +162,8 @@ static int mod_magnet_patch_connection(server *srv, connection *con, plugin_data
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 #undef PATCH
@@ -76,6 +76,7 @@ typedef struct {
 
 	plugin_config **config_storage;
 
+	config_snapshots *snapshots;
 	plugin_config conf;
 } plugin_data;
 
@@ -176,6 +177,8 @@ FREE_FUNC(mod_proxy_free) {
 		free(p->config_storage);
 	}
 
+	config_snapshots_free(p->snapshots);
+
 	free(p);
 
 	return HANDLER_GO_ON;
@@ -329,6 +332,8 @@ SETDEFAULTS_FUNC(mod_proxy_set_defaults) {
 		}
 	}
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 }
 
@@ -458,6 +463,28 @@ static void proxy_append_header(connection *con, const char *key, const char *va
 }
 
 
+/* move the request body received so far to the backend queue;
+ * with server.stream-request-body it might still be arriving */
+static void proxy_append_body(server *srv, handler_ctx *hctx) {
+	connection *con = hctx->remote_conn;
+	chunkqueue *req_cq = con->request_content_queue;
+	off_t len = req_cq->bytes_in - req_cq->bytes_out;
+
+	if (1 == con->request_body_streaming) {
+		/* the body is in memory: take only what the backend can swallow */
+		off_t room = MAX_REQUEST_BODY_STREAM_BUFFER - chunkqueue_length(hctx->wb);
+
+		if (len > room) len = room > 0 ? room : 0;
+
+		if (len > 0 && chunkqueue_length(req_cq) > MAX_REQUEST_BODY_STREAM_BUFFER) {
+			/* the core stopped reading from the client, wake it up */
+			joblist_append(srv, con);
+		}
+	}
+
+	chunkqueue_steal(hctx->wb, req_cq, len);
+}
+
 static int proxy_create_env(server *srv, handler_ctx *hctx) {
 	size_t i;
 
@@ -507,11 +534,7 @@ static int proxy_create_env(server *srv, handler_ctx *hctx) {
 
 	/* body */
 
-	if (con->request.content_length) {
-		chunkqueue *req_cq = con->request_content_queue;
-
-		chunkqueue_steal(hctx->wb, req_cq, req_cq->bytes_in);
-	}
+	proxy_append_body(srv, hctx);
 
 	return 0;
 }
@@ -698,6 +721,11 @@ static int proxy_demux_response(server *srv, handler_ctx *hctx) {
 			buffer_reset(hctx->response);
 		}
 
+		if (http_chunk_backpressure(srv, con)) {
+			/* the client is slower than the backend, wait until the write_queue drained */
+			fdevent_event_del(srv->ev, &(hctx->fde_ndx), hctx->fd);
+		}
+
 	} else {
 		/* reading from upstream done */
 		con->file_finished = 1;
@@ -796,6 +824,8 @@ static handler_t proxy_write_request(server *srv, handler_ctx *hctx) {
 
 		/* fall through */
 	case PROXY_STATE_WRITE:;
+		proxy_append_body(srv, hctx);
+
 		ret = srv->network_backend_write(srv, con, hctx->fd, hctx->wb, MAX_WRITE_LIMIT);
 
 		chunkqueue_remove_finished_chunks(hctx->wb);
@@ -810,10 +840,17 @@ static handler_t proxy_write_request(server *srv, handler_ctx *hctx) {
 			return HANDLER_ERROR;
 		}
 
-		if (hctx->wb->bytes_out == hctx->wb->bytes_in) {
+		if (hctx->wb->bytes_out == hctx->wb->bytes_in &&
+		    con->request_content_queue->bytes_out == con->request_content_queue->bytes_in) {
+			fdevent_event_del(srv->ev, &(hctx->fde_ndx), hctx->fd);
+
+			if (con->state == CON_STATE_READ_POST) {
+				/* wait for more of the request body, the client connection wakes us up */
+				return HANDLER_WAIT_FOR_EVENT;
+			}
+
 			proxy_set_state(srv, hctx, PROXY_STATE_READ);
 
-			fdevent_event_del(srv->ev, &(hctx->fde_ndx), hctx->fd);
 			fdevent_event_set(srv->ev, &(hctx->fde_ndx), hctx->fd, FDEVENT_IN);
 		} else {
 			fdevent_event_set(srv->ev, &(hctx->fde_ndx), hctx->fd, FDEVENT_OUT);
@@ -824,6 +861,10 @@ static handler_t proxy_write_request(server *srv, handler_ctx *hctx) {
 		return HANDLER_WAIT_FOR_EVENT;
 	case PROXY_STATE_READ:
 		/* waiting for a response */
+		if (!http_chunk_backpressure_active(srv, con)) {
+			/* (again) room in the write_queue, read from the backend */
+			fdevent_event_set(srv->ev, &(hctx->fde_ndx), hctx->fd, FDEVENT_IN);
+		}
 		return HANDLER_WAIT_FOR_EVENT;
 	default:
 		log_error_write(srv, __FILE__, __LINE__, "s", "(debug) unknown state");
@@ -839,6 +880,8 @@ static int mod_proxy_patch_connection(server *srv, connection *con, plugin_data
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH(extensions);
 	PATCH(debug);
 	PATCH(balance);
@@ -865,6 +908,8 @@ static int mod_proxy_patch_connection(server *srv, connection *con, plugin_data
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 #undef PATCH
@@ -884,6 +929,11 @@ SUBREQUEST_FUNC(mod_proxy_handle_subrequest) {
 	/* not my job */
 	if (con->mode != p->id) return HANDLER_GO_ON;
 
+	if (con->state == CON_STATE_READ_POST) {
+		/* server.stream-request-body: we take the body while it arrives */
+		con->request_body_streaming = 1;
+	}
+
 	/* ok, create the request */
 	switch(proxy_write_request(srv, hctx)) {
 	case HANDLER_ERROR:
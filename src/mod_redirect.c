@@ -4,6 +4,7 @@
 
 #include "plugin.h"
 #include "response.h"
+#include "status_counter.h"
 
 #include <ctype.h>
 #include <stdlib.h>
@@ -19,10 +20,12 @@ typedef struct {
 typedef struct {
 	PLUGIN_DATA;
 	buffer *match_buf;
+	buffer *cache_key;
 	buffer *location;
 
 	plugin_config **config_storage;
 
+	config_snapshots *snapshots;
 	plugin_config conf;
 } plugin_data;
 
@@ -32,6 +35,7 @@ INIT_FUNC(mod_redirect_init) {
 	p = calloc(1, sizeof(*p));
 
 	p->match_buf = buffer_init();
+	p->cache_key = buffer_init();
 	p->location = buffer_init();
 
 	return p;
@@ -58,8 +62,11 @@ FREE_FUNC(mod_redirect_free) {
 
 
 	buffer_free(p->match_buf);
+	buffer_free(p->cache_key);
 	buffer_free(p->location);
 
+	config_snapshots_free(p->snapshots);
+
 	free(p);
 
 	return HANDLER_GO_ON;
@@ -135,6 +142,8 @@ SETDEFAULTS_FUNC(mod_redirect_set_defaults) {
 		}
 	}
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 }
 #ifdef HAVE_PCRE_H
@@ -142,6 +151,8 @@ static int mod_redirect_patch_connection(server *srv, connection *con, plugin_da
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	p->conf.redirect = s->redirect;
 	p->conf.redirect_code = s->redirect_code;
 	p->conf.context = NULL;
@@ -167,13 +178,19 @@ static int mod_redirect_patch_connection(server *srv, connection *con, plugin_da
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 #endif
 static handler_t mod_redirect_uri_handler(server *srv, connection *con, void *p_data) {
 #ifdef HAVE_PCRE_H
 	plugin_data *p = p_data;
-	size_t i;
+	pcre_keyvalue_buffer *kvb;
+	const buffer *key;
+	const size_t *cand;
+	size_t c, ncand;
+	int ndx;
 
 	/*
 	 * REWRITE URL
@@ -184,15 +201,31 @@ static handler_t mod_redirect_uri_handler(server *srv, connection *con, void *p_
 
 	mod_redirect_patch_connection(srv, con, p);
 
+	kvb = p->conf.redirect;
+	if (0 == kvb->used) return HANDLER_GO_ON;
+
 	buffer_copy_buffer(p->match_buf, con->request.uri);
 
-	for (i = 0; i < p->conf.redirect->used; i++) {
+	key = pcre_result_cache_key(con, p->conf.context, &kvb->index, p->match_buf, p->cache_key);
+	ndx = pcre_result_cache_get(kvb->index.results, key, p->location);
+	if (PCRE_RESULT_CACHE_MISS != ndx) {
+		status_counter_inc(srv, CONST_STR_LEN("redirect.cache-hits"));
+		if (PCRE_RESULT_CACHE_NOMATCH == ndx) return HANDLER_GO_ON;
+		goto redirect;
+	}
+	status_counter_inc(srv, CONST_STR_LEN("redirect.cache-misses"));
+	if (NULL == kvb->index.results) kvb->index.results = pcre_result_cache_init();
+
+	/* only rules whose literal prefix matches (or which have none), in order */
+	ncand = pcre_prefilter_candidates(kvb->index.prefilter, CONST_BUF_LEN(p->match_buf), &cand);
+
+	for (c = 0; c < ncand; c++) {
 		pcre *match;
 		pcre_extra *extra;
 		const char *pattern;
 		size_t pattern_len;
 		int n;
-		pcre_keyvalue *kv = p->conf.redirect->kv[i];
+		pcre_keyvalue *kv = kvb->kv[cand[c]];
 # define N 10
 		int ovec[N * 3];
 
@@ -254,17 +287,26 @@ static handler_t mod_redirect_uri_handler(server *srv, connection *con, void *p_
 
 			pcre_free(list);
 
-			response_header_insert(srv, con, CONST_STR_LEN("Location"), CONST_BUF_LEN(p->location));
+			pcre_result_cache_put(kvb->index.results, key, (int)cand[c], p->location);
 
-			con->http_status = p->conf.redirect_code > 99 && p->conf.redirect_code < 1000 ? p->conf.redirect_code : 301;
-			con->mode = DIRECT;
-			con->file_finished = 1;
-
-			return HANDLER_FINISHED;
+			goto redirect;
 		}
 	}
 #undef N
 
+	pcre_result_cache_put(kvb->index.results, key, PCRE_RESULT_CACHE_NOMATCH, NULL);
+
+	return HANDLER_GO_ON;
+
+redirect:
+	response_header_insert(srv, con, CONST_STR_LEN("Location"), CONST_BUF_LEN(p->location));
+
+	con->http_status = p->conf.redirect_code > 99 && p->conf.redirect_code < 1000 ? p->conf.redirect_code : 301;
+	con->mode = DIRECT;
+	con->file_finished = 1;
+
+	return HANDLER_FINISHED;
+
 #else
 	UNUSED(srv);
 	UNUSED(con);
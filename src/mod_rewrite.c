@@ -4,6 +4,7 @@
 
 #include "plugin.h"
 #include "stat_cache.h"
+#include "status_counter.h"
 
 #include <ctype.h>
 #include <stdlib.h>
@@ -12,6 +13,7 @@
 #ifdef HAVE_PCRE_H
 typedef struct {
 	pcre *key;
+	pcre_extra *key_extra;
 
 	buffer *value;
 
@@ -23,6 +25,8 @@ typedef struct {
 
 	size_t used;
 	size_t size;
+
+	pcre_rule_index index;
 } rewrite_rule_buffer;
 
 typedef struct {
@@ -39,9 +43,11 @@ typedef struct {
 typedef struct {
 	PLUGIN_DATA;
 	buffer *match_buf;
+	buffer *cache_key;
 
 	plugin_config **config_storage;
 
+	config_snapshots *snapshots;
 	plugin_config conf;
 } plugin_data;
 
@@ -64,6 +70,7 @@ static rewrite_rule_buffer *rewrite_rule_buffer_init(void) {
 	rewrite_rule_buffer *kvb;
 
 	kvb = calloc(1, sizeof(*kvb));
+	pcre_rule_index_init(&kvb->index);
 
 	return kvb;
 }
@@ -100,10 +107,17 @@ static int rewrite_rule_buffer_append(rewrite_rule_buffer *kvb, buffer *key, buf
 		return -1;
 	}
 
+	if (NULL == (kvb->ptr[kvb->used]->key_extra = pcre_keyvalue_study(kvb->ptr[kvb->used]->key, &errptr)) &&
+			errptr != NULL) {
+		return -1;
+	}
+
 	kvb->ptr[kvb->used]->value = buffer_init();
 	buffer_copy_buffer(kvb->ptr[kvb->used]->value, value);
 	kvb->ptr[kvb->used]->once = once;
 
+	pcre_rule_index_append(&kvb->index, key->ptr, value->ptr, kvb->used);
+
 	kvb->used++;
 
 	return 0;
@@ -114,12 +128,14 @@ static void rewrite_rule_buffer_free(rewrite_rule_buffer *kvb) {
 
 	for (i = 0; i < kvb->size; i++) {
 		if (kvb->ptr[i]->key) pcre_free(kvb->ptr[i]->key);
+		if (kvb->ptr[i]->key_extra) pcre_keyvalue_study_free(kvb->ptr[i]->key_extra);
 		if (kvb->ptr[i]->value) buffer_free(kvb->ptr[i]->value);
 		free(kvb->ptr[i]);
 	}
 
 	if (kvb->ptr) free(kvb->ptr);
 
+	pcre_rule_index_free(&kvb->index);
 	free(kvb);
 }
 
@@ -130,6 +146,7 @@ INIT_FUNC(mod_rewrite_init) {
 	p = calloc(1, sizeof(*p));
 
 	p->match_buf = buffer_init();
+	p->cache_key = buffer_init();
 
 	return p;
 }
@@ -142,6 +159,7 @@ FREE_FUNC(mod_rewrite_free) {
 	if (!p) return HANDLER_GO_ON;
 
 	buffer_free(p->match_buf);
+	buffer_free(p->cache_key);
 	if (p->config_storage) {
 		size_t i;
 		for (i = 0; i < srv->config_context->used; i++) {
@@ -157,6 +175,8 @@ FREE_FUNC(mod_rewrite_free) {
 		free(p->config_storage);
 	}
 
+	config_snapshots_free(p->snapshots);
+
 	free(p);
 
 	return HANDLER_GO_ON;
@@ -277,6 +297,10 @@ SETDEFAULTS_FUNC(mod_rewrite_set_defaults) {
 		parse_config_entry(srv, config->value, s->rewrite, "url.rewrite-repeat",    0);
 	}
 
+#ifdef HAVE_PCRE_H
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+#endif
+
 	return HANDLER_GO_ON;
 }
 
@@ -288,6 +312,8 @@ static int mod_rewrite_patch_connection(server *srv, connection *con, plugin_dat
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH(rewrite);
 	PATCH(rewrite_NF);
 	p->conf.context = NULL;
@@ -327,6 +353,8 @@ static int mod_rewrite_patch_connection(server *srv, connection *con, plugin_dat
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 
@@ -344,7 +372,11 @@ URIHANDLER_FUNC(mod_rewrite_con_reset) {
 }
 
 static int process_rewrite_rules(server *srv, connection *con, plugin_data *p, rewrite_rule_buffer *kvb) {
-	size_t i;
+	const buffer *key;
+	const size_t *cand;
+	size_t c, ncand;
+	int ndx;
+	rewrite_rule *rule;
 	handler_ctx *hctx;
 
 	if (con->plugin_ctx[p->id]) {
@@ -360,22 +392,38 @@ static int process_rewrite_rules(server *srv, connection *con, plugin_data *p, r
 		if (hctx->state == REWRITE_STATE_FINISHED) return HANDLER_GO_ON;
 	}
 
+	if (0 == kvb->used) return HANDLER_GO_ON;
+
 	buffer_copy_buffer(p->match_buf, con->request.uri);
 
-	for (i = 0; i < kvb->used; i++) {
+	key = pcre_result_cache_key(con, p->conf.context, &kvb->index, p->match_buf, p->cache_key);
+	ndx = pcre_result_cache_get(kvb->index.results, key, con->request.uri);
+	if (PCRE_RESULT_CACHE_MISS != ndx) {
+		status_counter_inc(srv, CONST_STR_LEN("rewrite.cache-hits"));
+		if (PCRE_RESULT_CACHE_NOMATCH == ndx) return HANDLER_GO_ON;
+		rule = kvb->ptr[ndx];
+		goto rewritten;
+	}
+	status_counter_inc(srv, CONST_STR_LEN("rewrite.cache-misses"));
+	if (NULL == kvb->index.results) kvb->index.results = pcre_result_cache_init();
+
+	/* only rules whose literal prefix matches (or which have none), in order */
+	ncand = pcre_prefilter_candidates(kvb->index.prefilter, CONST_BUF_LEN(p->match_buf), &cand);
+
+	for (c = 0; c < ncand; c++) {
 		pcre *match;
 		const char *pattern;
 		size_t pattern_len;
 		int n;
-		rewrite_rule *rule = kvb->ptr[i];
 # define N 10
 		int ovec[N * 3];
 
+		rule        = kvb->ptr[cand[c]];
 		match       = rule->key;
 		pattern     = rule->value->ptr;
 		pattern_len = buffer_string_length(rule->value);
 
-		if ((n = pcre_exec(match, NULL, CONST_BUF_LEN(p->match_buf), 0, 0, ovec, 3 * N)) < 0) {
+		if ((n = pcre_exec(match, rule->key_extra, CONST_BUF_LEN(p->match_buf), 0, 0, ovec, 3 * N)) < 0) {
 			if (n != PCRE_ERROR_NOMATCH) {
 				log_error_write(srv, __FILE__, __LINE__, "sd",
 						"execution error while matching: ", n);
@@ -429,21 +477,28 @@ static int process_rewrite_rules(server *srv, connection *con, plugin_data *p, r
 
 			pcre_free(list);
 
-			if (con->plugin_ctx[p->id] == NULL) {
-				hctx = handler_ctx_init();
-				con->plugin_ctx[p->id] = hctx;
-			} else {
-				hctx = con->plugin_ctx[p->id];
-			}
-
-			if (rule->once) hctx->state = REWRITE_STATE_FINISHED;
+			pcre_result_cache_put(kvb->index.results, key, (int)cand[c], con->request.uri);
 
-			return HANDLER_COMEBACK;
+			goto rewritten;
 		}
 #undef N
 	}
 
+	pcre_result_cache_put(kvb->index.results, key, PCRE_RESULT_CACHE_NOMATCH, NULL);
+
 	return HANDLER_GO_ON;
+
+rewritten:
+	if (con->plugin_ctx[p->id] == NULL) {
+		hctx = handler_ctx_init();
+		con->plugin_ctx[p->id] = hctx;
+	} else {
+		hctx = con->plugin_ctx[p->id];
+	}
+
+	if (rule->once) hctx->state = REWRITE_STATE_FINISHED;
+
+	return HANDLER_COMEBACK;
 }
 
 URIHANDLER_FUNC(mod_rewrite_physical) {
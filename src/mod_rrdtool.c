@@ -41,6 +41,7 @@ typedef struct {
 	int rrdtool_running;
 
 	plugin_config **config_storage;
+	config_snapshots *snapshots;
 	plugin_config conf;
 } plugin_data;
 
@@ -88,6 +89,8 @@ FREE_FUNC(mod_rrd_free) {
 #endif
 	}
 
+	config_snapshots_free(p->snapshots);
+
 	free(p);
 
 	return HANDLER_GO_ON;
@@ -300,6 +303,8 @@ static int mod_rrd_patch_connection(server *srv, connection *con, plugin_data *p
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH(path_rrdtool_bin);
 	PATCH(path_rrd);
 
@@ -330,6 +335,8 @@ static int mod_rrd_patch_connection(server *srv, connection *con, plugin_data *p
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 #undef PATCH
@@ -398,6 +405,8 @@ SETDEFAULTS_FUNC(mod_rrd_set_defaults) {
 
 	p->rrdtool_running = 1;
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 }
 
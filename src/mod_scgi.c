@@ -284,6 +284,7 @@ typedef struct {
 
 	plugin_config **config_storage;
 
+	config_snapshots *snapshots;
 	plugin_config conf; /* this is only used as long as no handler_ctx is setup */
 } plugin_data;
 
@@ -599,6 +600,8 @@ FREE_FUNC(mod_scgi_free) {
 		free(p->config_storage);
 	}
 
+	config_snapshots_free(p->snapshots);
+
 	free(p);
 
 	return HANDLER_GO_ON;
@@ -1192,6 +1195,8 @@ SETDEFAULTS_FUNC(mod_scgi_set_defaults) {
 		}
 	}
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 
 error:
@@ -2328,6 +2333,9 @@ SUBREQUEST_FUNC(mod_scgi_handle_subrequest) {
 	/* not my job */
 	if (con->mode != p->id) return HANDLER_GO_ON;
 
+	/* the request body is sent in one go; wait until it is complete */
+	if (con->state == CON_STATE_READ_POST) return HANDLER_WAIT_FOR_EVENT;
+
 	/* ok, create the request */
 	switch(scgi_write_request(srv, hctx)) {
 	case HANDLER_ERROR:
@@ -2615,6 +2623,8 @@ static int scgi_patch_connection(server *srv, connection *con, plugin_data *p) {
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH(exts);
 	PATCH(debug);
 
@@ -2638,6 +2648,8 @@ static int scgi_patch_connection(server *srv, connection *con, plugin_data *p) {
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 #undef PATCH
@@ -43,6 +43,7 @@ typedef struct {
 
 	plugin_config **config_storage;
 
+	config_snapshots *snapshots;
 	plugin_config conf;
 } plugin_data;
 
@@ -92,6 +93,8 @@ FREE_FUNC(mod_secdownload_free) {
 
 	buffer_free(p->md5);
 
+	config_snapshots_free(p->snapshots);
+
 	free(p);
 
 	return HANDLER_GO_ON;
@@ -137,6 +140,8 @@ SETDEFAULTS_FUNC(mod_secdownload_set_defaults) {
 		}
 	}
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 }
 
@@ -171,6 +176,8 @@ static int mod_secdownload_patch_connection(server *srv, connection *con, plugin
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH(secret);
 	PATCH(doc_root);
 	PATCH(uri_prefix);
@@ -200,6 +207,8 @@ static int mod_secdownload_patch_connection(server *srv, connection *con, plugin
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 #undef PATCH
@@ -27,6 +27,7 @@ typedef struct {
 
 	plugin_config **config_storage;
 
+	config_snapshots *snapshots;
 	plugin_config conf;
 } plugin_data;
 
@@ -78,6 +79,8 @@ FREE_FUNC(mod_setenv_free) {
 		free(p->config_storage);
 	}
 
+	config_snapshots_free(p->snapshots);
+
 	free(p);
 
 	return HANDLER_GO_ON;
@@ -120,6 +123,8 @@ SETDEFAULTS_FUNC(mod_setenv_set_defaults) {
 		}
 	}
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 }
 
@@ -129,6 +134,8 @@ static int mod_setenv_patch_connection(server *srv, connection *con, plugin_data
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH(request_header);
 	PATCH(response_header);
 	PATCH(environment);
@@ -155,6 +162,8 @@ static int mod_setenv_patch_connection(server *srv, connection *con, plugin_data
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 #undef PATCH
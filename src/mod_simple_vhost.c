@@ -29,6 +29,7 @@ typedef struct {
 	buffer *doc_root;
 
 	plugin_config **config_storage;
+	config_snapshots *snapshots;
 	plugin_config conf;
 } plugin_data;
 
@@ -70,6 +71,8 @@ FREE_FUNC(mod_simple_vhost_free) {
 
 	buffer_free(p->doc_root);
 
+	config_snapshots_free(p->snapshots);
+
 	free(p);
 
 	return HANDLER_GO_ON;
@@ -120,6 +123,8 @@ SETDEFAULTS_FUNC(mod_simple_vhost_set_defaults) {
 		}
 	}
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 }
 
@@ -173,6 +178,8 @@ static int mod_simple_vhost_patch_connection(server *srv, connection *con, plugi
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH(server_root);
 	PATCH(default_host);
 	PATCH(document_root);
@@ -210,6 +217,8 @@ static int mod_simple_vhost_patch_connection(server *srv, connection *con, plugi
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 #undef PATCH
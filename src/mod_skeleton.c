@@ -34,6 +34,7 @@ typedef struct {
 
 	plugin_config **config_storage;
 
+	config_snapshots *snapshots;
 	plugin_config conf;
 } plugin_data;
 
@@ -90,6 +91,8 @@ FREE_FUNC(mod_skeleton_free) {
 
 	buffer_free(p->match_buf);
 
+	config_snapshots_free(p->snapshots);
+
 	free(p);
 
 	return HANDLER_GO_ON;
@@ -126,6 +129,8 @@ SETDEFAULTS_FUNC(mod_skeleton_set_defaults) {
 		}
 	}
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 }
 
@@ -135,6 +140,8 @@ static int mod_skeleton_patch_connection(server *srv, connection *con, plugin_da
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH(match);
 
 	/* skip the first, the global context */
@@ -155,6 +162,8 @@ static int mod_skeleton_patch_connection(server *srv, connection *con, plugin_da
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 #undef PATCH
@@ -82,11 +82,14 @@ FREE_FUNC(mod_ssi_free) {
 	array_free(p->ssi_vars);
 	array_free(p->ssi_cgi_env);
 #ifdef HAVE_PCRE_H
+	pcre_keyvalue_study_free(p->ssi_regex_extra);
 	pcre_free(p->ssi_regex);
 #endif
 	buffer_free(p->timefmt);
 	buffer_free(p->stat_fn);
 
+	config_snapshots_free(p->snapshots);
+
 	free(p);
 
 	return HANDLER_GO_ON;
@@ -138,12 +141,21 @@ SETDEFAULTS_FUNC(mod_ssi_set_defaults) {
 				erroff, errptr);
 		return HANDLER_ERROR;
 	}
+
+	if (NULL == (p->ssi_regex_extra = pcre_keyvalue_study(p->ssi_regex, &errptr)) &&
+			errptr != NULL) {
+		log_error_write(srv, __FILE__, __LINE__, "ss",
+				"ssi: pcre study failed:", errptr);
+		return HANDLER_ERROR;
+	}
 #else
 	log_error_write(srv, __FILE__, __LINE__, "s",
 			"mod_ssi: pcre support is missing, please recompile with pcre support or remove mod_ssi from the list of modules");
 	return HANDLER_ERROR;
 #endif
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 }
 
@@ -289,6 +301,7 @@ static int process_ssi_stmt(server *srv, connection *con, plugin_data *p, const
 	size_t i, ssicmd = 0;
 	char buf[255];
 	buffer *b = NULL;
+	const size_t *sorted;
 
 	struct {
 		const char *var;
@@ -647,16 +660,18 @@ static int process_ssi_stmt(server *srv, connection *con, plugin_data *p, const
 		if (p->if_is_false) break;
 
 		b = buffer_init();
+		sorted = array_get_sorted_index(p->ssi_vars);
 		for (i = 0; i < p->ssi_vars->used; i++) {
-			data_string *ds = (data_string *)p->ssi_vars->data[p->ssi_vars->sorted[i]];
+			data_string *ds = (data_string *)p->ssi_vars->data[sorted[i]];
 
 			buffer_append_string_buffer(b, ds->key);
 			buffer_append_string_len(b, CONST_STR_LEN("="));
 			buffer_append_string_encoded(b, CONST_BUF_LEN(ds->value), ENCODING_MINIMAL_XML);
 			buffer_append_string_len(b, CONST_STR_LEN("\n"));
 		}
+		sorted = array_get_sorted_index(p->ssi_cgi_env);
 		for (i = 0; i < p->ssi_cgi_env->used; i++) {
-			data_string *ds = (data_string *)p->ssi_cgi_env->data[p->ssi_cgi_env->sorted[i]];
+			data_string *ds = (data_string *)p->ssi_cgi_env->data[sorted[i]];
 
 			buffer_append_string_buffer(b, ds->key);
 			buffer_append_string_len(b, CONST_STR_LEN("="));
@@ -1001,7 +1016,7 @@ static int mod_ssi_handle_request(server *srv, connection *con, plugin_data *p)
 	 *
 	 */
 #ifdef HAVE_PCRE_H
-	for (i = 0; (n = pcre_exec(p->ssi_regex, NULL, s.start, s.size, i, 0, ovec, N * 3)) > 0; i = ovec[1]) {
+	for (i = 0; (n = pcre_exec(p->ssi_regex, p->ssi_regex_extra, s.start, s.size, i, 0, ovec, N * 3)) > 0; i = ovec[1]) {
 		const char **l;
 		/* take everything from last offset to current match pos */
 
@@ -1070,6 +1085,8 @@ static int mod_ssi_patch_connection(server *srv, connection *con, plugin_data *p
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH(ssi_extension);
 	PATCH(content_type);
 
@@ -1093,6 +1110,8 @@ static int mod_ssi_patch_connection(server *srv, connection *con, plugin_data *p
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 #undef PATCH
@@ -23,6 +23,7 @@ typedef struct {
 
 #ifdef HAVE_PCRE_H
 	pcre *ssi_regex;
+	pcre_extra *ssi_regex_extra;
 #endif
 	buffer *timefmt;
 	int sizefmt;
@@ -36,6 +37,7 @@ typedef struct {
 
 	plugin_config **config_storage;
 
+	config_snapshots *snapshots;
 	plugin_config conf;
 } plugin_data;
 
@@ -36,6 +36,7 @@ typedef struct {
 
 	plugin_config **config_storage;
 
+	config_snapshots *snapshots;
 	plugin_config conf;
 } plugin_data;
 
@@ -73,6 +74,8 @@ FREE_FUNC(mod_staticfile_free) {
 	}
 	buffer_free(p->range_buf);
 
+	config_snapshots_free(p->snapshots);
+
 	free(p);
 
 	return HANDLER_GO_ON;
@@ -115,6 +118,8 @@ SETDEFAULTS_FUNC(mod_staticfile_set_defaults) {
 		}
 	}
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 }
 
@@ -124,6 +129,8 @@ static int mod_staticfile_patch_connection(server *srv, connection *con, plugin_
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH(exclude_ext);
 	PATCH(etags_used);
 	PATCH(disable_pathinfo);
@@ -150,6 +157,8 @@ static int mod_staticfile_patch_connection(server *srv, connection *con, plugin_
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 #undef PATCH
@@ -163,11 +172,14 @@ static int http_response_parse_range(server *srv, connection *con, plugin_data *
 	data_string *ds;
 	stat_cache_entry *sce = NULL;
 	buffer *content_type = NULL;
+	chunk_shared_mem *content;
 
 	if (HANDLER_ERROR == stat_cache_get_entry(srv, con, con->physical.path, &sce)) {
 		SEGFAULT();
 	}
 
+	content = stat_cache_entry_get_content(srv, sce);
+
 	start = 0;
 	end = sce->st.st_size - 1;
 
@@ -312,7 +324,11 @@ static int http_response_parse_range(server *srv, connection *con, plugin_data *
 				buffer_free(b);
 			}
 
-			chunkqueue_append_file(con->write_queue, con->physical.path, start, end - start + 1);
+			if (NULL != content) {
+				chunkqueue_append_shared_mem(con->write_queue, content, start, end - start + 1);
+			} else {
+				chunkqueue_append_file(con->write_queue, con->physical.path, start, end - start + 1);
+			}
 			con->response.content_length += end - start + 1;
 		}
 	}
@@ -361,6 +377,7 @@ URIHANDLER_FUNC(mod_staticfile_subrequest) {
 	size_t k;
 	stat_cache_entry *sce = NULL;
 	buffer *mtime = NULL;
+	chunk_shared_mem *content;
 	data_string *ds;
 	int allow_caching = 1;
 
@@ -538,7 +555,12 @@ URIHANDLER_FUNC(mod_staticfile_subrequest) {
 	/* we add it here for all requests
 	 * the HEAD request will drop it afterwards again
 	 */
-	http_chunk_append_file(srv, con, con->physical.path, 0, sce->st.st_size);
+	if (NULL != (content = stat_cache_entry_get_content(srv, sce))) {
+		/* small files are sent from memory shared by all requests, together with the headers */
+		http_chunk_append_shared_mem(srv, con, content, 0, buffer_string_length(content->mem));
+	} else {
+		http_chunk_append_file(srv, con, con->physical.path, 0, sce->st.st_size);
+	}
 
 	con->http_status = 200;
 	con->file_finished = 1;
@@ -50,6 +50,7 @@ typedef struct {
 
 	plugin_config **config_storage;
 
+	config_snapshots *snapshots;
 	plugin_config conf;
 } plugin_data;
 
@@ -95,6 +96,7 @@ FREE_FUNC(mod_status_free) {
 		free(p->config_storage);
 	}
 
+	config_snapshots_free(p->snapshots);
 
 	free(p);
 
@@ -139,6 +141,8 @@ SETDEFAULTS_FUNC(mod_status_set_defaults) {
 		}
 	}
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 }
 
@@ -348,6 +352,42 @@ static handler_t mod_status_handle_server_status_html(server *srv, connection *c
 	buffer_append_string(b, buf);
 	buffer_append_string_len(b, CONST_STR_LEN("</td></tr>\n"));
 
+	buffer_append_string_len(b, CONST_STR_LEN("<tr><td>Buffered</td><td class=\"string\">"));
+	avg = chunk_mem_used();
+
+	mod_status_get_multiplier(&avg, &multiplier, 1024);
+
+	sprintf(buf, "%.2f", avg);
+	buffer_append_string(b, buf);
+	buffer_append_string_len(b, CONST_STR_LEN(" "));
+	if (multiplier)	buffer_append_string_len(b, &multiplier, 1);
+	buffer_append_string_len(b, CONST_STR_LEN("byte (peak "));
+	avg = chunk_mem_peak();
+
+	mod_status_get_multiplier(&avg, &multiplier, 1024);
+
+	sprintf(buf, "%.2f", avg);
+	buffer_append_string(b, buf);
+	buffer_append_string_len(b, CONST_STR_LEN(" "));
+	if (multiplier)	buffer_append_string_len(b, &multiplier, 1);
+	buffer_append_string_len(b, CONST_STR_LEN("byte"));
+	if (0 != chunk_mem_limit()) {
+		buffer_append_string_len(b, CONST_STR_LEN(", limit "));
+		buffer_append_int(b, chunk_mem_limit() >> 10);
+		buffer_append_string_len(b, CONST_STR_LEN(" kbyte"));
+	}
+	buffer_append_string_len(b, CONST_STR_LEN(")</td></tr>\n"));
+
+	buffer_append_string_len(b, CONST_STR_LEN("<tr><td>Spare chunks</td><td class=\"string\">"));
+	buffer_append_int(b, chunk_pool_chunks());
+	buffer_append_string_len(b, CONST_STR_LEN(" ("));
+	buffer_append_int(b, chunk_pool_bytes() >> 10);
+	buffer_append_string_len(b, CONST_STR_LEN(" kbyte), "));
+	avg = chunk_pool_hits() + chunk_pool_misses();
+	sprintf(buf, "%.2f", avg > 0 ? 100.0 * chunk_pool_hits() / avg : 0.0);
+	buffer_append_string(b, buf);
+	buffer_append_string_len(b, CONST_STR_LEN(" % reused</td></tr>\n"));
+
 
 	buffer_append_string_len(b, CONST_STR_LEN("<tr><th colspan=\"2\">absolute (since start)</th></tr>\n"));
 
@@ -601,6 +641,32 @@ static handler_t mod_status_handle_server_status_text(server *srv, connection *c
 	buffer_append_int(b, srv->conns->size - srv->conns->used);
 	buffer_append_string_len(b, CONST_STR_LEN("\n"));
 
+	/* output memory held in connection queues */
+	buffer_append_string_len(b, CONST_STR_LEN("BufferedBytes: "));
+	buffer_append_int(b, chunk_mem_used());
+	buffer_append_string_len(b, CONST_STR_LEN("\n"));
+
+	buffer_append_string_len(b, CONST_STR_LEN("BufferedBytesPeak: "));
+	buffer_append_int(b, chunk_mem_peak());
+	buffer_append_string_len(b, CONST_STR_LEN("\n"));
+
+	/* output the process-wide chunk pool */
+	buffer_append_string_len(b, CONST_STR_LEN("SpareChunks: "));
+	buffer_append_int(b, chunk_pool_chunks());
+	buffer_append_string_len(b, CONST_STR_LEN("\n"));
+
+	buffer_append_string_len(b, CONST_STR_LEN("SpareChunkBytes: "));
+	buffer_append_int(b, chunk_pool_bytes());
+	buffer_append_string_len(b, CONST_STR_LEN("\n"));
+
+	buffer_append_string_len(b, CONST_STR_LEN("ChunkPoolHits: "));
+	buffer_append_int(b, chunk_pool_hits());
+	buffer_append_string_len(b, CONST_STR_LEN("\n"));
+
+	buffer_append_string_len(b, CONST_STR_LEN("ChunkPoolMisses: "));
+	buffer_append_int(b, chunk_pool_misses());
+	buffer_append_string_len(b, CONST_STR_LEN("\n"));
+
 	/* output scoreboard */
 	buffer_append_string_len(b, CONST_STR_LEN("Scoreboard: "));
 	for (k = 0; k < srv->conns->used; k++) {
@@ -626,6 +692,7 @@ static handler_t mod_status_handle_server_statistics(server *srv, connection *co
 	buffer *b;
 	size_t i;
 	array *st = srv->status;
+	const size_t *sorted;
 	UNUSED(p_d);
 
 	if (0 == st->used) {
@@ -637,8 +704,9 @@ static handler_t mod_status_handle_server_statistics(server *srv, connection *co
 	}
 
 	b = buffer_init();
+	sorted = array_get_sorted_index(st);
 	for (i = 0; i < st->used; i++) {
-		size_t ndx = st->sorted[i];
+		size_t ndx = sorted[i];
 
 		buffer_append_string_buffer(b, st->data[ndx]->key);
 		buffer_append_string_len(b, CONST_STR_LEN(": "));
@@ -776,6 +844,8 @@ static int mod_status_patch_connection(server *srv, connection *con, plugin_data
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH(status_url);
 	PATCH(config_url);
 	PATCH(sort);
@@ -805,6 +875,8 @@ static int mod_status_patch_connection(server *srv, connection *con, plugin_data
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 
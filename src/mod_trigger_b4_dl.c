@@ -43,7 +43,9 @@ typedef struct {
 	buffer *mc_namespace;
 #if defined(HAVE_PCRE_H)
 	pcre *trigger_regex;
+	pcre_extra *trigger_regex_extra;
 	pcre *download_regex;
+	pcre_extra *download_regex_extra;
 #endif
 #if defined(HAVE_GDBM_H)
 	GDBM_FILE db;
@@ -64,6 +66,7 @@ typedef struct {
 
 	plugin_config **config_storage;
 
+	config_snapshots *snapshots;
 	plugin_config conf;
 } plugin_data;
 
@@ -104,6 +107,8 @@ FREE_FUNC(mod_trigger_b4_dl_free) {
 #if defined(HAVE_PCRE_H)
 			if (s->trigger_regex) pcre_free(s->trigger_regex);
 			if (s->download_regex) pcre_free(s->download_regex);
+			if (s->trigger_regex_extra) pcre_keyvalue_study_free(s->trigger_regex_extra);
+			if (s->download_regex_extra) pcre_keyvalue_study_free(s->download_regex_extra);
 #endif
 #if defined(HAVE_GDBM_H)
 			if (s->db) gdbm_close(s->db);
@@ -119,6 +124,8 @@ FREE_FUNC(mod_trigger_b4_dl_free) {
 
 	buffer_free(p->tmp_buf);
 
+	config_snapshots_free(p->snapshots);
+
 	free(p);
 
 	return HANDLER_GO_ON;
@@ -197,6 +204,14 @@ SETDEFAULTS_FUNC(mod_trigger_b4_dl_set_defaults) {
 						s->download_url, "pos:", erroff);
 				return HANDLER_ERROR;
 			}
+
+			if (NULL == (s->download_regex_extra = pcre_keyvalue_study(s->download_regex, &errptr)) &&
+					errptr != NULL) {
+				log_error_write(srv, __FILE__, __LINE__, "sbss",
+						"studying regex for download-url failed:",
+						s->download_url, "error:", errptr);
+				return HANDLER_ERROR;
+			}
 		}
 
 		if (!buffer_string_is_empty(s->trigger_url)) {
@@ -209,6 +224,14 @@ SETDEFAULTS_FUNC(mod_trigger_b4_dl_set_defaults) {
 
 				return HANDLER_ERROR;
 			}
+
+			if (NULL == (s->trigger_regex_extra = pcre_keyvalue_study(s->trigger_regex, &errptr)) &&
+					errptr != NULL) {
+				log_error_write(srv, __FILE__, __LINE__, "sbss",
+						"studying regex for trigger-url failed:",
+						s->trigger_url, "error:", errptr);
+				return HANDLER_ERROR;
+			}
 		}
 #endif
 
@@ -243,6 +266,8 @@ SETDEFAULTS_FUNC(mod_trigger_b4_dl_set_defaults) {
 #endif
 	}
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 }
 
@@ -252,12 +277,16 @@ static int mod_trigger_b4_dl_patch_connection(server *srv, connection *con, plug
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 #if defined(HAVE_GDBM)
 	PATCH(db);
 #endif
 #if defined(HAVE_PCRE_H)
 	PATCH(download_regex);
+	PATCH(download_regex_extra);
 	PATCH(trigger_regex);
+	PATCH(trigger_regex_extra);
 #endif
 	PATCH(trigger_timeout);
 	PATCH(deny_url);
@@ -282,10 +311,12 @@ static int mod_trigger_b4_dl_patch_connection(server *srv, connection *con, plug
 			if (buffer_is_equal_string(du->key, CONST_STR_LEN("trigger-before-download.download-url"))) {
 #if defined(HAVE_PCRE_H)
 				PATCH(download_regex);
+				PATCH(download_regex_extra);
 #endif
 			} else if (buffer_is_equal_string(du->key, CONST_STR_LEN("trigger-before-download.trigger-url"))) {
 # if defined(HAVE_PCRE_H)
 				PATCH(trigger_regex);
+				PATCH(trigger_regex_extra);
 # endif
 			} else if (buffer_is_equal_string(du->key, CONST_STR_LEN("trigger-before-download.gdbm-filename"))) {
 #if defined(HAVE_GDBM_H)
@@ -307,6 +338,8 @@ static int mod_trigger_b4_dl_patch_connection(server *srv, connection *con, plug
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 #undef PATCH
@@ -359,7 +392,7 @@ URIHANDLER_FUNC(mod_trigger_b4_dl_uri_handler) {
 	}
 
 	/* check if URL is a trigger -> insert IP into DB */
-	if ((n = pcre_exec(p->conf.trigger_regex, NULL, CONST_BUF_LEN(con->uri.path), 0, 0, ovec, 3 * N)) < 0) {
+	if ((n = pcre_exec(p->conf.trigger_regex, p->conf.trigger_regex_extra, CONST_BUF_LEN(con->uri.path), 0, 0, ovec, 3 * N)) < 0) {
 		if (n != PCRE_ERROR_NOMATCH) {
 			log_error_write(srv, __FILE__, __LINE__, "sd",
 					"execution error while matching:", n);
@@ -411,7 +444,7 @@ URIHANDLER_FUNC(mod_trigger_b4_dl_uri_handler) {
 	}
 
 	/* check if URL is a download -> check IP in DB, update timestamp */
-	if ((n = pcre_exec(p->conf.download_regex, NULL, CONST_BUF_LEN(con->uri.path), 0, 0, ovec, 3 * N)) < 0) {
+	if ((n = pcre_exec(p->conf.download_regex, p->conf.download_regex_extra, CONST_BUF_LEN(con->uri.path), 0, 0, ovec, 3 * N)) < 0) {
 		if (n != PCRE_ERROR_NOMATCH) {
 			log_error_write(srv, __FILE__, __LINE__, "sd",
 					"execution error while matching: ", n);
@@ -14,33 +14,48 @@
 /**
  * this is a uploadprogress for a lighttpd plugin
  *
+ * uploads are looked up by their X-Progress-ID in a hash; after an
+ * upload finished its size is kept for upload-progress.remove-timeout
+ * seconds (default 60) so the last polls still see the final state.
  */
 
-typedef struct {
+typedef struct connection_map_entry {
+	struct connection_map_entry *next;
+
 	buffer     *con_id;
-	connection *con;
+	size_t      hash;
+	connection *con;     /* NULL once the upload is done */
+
+	/* the state of a finished upload */
+	off_t       size;
+	off_t       received;
+	time_t      expires;
 } connection_map_entry;
 
 typedef struct {
-	connection_map_entry **ptr;
-
-	size_t used;
+	connection_map_entry **ptr; /* hash buckets */
 	size_t size;
+	size_t used;
+
+	connection_map_entry *unused; /* free entries, for reuse */
 } connection_map;
 
 /* plugin config for all request/connections */
 
 typedef struct {
 	buffer *progress_url;
+	unsigned short remove_timeout;
 } plugin_config;
 
 typedef struct {
 	PLUGIN_DATA;
 
 	connection_map *con_map;
+	time_t last_cleanup;
 
 	plugin_config **config_storage;
 
+	config_snapshots *snapshots;
 	plugin_config conf;
 } plugin_data;
 
@@ -55,99 +70,134 @@ static connection_map *connection_map_init() {
 	connection_map *cm;
 
 	cm = calloc(1, sizeof(*cm));
+	force_assert(NULL != cm);
+
+	cm->size = 64;
+	cm->ptr = calloc(cm->size, sizeof(*(cm->ptr)));
+	force_assert(NULL != cm->ptr);
 
 	return cm;
 }
 
+static void connection_map_entry_free(connection_map_entry *cme) {
+	buffer_free(cme->con_id);
+	free(cme);
+}
+
 static void connection_map_free(connection_map *cm) {
+	connection_map_entry *cme, *next;
 	size_t i;
-	for (i = 0; i < cm->size; i++) {
-		connection_map_entry *cme = cm->ptr[i];
-
-		if (!cme) break;
 
-		if (cme->con_id) {
-			buffer_free(cme->con_id);
+	for (i = 0; i < cm->size; i++) {
+		for (cme = cm->ptr[i]; cme; cme = next) {
+			next = cme->next;
+			connection_map_entry_free(cme);
 		}
-		free(cme);
 	}
 
+	for (cme = cm->unused; cme; cme = next) {
+		next = cme->next;
+		connection_map_entry_free(cme);
+	}
+
+	free(cm->ptr);
 	free(cm);
 }
 
-static int connection_map_insert(connection_map *cm, connection *con, buffer *con_id) {
-	connection_map_entry *cme;
-	size_t i;
+static size_t connection_map_hash(const buffer *con_id) {
+	size_t i, h = 5381;
 
-	if (cm->size == 0) {
-		cm->size = 16;
-		cm->ptr = malloc(cm->size * sizeof(*(cm->ptr)));
-		for (i = 0; i < cm->size; i++) {
-			cm->ptr[i] = NULL;
-		}
-	} else if (cm->used == cm->size) {
-		cm->size += 16;
-		cm->ptr = realloc(cm->ptr, cm->size * sizeof(*(cm->ptr)));
-		for (i = cm->used; i < cm->size; i++) {
-			cm->ptr[i] = NULL;
-		}
+	for (i = 0; i < buffer_string_length(con_id); i++) {
+		h = ((h << 5) + h) ^ (unsigned char)con_id->ptr[i];
 	}
 
-	if (cm->ptr[cm->used]) {
-		/* is already alloced, just reuse it */
-		cme = cm->ptr[cm->used];
-	} else {
-		cme = malloc(sizeof(*cme));
-	}
-	cme->con_id = buffer_init();
-	buffer_copy_buffer(cme->con_id, con_id);
-	cme->con = con;
+	return h;
+}
 
-	cm->ptr[cm->used++] = cme;
+static connection_map_entry *connection_map_get(connection_map *cm, const buffer *con_id) {
+	size_t h = connection_map_hash(con_id);
+	connection_map_entry *cme;
 
-	return 0;
-}
+	for (cme = cm->ptr[h % cm->size]; cme; cme = cme->next) {
+		if (cme->hash == h && buffer_is_equal(cme->con_id, con_id)) return cme;
+	}
 
-static connection *connection_map_get_connection(connection_map *cm, buffer *con_id) {
-	size_t i;
+	return NULL;
+}
 
-	for (i = 0; i < cm->used; i++) {
-		connection_map_entry *cme = cm->ptr[i];
+static void connection_map_grow(connection_map *cm) {
+	size_t i, size = cm->size * 2;
+	connection_map_entry **ptr = calloc(size, sizeof(*ptr));
 
-		if (buffer_is_equal(cme->con_id, con_id)) {
-			/* found connection */
+	force_assert(NULL != ptr);
 
-			return cme->con;
+	for (i = 0; i < cm->size; i++) {
+		connection_map_entry *cme, *next;
+		for (cme = cm->ptr[i]; cme; cme = next) {
+			next = cme->next;
+			cme->next = ptr[cme->hash % size];
+			ptr[cme->hash % size] = cme;
 		}
 	}
-	return NULL;
+
+	free(cm->ptr);
+	cm->ptr = ptr;
+	cm->size = size;
 }
 
-static int connection_map_remove_connection(connection_map *cm, connection *con) {
-	size_t i;
+/* the entry for con_id, (re)assigned to con */
+static connection_map_entry *connection_map_insert(connection_map *cm, connection *con, const buffer *con_id) {
+	connection_map_entry *cme;
+
+	if (NULL != (cme = connection_map_get(cm, con_id))) {
+		/* a new upload with the same id takes over */
+		cme->con = con;
+		return cme;
+	}
 
-	for (i = 0; i < cm->used; i++) {
-		connection_map_entry *cme = cm->ptr[i];
+	if (cm->used >= cm->size) connection_map_grow(cm);
 
-		if (cme->con == con) {
-			/* found connection */
+	if (NULL != cm->unused) {
+		/* is already alloced, just reuse it */
+		cme = cm->unused;
+		cm->unused = cme->next;
+	} else {
+		cme = calloc(1, sizeof(*cme));
+		force_assert(NULL != cme);
+		cme->con_id = buffer_init();
+	}
+	buffer_copy_buffer(cme->con_id, con_id);
+	cme->hash = connection_map_hash(con_id);
+	cme->con = con;
 
-			buffer_reset(cme->con_id);
-			cme->con = NULL;
+	cme->next = cm->ptr[cme->hash % cm->size];
+	cm->ptr[cme->hash % cm->size] = cme;
+	cm->used++;
 
-			cm->used--;
+	return cme;
+}
 
-			/* swap positions with the last entry */
-			if (cm->used) {
-				cm->ptr[i] = cm->ptr[cm->used];
-				cm->ptr[cm->used] = cme;
-			}
+/* drop the finished uploads nobody asked for in time */
+static void connection_map_cleanup(connection_map *cm, time_t now) {
+	size_t i;
 
-			return 1;
+	for (i = 0; i < cm->size; i++) {
+		connection_map_entry **pcme = &(cm->ptr[i]);
+
+		while (*pcme) {
+			connection_map_entry *cme = *pcme;
+
+			if (NULL == cme->con && cme->expires <= now) {
+				*pcme = cme->next;
+				buffer_reset(cme->con_id);
+				cme->next = cm->unused;
+				cm->unused = cme;
+				cm->used--;
+			} else {
+				pcme = &(cme->next);
+			}
 		}
 	}
-
-	return 0;
 }
 
 /* init the plugin data */
@@ -185,6 +235,8 @@ FREE_FUNC(mod_uploadprogress_free) {
 
 	connection_map_free(p->con_map);
 
+	config_snapshots_free(p->snapshots);
+
 	free(p);
 
 	return HANDLER_GO_ON;
@@ -198,6 +250,7 @@ SETDEFAULTS_FUNC(mod_uploadprogress_set_defaults) {
 
 	config_values_t cv[] = {
 		{ "upload-progress.progress-url", NULL, T_CONFIG_STRING, T_CONFIG_SCOPE_CONNECTION },       /* 0 */
+		{ "upload-progress.remove-timeout", NULL, T_CONFIG_SHORT, T_CONFIG_SCOPE_CONNECTION },      /* 1 */
 		{ NULL,                         NULL, T_CONFIG_UNSET, T_CONFIG_SCOPE_UNSET }
 	};
 
@@ -211,8 +264,10 @@ SETDEFAULTS_FUNC(mod_uploadprogress_set_defaults) {
 
 		s = calloc(1, sizeof(plugin_config));
 		s->progress_url    = buffer_init();
+		s->remove_timeout  = 60;
 
 		cv[0].destination = s->progress_url;
+		cv[1].destination = &(s->remove_timeout);
 
 		p->config_storage[i] = s;
 
@@ -221,6 +276,8 @@ SETDEFAULTS_FUNC(mod_uploadprogress_set_defaults) {
 		}
 	}
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 }
 
@@ -230,7 +287,10 @@ static int mod_uploadprogress_patch_connection(server *srv, connection *con, plu
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH(progress_url);
+	PATCH(remove_timeout);
 
 	/* skip the first, the global context */
 	for (i = 1; i < srv->config_context->used; i++) {
@@ -246,10 +306,14 @@ static int mod_uploadprogress_patch_connection(server *srv, connection *con, plu
 
 			if (buffer_is_equal_string(du->key, CONST_STR_LEN("upload-progress.progress-url"))) {
 				PATCH(progress_url);
+			} else if (buffer_is_equal_string(du->key, CONST_STR_LEN("upload-progress.remove-timeout"))) {
+				PATCH(remove_timeout);
 			}
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 #undef PATCH
@@ -277,7 +341,8 @@ URIHANDLER_FUNC(mod_uploadprogress_uri_handler) {
 	size_t i;
 	data_string *ds;
 	buffer *b;
-	connection *post_con = NULL;
+	connection_map_entry *cme;
+	off_t size, received;
 
 	UNUSED(srv);
 
@@ -317,7 +382,16 @@ URIHANDLER_FUNC(mod_uploadprogress_uri_handler) {
 			}
 		}
 
-		connection_map_insert(p->con_map, con, b);
+		cme = connection_map_insert(p->con_map, con, b);
+		if (con->plugin_ctx[p->id] != cme) {
+			connection_map_entry *prev = con->plugin_ctx[p->id];
+			/* the connection registered under another id before */
+			if (NULL != prev && prev->con == con) {
+				prev->con = NULL;
+				prev->expires = srv->cur_ts;
+			}
+			con->plugin_ctx[p->id] = cme;
+		}
 
 		return HANDLER_GO_ON;
 	case HTTP_METHOD_GET:
@@ -361,11 +435,11 @@ URIHANDLER_FUNC(mod_uploadprogress_uri_handler) {
 		con->mode = DIRECT;
 
 		/* get the connection */
-		if (NULL == (post_con = connection_map_get_connection(p->con_map, b))) {
+		if (NULL == (cme = connection_map_get(p->con_map, b))) {
 			log_error_write(srv, __FILE__, __LINE__, "sb",
 					"ID no known:", b);
 
-			chunkqueue_get_append_mem(con->write_queue, CONST_STR_LEN("starting"));
+			chunkqueue_append_mem(con->write_queue, CONST_STR_LEN("starting"));
 
 			return HANDLER_FINISHED;
 		}
@@ -377,6 +451,14 @@ URIHANDLER_FUNC(mod_uploadprogress_uri_handler) {
 		response_header_overwrite(srv, con, CONST_STR_LEN("Expires"), CONST_STR_LEN("Thu, 19 Nov 1981 08:52:00 GMT"));
 		response_header_overwrite(srv, con, CONST_STR_LEN("Cache-Control"), CONST_STR_LEN("no-store, no-cache, must-revalidate, post-check=0, pre-check=0"));
 
+		if (NULL != cme->con) {
+			size = cme->con->request.content_length;
+			received = cme->con->request_content_queue->bytes_in;
+		} else {
+			size = cme->size;
+			received = cme->received;
+		}
+
 		b = buffer_init();
 
 		/* prepare XML */
@@ -384,11 +466,11 @@ URIHANDLER_FUNC(mod_uploadprogress_uri_handler) {
 			"<?xml version=\"1.0\" encoding=\"iso-8859-1\"?>"
 			"<upload>"
 			"<size>"));
-		buffer_append_int(b, post_con->request.content_length);
+		buffer_append_int(b, size);
 		buffer_append_string_len(b, CONST_STR_LEN(
 			"</size>"
 			"<received>"));
-		buffer_append_int(b, post_con->request_content_queue->bytes_in);
+		buffer_append_int(b, received);
 		buffer_append_string_len(b, CONST_STR_LEN(
 			"</received>"
 			"</upload>"));
@@ -408,16 +490,34 @@ URIHANDLER_FUNC(mod_uploadprogress_uri_handler) {
 	return HANDLER_GO_ON;
 }
 
-REQUESTDONE_FUNC(mod_uploadprogress_request_done) {
+/* keep the final state of the upload around for a while */
+static handler_t mod_uploadprogress_release(server *srv, connection *con, void *p_d) {
 	plugin_data *p = p_d;
+	connection_map_entry *cme = con->plugin_ctx[p->id];
 
-	UNUSED(srv);
+	if (NULL == cme) return HANDLER_GO_ON;
+	con->plugin_ctx[p->id] = NULL;
 
-	if (con->uri.path->used == 0) return HANDLER_GO_ON;
+	/* another upload took the id over */
+	if (cme->con != con) return HANDLER_GO_ON;
 
-	if (connection_map_remove_connection(p->con_map, con)) {
-		/* removed */
-	}
+	mod_uploadprogress_patch_connection(srv, con, p);
+
+	cme->size = con->request.content_length;
+	cme->received = con->request_content_queue->bytes_in;
+	cme->expires = srv->cur_ts + p->conf.remove_timeout;
+	cme->con = NULL;
+
+	return HANDLER_GO_ON;
+}
+
+TRIGGER_FUNC(mod_uploadprogress_trigger) {
+	plugin_data *p = p_d;
+
+	if (srv->cur_ts == p->last_cleanup) return HANDLER_GO_ON;
+	p->last_cleanup = srv->cur_ts;
+
+	connection_map_cleanup(p->con_map, srv->cur_ts);
 
 	return HANDLER_GO_ON;
 }
@@ -431,7 +531,10 @@ int mod_uploadprogress_plugin_init(plugin *p) {
 
 	p->init        = mod_uploadprogress_init;
 	p->handle_uri_clean  = mod_uploadprogress_uri_handler;
-	p->handle_request_done  = mod_uploadprogress_request_done;
+	p->handle_request_done  = mod_uploadprogress_release;
+	p->handle_connection_close = mod_uploadprogress_release;
+	p->connection_reset = mod_uploadprogress_release;
+	p->handle_trigger = mod_uploadprogress_trigger;
 	p->set_defaults  = mod_uploadprogress_set_defaults;
 	p->cleanup     = mod_uploadprogress_free;
 
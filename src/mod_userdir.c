@@ -33,6 +33,7 @@ typedef struct {
 
 	plugin_config **config_storage;
 
+	config_snapshots *snapshots;
 	plugin_config conf;
 } plugin_data;
 
@@ -75,6 +76,8 @@ FREE_FUNC(mod_userdir_free) {
 	buffer_free(p->username);
 	buffer_free(p->temp_path);
 
+	config_snapshots_free(p->snapshots);
+
 	free(p);
 
 	return HANDLER_GO_ON;
@@ -128,6 +131,8 @@ SETDEFAULTS_FUNC(mod_userdir_set_defaults) {
 		}
 	}
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 }
 
@@ -137,6 +142,8 @@ static int mod_userdir_patch_connection(server *srv, connection *con, plugin_dat
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH(path);
 	PATCH(exclude_user);
 	PATCH(include_user);
@@ -172,6 +179,8 @@ static int mod_userdir_patch_connection(server *srv, connection *con, plugin_dat
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 #undef PATCH
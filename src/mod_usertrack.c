@@ -23,6 +23,7 @@ typedef struct {
 
 	plugin_config **config_storage;
 
+	config_snapshots *snapshots;
 	plugin_config conf;
 } plugin_data;
 
@@ -58,6 +59,8 @@ FREE_FUNC(mod_usertrack_free) {
 		free(p->config_storage);
 	}
 
+	config_snapshots_free(p->snapshots);
+
 	free(p);
 
 	return HANDLER_GO_ON;
@@ -132,6 +135,8 @@ SETDEFAULTS_FUNC(mod_usertrack_set_defaults) {
 		}
 	}
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 }
 
@@ -141,6 +146,8 @@ static int mod_usertrack_patch_connection(server *srv, connection *con, plugin_d
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH(cookie_name);
 	PATCH(cookie_domain);
 	PATCH(cookie_max_age);
@@ -167,6 +174,8 @@ static int mod_usertrack_patch_connection(server *srv, connection *con, plugin_d
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 #undef PATCH
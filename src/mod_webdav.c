@@ -83,6 +83,7 @@ typedef struct {
 
 	plugin_config **config_storage;
 
+	config_snapshots *snapshots;
 	plugin_config conf;
 } plugin_data;
 
@@ -158,6 +159,8 @@ FREE_FUNC(mod_webdav_free) {
 
 	buffer_free(p->tmp_buf);
 
+	config_snapshots_free(p->snapshots);
+
 	free(p);
 
 	return HANDLER_GO_ON;
@@ -369,6 +372,8 @@ SETDEFAULTS_FUNC(mod_webdav_set_defaults) {
 		}
 	}
 
+	p->snapshots = config_snapshots_init(srv, cv, sizeof(p->conf));
+
 	return HANDLER_GO_ON;
 }
 
@@ -378,6 +383,8 @@ static int mod_webdav_patch_connection(server *srv, connection *con, plugin_data
 	size_t i, j;
 	plugin_config *s = p->config_storage[0];
 
+	if (config_snapshot_get(srv, con, p->snapshots, &p->conf)) return 0;
+
 	PATCH_OPTION(enabled);
 	PATCH_OPTION(is_readonly);
 	PATCH_OPTION(log_xml);
@@ -439,6 +446,8 @@ static int mod_webdav_patch_connection(server *srv, connection *con, plugin_data
 		}
 	}
 
+	config_snapshot_put(p->snapshots, &p->conf);
+
 	return 0;
 }
 
@@ -1038,16 +1047,17 @@ static int webdav_parse_chunkqueue(server *srv, connection *con, plugin_data *p,
 
 			break;
 		case MEM_CHUNK:
+		case SHARED_CHUNK: {
 			/* append to the buffer */
-			weHave = buffer_string_length(c->mem) - c->offset;
+			const char *data = chunk_mem_data(c, &weHave);
 
 			if (weHave > weWant) weHave = weWant;
 
 			if (p->conf.log_xml) {
-				log_error_write(srv, __FILE__, __LINE__, "ss", "XML-request-body:", c->mem->ptr + c->offset);
+				log_error_write(srv, __FILE__, __LINE__, "ss", "XML-request-body:", data);
 			}
 
-			if (XML_ERR_OK != (err = xmlParseChunk(ctxt, c->mem->ptr + c->offset, weHave, 0))) {
+			if (XML_ERR_OK != (err = xmlParseChunk(ctxt, data, weHave, 0))) {
 				log_error_write(srv, __FILE__, __LINE__, "sodd", "xmlParseChunk failed at:", cq->bytes_out, weHave, err);
 			}
 
@@ -1055,6 +1065,7 @@ static int webdav_parse_chunkqueue(server *srv, connection *con, plugin_data *p,
 
 			break;
 		}
+		}
 	}
 
 	switch ((err = xmlParseChunk(ctxt, 0, 0, 1))) {
@@ -1215,6 +1226,21 @@ URIHANDLER_FUNC(mod_webdav_subrequest_handler) {
 	/* physical path is setup */
 	if (buffer_is_empty(con->physical.path)) return HANDLER_GO_ON;
 
+	if (con->state == CON_STATE_READ_POST) {
+		switch (con->request.http_method) {
+		case HTTP_METHOD_PROPFIND:
+		case HTTP_METHOD_PROPPATCH:
+		case HTTP_METHOD_PUT:
+		case HTTP_METHOD_LOCK:
+			/* we need the complete request body,
+			 * let the physical path be built again once it is there */
+			buffer_reset(con->physical.path);
+			return HANDLER_WAIT_FOR_EVENT;
+		default:
+			break;
+		}
+	}
+
 	/* PROPFIND need them */
 	if (NULL != (ds = (data_string *)array_get_element(con->request.headers, "Depth"))) {
 		depth = strtol(ds->value->ptr, NULL, 10);
@@ -1746,7 +1772,11 @@ URIHANDLER_FUNC(mod_webdav_subrequest_handler) {
 				}
 				break;
 			case MEM_CHUNK:
-				if ((r = write(fd, c->mem->ptr + c->offset, buffer_string_length(c->mem) - c->offset)) < 0) {
+			case SHARED_CHUNK: {
+				size_t len;
+				const char *data = chunk_mem_data(c, &len);
+
+				if ((r = write(fd, data, len)) < 0) {
 					switch(errno) {
 					case ENOSPC:
 						con->http_status = 507;
@@ -1759,6 +1789,7 @@ URIHANDLER_FUNC(mod_webdav_subrequest_handler) {
 				}
 				break;
 			}
+			}
 
 			if (r > 0) {
 				chunkqueue_mark_written(cq, r);
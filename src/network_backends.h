@@ -75,11 +75,11 @@ int network_write_chunkqueue_openssl(server *srv, connection *con, SSL *ssl, chu
 
 /* write next chunk(s); finished chunks are removed afterwards after successful writes.
  * return values: similar as backends (0 succes, -1 error, -2 remote close, -3 try again later (EINTR/EAGAIN)) */
-/* next chunk must be MEM_CHUNK. use write()/send() */
+/* next chunk must be MEM_CHUNK or SHARED_CHUNK. use write()/send() */
 int network_write_mem_chunk(server *srv, connection *con, int fd, chunkqueue *cq, off_t *p_max_bytes);
 
 #if defined(USE_WRITEV)
-/* next chunk must be MEM_CHUNK. send multiple mem chunks using writev() */
+/* next chunk must be MEM_CHUNK or SHARED_CHUNK. send multiple mem chunks using writev() */
 int network_writev_mem_chunks(server *srv, connection *con, int fd, chunkqueue *cq, off_t *p_max_bytes);
 #else
 /* fallback to write()/send() */
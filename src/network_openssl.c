@@ -32,15 +32,13 @@ static int load_next_chunk(server *srv, connection *con, chunkqueue *cq, off_t m
 
 	switch (c->type) {
 	case MEM_CHUNK:
+	case SHARED_CHUNK:
 		{
 			size_t have;
 
-			force_assert(c->offset >= 0 && c->offset <= (off_t)buffer_string_length(c->mem));
-
-			have = buffer_string_length(c->mem) - c->offset;
+			*data = chunk_mem_data(c, &have);
 			if ((off_t) have > max_bytes) have = max_bytes;
 
-			*data = c->mem->ptr + c->offset;
 			*data_len = have;
 		}
 		return 0;
@@ -12,15 +12,17 @@
 
 int network_write_mem_chunk(server *srv, connection *con, int fd, chunkqueue *cq, off_t *p_max_bytes) {
 	chunk* const c = cq->first;
+	const char *data;
+	size_t data_len;
 	off_t c_len;
 	ssize_t r;
 	UNUSED(con);
 
 	force_assert(NULL != c);
-	force_assert(MEM_CHUNK == c->type);
-	force_assert(c->offset >= 0 && c->offset <= (off_t)buffer_string_length(c->mem));
+	force_assert(MEM_CHUNK == c->type || SHARED_CHUNK == c->type);
 
-	c_len = buffer_string_length(c->mem) - c->offset;
+	data = chunk_mem_data(c, &data_len);
+	c_len = data_len;
 	if (c_len > *p_max_bytes) c_len = *p_max_bytes;
 
 	if (0 == c_len) {
@@ -29,7 +31,7 @@ int network_write_mem_chunk(server *srv, connection *con, int fd, chunkqueue *cq
 	}
 
 #if defined(__WIN32)
-	if ((r = send(fd, c->mem->ptr + c->offset, c_len, 0)) < 0) {
+	if ((r = send(fd, data, c_len, 0)) < 0) {
 		int lastError = WSAGetLastError();
 		switch (lastError) {
 		case WSAEINTR:
@@ -46,7 +48,7 @@ int network_write_mem_chunk(server *srv, connection *con, int fd, chunkqueue *cq
 		}
 	}
 #else /* __WIN32 */
-	if ((r = write(fd, c->mem->ptr + c->offset, c_len)) < 0) {
+	if ((r = write(fd, data, c_len)) < 0) {
 		switch (errno) {
 		case EAGAIN:
 		case EINTR:
@@ -76,6 +78,7 @@ int network_write_chunkqueue_write(server *srv, connection *con, int fd, chunkqu
 
 		switch (cq->first->type) {
 		case MEM_CHUNK:
+		case SHARED_CHUNK:
 			r = network_write_mem_chunk(srv, con, fd, cq, &max_bytes);
 			break;
 		case FILE_CHUNK:
@@ -96,6 +99,7 @@ int network_write_chunkqueue_sendfile(server *srv, connection *con, int fd, chun
 
 		switch (cq->first->type) {
 		case MEM_CHUNK:
+		case SHARED_CHUNK:
 			r = network_writev_mem_chunks(srv, con, fd, cq, &max_bytes);
 			break;
 		case FILE_CHUNK:
@@ -28,6 +28,16 @@ int network_open_file_chunk(server *srv, connection *con, chunkqueue *cq) {
 	offset = c->file.start + c->offset;
 	toSend = c->file.length - c->offset;
 
+	if (-1 == c->file.fd && c->file.is_temp) {
+		/* tempfiles are used once and unlinked by chunk_reset(); keep them
+		 * out of the stat cache, a cached fd would hold the deleted file */
+		if (-1 == (c->file.fd = open(c->file.name->ptr, O_RDONLY|O_NOCTTY))) {
+			log_error_write(srv, __FILE__, __LINE__, "ssb", "open failed:", strerror(errno), c->file.name);
+			return -1;
+		}
+		fd_close_on_exec(c->file.fd);
+	}
+
 	if (-1 == c->file.fd) {
 		stat_cache_entry *sce = NULL;
 
@@ -36,11 +46,15 @@ int network_open_file_chunk(server *srv, connection *con, chunkqueue *cq) {
 			return -1;
 		}
 
-		if (-1 == (c->file.fd = open(c->file.name->ptr, O_RDONLY|O_NOCTTY))) {
+		/* share the fd kept open in the stat cache */
+		if (NULL != (c->file.fdref = stat_cache_entry_get_fd(srv, sce))) {
+			c->file.fd = c->file.fdref->fd;
+		} else if (-1 == (c->file.fd = open(c->file.name->ptr, O_RDONLY|O_NOCTTY))) {
 			log_error_write(srv, __FILE__, __LINE__, "ssb", "open failed:", strerror(errno), c->file.name);
 			return -1;
+		} else {
+			fd_close_on_exec(c->file.fd);
 		}
-		fd_close_on_exec(c->file.fd);
 
 		file_size = sce->st.st_size;
 	} else {
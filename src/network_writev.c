@@ -45,22 +45,21 @@ int network_writev_mem_chunks(server *srv, connection *con, int fd, chunkqueue *
 	UNUSED(con);
 
 	force_assert(NULL != cq->first);
-	force_assert(MEM_CHUNK == cq->first->type);
+	force_assert(MEM_CHUNK == cq->first->type || SHARED_CHUNK == cq->first->type);
 
 	{
 		chunk const *c;
 
 		toSend = 0;
 		num_chunks = 0;
-		for (c = cq->first; NULL != c && MEM_CHUNK == c->type && num_chunks < MAX_CHUNKS && toSend < max_bytes; c = c->next) {
+		for (c = cq->first; NULL != c && (MEM_CHUNK == c->type || SHARED_CHUNK == c->type) && num_chunks < MAX_CHUNKS && toSend < max_bytes; c = c->next) {
 			size_t c_len;
+			const char *data = chunk_mem_data(c, &c_len);
 
-			force_assert(c->offset >= 0 && c->offset <= (off_t)buffer_string_length(c->mem));
-			c_len = buffer_string_length(c->mem) - c->offset;
 			if (c_len > 0) {
 				toSend += c_len;
 
-				chunks[num_chunks].iov_base = c->mem->ptr + c->offset;
+				chunks[num_chunks].iov_base = (char *)data;
 				chunks[num_chunks].iov_len = c_len;
 
 				++num_chunks;
@@ -104,6 +103,7 @@ int network_write_chunkqueue_writev(server *srv, connection *con, int fd, chunkq
 
 		switch (cq->first->type) {
 		case MEM_CHUNK:
+		case SHARED_CHUNK:
 			r = network_writev_mem_chunks(srv, con, fd, cq, &max_bytes);
 			break;
 		case FILE_CHUNK:
@@ -88,5 +88,11 @@ int config_setup_connection(server *srv, connection *con);
 int config_patch_connection(server *srv, connection *con, comp_key_t comp);
 int config_check_cond(server *srv, connection *con, data_config *dc);
 int config_append_cond_match_buffer(connection *con, data_config *dc, buffer *buf, int n);
+const buffer *pcre_result_cache_key(connection *con, data_config *context, const pcre_rule_index *ri, const buffer *url, buffer *key);
+
+config_snapshots *config_snapshots_init(server *srv, const config_values_t *cv, size_t conf_size);
+void config_snapshots_free(config_snapshots *cs);
+int config_snapshot_get(server *srv, connection *con, config_snapshots *cs, void *conf);
+void config_snapshot_put(config_snapshots *cs, const void *conf);
 
 #endif
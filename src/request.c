@@ -733,7 +733,6 @@ int http_request_parse(server *srv, connection *con) {
 					con->parse_request->ptr[i+1] = '\0';
 
 					if (in_folding) {
-						buffer *key_b;
 						/**
 						 * we use a evil hack to handle the line-folding
 						 * 
@@ -761,14 +760,12 @@ int http_request_parse(server *srv, connection *con) {
 							return 0;
 						}
 
-						key_b = buffer_init();
-						buffer_copy_string_len(key_b, key, key_len);
+						/* only needed for the lookup, one scratch buffer for all continuation lines */
+						buffer_copy_string_len(srv->tmp_buf, key, key_len);
 
-						if (NULL != (ds = (data_string *)array_get_element(con->request.headers, key_b->ptr))) {
+						if (NULL != (ds = (data_string *)array_get_element(con->request.headers, srv->tmp_buf->ptr))) {
 							buffer_append_string(ds->value, value);
 						}
-
-						buffer_free(key_b);
 					} else {
 						int s_len;
 						key = con->parse_request->ptr + first;
@@ -991,6 +988,35 @@ int http_request_parse(server *srv, connection *con) {
 									array_insert_unique(con->request.headers, (data_unset *)ds);
 									return 0;
 								}
+							} else if (cmp > 0 && 0 == (cmp = buffer_caseless_compare(CONST_BUF_LEN(ds->key), CONST_STR_LEN("Transfer-Encoding")))) {
+								if (con->request.te_chunked) {
+									con->http_status = 400;
+									con->keep_alive = 0;
+
+									if (srv->srvconf.log_request_header_on_error) {
+										log_error_write(srv, __FILE__, __LINE__, "s",
+												"duplicate Transfer-Encoding-header -> 400");
+										log_error_write(srv, __FILE__, __LINE__, "Sb",
+												"request-header:\n",
+												con->request.request);
+									}
+									array_insert_unique(con->request.headers, (data_unset *)ds);
+									return 0;
+								}
+
+								/* we only know how to decode "chunked" */
+								if (0 != buffer_caseless_compare(CONST_BUF_LEN(ds->value), CONST_STR_LEN("chunked"))) {
+									log_error_write(srv, __FILE__, __LINE__, "sbs",
+											"unsupported Transfer-Encoding:", ds->value, "-> 501");
+
+									con->http_status = 501;
+									con->keep_alive = 0;
+
+									array_insert_unique(con->request.headers, (data_unset *)ds);
+									return 0;
+								}
+
+								con->request.te_chunked = TE_CHUNKED_SIZE;
 							}
 
 							if (ds) array_insert_unique(con->request.headers, (data_unset *)ds);
@@ -1103,11 +1129,32 @@ int http_request_parse(server *srv, connection *con) {
 		return 0;
 	}
 
+	if (con->request.te_chunked) {
+		/* RFC 7230 3.3.3: a message with both is most likely a smuggling attempt */
+		if (con_length_set) {
+			log_error_write(srv, __FILE__, __LINE__, "s",
+					"Content-Length and Transfer-Encoding: chunked -> 400");
+
+			con->keep_alive = 0;
+			con->http_status = 400;
+			return 0;
+		}
+
+		if (con->request.http_version != HTTP_VERSION_1_1) {
+			log_error_write(srv, __FILE__, __LINE__, "s",
+					"Transfer-Encoding: chunked in HTTP/1.0 request -> 400");
+
+			con->keep_alive = 0;
+			con->http_status = 400;
+			return 0;
+		}
+	}
+
 	switch(con->request.http_method) {
 	case HTTP_METHOD_GET:
 	case HTTP_METHOD_HEAD:
 		/* content-length is forbidden for those */
-		if (con_length_set && con->request.content_length != 0) {
+		if ((con_length_set && con->request.content_length != 0) || con->request.te_chunked) {
 			/* content-length is missing */
 			log_error_write(srv, __FILE__, __LINE__, "s",
 					"GET/HEAD with content-length -> 400");
@@ -1119,7 +1166,7 @@ int http_request_parse(server *srv, connection *con) {
 		break;
 	case HTTP_METHOD_POST:
 		/* content-length is required for them */
-		if (!con_length_set) {
+		if (!con_length_set && !con->request.te_chunked) {
 			/* content-length is missing */
 			log_error_write(srv, __FILE__, __LINE__, "s",
 					"POST-request, but content-length missing -> 411");
@@ -1136,6 +1183,9 @@ int http_request_parse(server *srv, connection *con) {
 	}
 
 
+	/* the length of a chunked body is only known once it is read completely */
+	if (con->request.te_chunked) return 1;
+
 	/* check if we have read post data */
 	if (con_length_set) {
 		/* don't handle more the SSIZE_MAX bytes in content-length */
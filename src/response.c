@@ -33,7 +33,8 @@ int http_response_write_header(server *srv, connection *con) {
 	int have_date = 0;
 	int have_server = 0;
 
-	b = buffer_init();
+	/* reuse the server-wide buffer; prepending it below moves the content into the write_queue */
+	b = srv->response_header;
 
 	if (con->request.http_version == HTTP_VERSION_1_1) {
 		buffer_copy_string_len(b, CONST_STR_LEN("HTTP/1.1 "));
@@ -108,12 +109,8 @@ int http_response_write_header(server *srv, connection *con) {
 	}
 
 	if (!have_server) {
-		if (buffer_is_empty(con->conf.server_tag)) {
-			buffer_append_string_len(b, CONST_STR_LEN("\r\nServer: " PACKAGE_DESC));
-		} else if (!buffer_string_is_empty(con->conf.server_tag)) {
-			buffer_append_string_len(b, CONST_STR_LEN("\r\nServer: "));
-			buffer_append_string_encoded(b, CONST_BUF_LEN(con->conf.server_tag), ENCODING_HTTP_HEADER);
-		}
+		/* empty if server.tag = "" */
+		buffer_append_string_buffer(b, con->conf.server_tag_header);
 	}
 
 	buffer_append_string_len(b, CONST_STR_LEN("\r\n\r\n"));
@@ -125,7 +122,6 @@ int http_response_write_header(server *srv, connection *con) {
 	}
 
 	chunkqueue_prepend_buffer(con->write_queue, b);
-	buffer_free(b);
 
 	return 0;
 }
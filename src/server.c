@@ -56,6 +56,10 @@
 # include <sys/prctl.h>
 #endif
 
+#ifdef HAVE_SYS_INOTIFY_H
+# include <sys/inotify.h>
+#endif
+
 #ifdef USE_OPENSSL
 # include <openssl/err.h> 
 #endif
@@ -194,6 +198,7 @@ static server *server_init(void) {
 	CLEAN(srvconf.bindhost);
 	CLEAN(srvconf.event_handler);
 	CLEAN(srvconf.pid_file);
+	CLEAN(srvconf.config_basedir);
 
 	CLEAN(tmp_chunk_len);
 #undef CLEAN
@@ -243,6 +248,11 @@ static server *server_init(void) {
 	srv->srvconf.network_backend = buffer_init();
 	srv->srvconf.upload_tempdirs = array_init();
 	srv->srvconf.reject_expect_100_with_417 = 1;
+	srv->srvconf.max_response_buffer = 256; /* kbytes */
+	srv->srvconf.stat_cache_max_entries = 65536;
+	srv->srvconf.stat_cache_max_fds = 256;
+	srv->srvconf.small_file_cache_memory = 4096; /* kbytes */
+	srv->srvconf.small_file_cache_max_size = 16; /* kbytes */
 
 	/* use syslog */
 	srv->errorlog_fd = STDERR_FILENO;
@@ -281,6 +291,7 @@ static void server_free(server *srv) {
 	CLEAN(srvconf.bindhost);
 	CLEAN(srvconf.event_handler);
 	CLEAN(srvconf.pid_file);
+	CLEAN(srvconf.config_basedir);
 	CLEAN(srvconf.modules_dir);
 	CLEAN(srvconf.network_backend);
 
@@ -303,6 +314,7 @@ static void server_free(server *srv) {
 			buffer_free(s->document_root);
 			buffer_free(s->server_name);
 			buffer_free(s->server_tag);
+			buffer_free(s->server_tag_header);
 			buffer_free(s->ssl_pemfile);
 			buffer_free(s->ssl_ca_file);
 			buffer_free(s->ssl_cipher_list);
@@ -324,6 +336,13 @@ static void server_free(server *srv) {
 		srv->config_storage = NULL;
 	}
 
+	config_snapshots_free(srv->config_snapshots);
+
+	for (i = 0; i < srv->config_host_index_used; i++) {
+		array_free(srv->config_host_index[i]);
+	}
+	free(srv->config_host_index);
+
 #define CLEAN(x) \
 	array_free(srv->x);
 
@@ -652,6 +671,9 @@ int main (int argc, char **argv) {
 		return -1;
 	}
 
+	/* divide by 1024 as srvconf.max_buffered_memory is in kBytes */
+	chunk_mem_set_limit((off_t)srv->srvconf.max_buffered_memory << 10);
+
 	/* UID handling */
 #ifdef HAVE_GETUID
 	if (!i_am_root && issetugid()) {
@@ -1145,6 +1167,7 @@ int main (int argc, char **argv) {
 			connections_free(srv);
 			plugins_free(srv);
 			server_free(srv);
+			chunk_pool_free();
 			return 0;
 		}
 	}
@@ -1199,6 +1222,20 @@ int main (int argc, char **argv) {
 		fdevent_event_set(srv->ev, &(srv->stat_cache->fam_fcce_ndx), FAMCONNECTION_GETFD(&srv->stat_cache->fam), FDEVENT_IN);
 	}
 #endif
+#ifdef HAVE_SYS_INOTIFY_H
+	/* setup inotify */
+	if (srv->srvconf.stat_cache_engine == STAT_CACHE_ENGINE_INOTIFY) {
+		if (-1 == (srv->stat_cache->notify_fd = inotify_init())) {
+			log_error_write(srv, __FILE__, __LINE__, "ss",
+					 "could not open an inotify instance, dieing:", strerror(errno));
+			return -1;
+		}
+
+		fdevent_fcntl_set(srv->ev, srv->stat_cache->notify_fd);
+		fdevent_register(srv->ev, srv->stat_cache->notify_fd, stat_cache_handle_inotify_fdevent, NULL);
+		fdevent_event_set(srv->ev, &(srv->stat_cache->notify_fde_ndx), srv->stat_cache->notify_fd, FDEVENT_IN);
+	}
+#endif
 
 
 	/* get the current number of FDs */
@@ -1286,8 +1323,6 @@ int main (int argc, char **argv) {
 				/* trigger waitpid */
 				srv->cur_ts = min_ts;
 
-				/* cleanup stat-cache */
-				stat_cache_trigger_cleanup(srv);
 				/**
 				 * check all connections for timeouts
 				 *
@@ -1547,6 +1582,9 @@ int main (int argc, char **argv) {
 		}
 
 		srv->joblist->used = 0;
+
+		/* expire a batch of idle stat-cache entries */
+		stat_cache_trigger_cleanup(srv);
 	}
 
 	if (!buffer_string_is_empty(srv->srvconf.pid_file) &&
@@ -1580,6 +1618,7 @@ int main (int argc, char **argv) {
 	connections_free(srv);
 	plugins_free(srv);
 	server_free(srv);
+	chunk_pool_free();
 
 	return 0;
 }
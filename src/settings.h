@@ -30,10 +30,33 @@
  */
 #define BUFFER_MAX_REUSE_SIZE  (4 * 1024)
 
+/**
+ * max number of buffers a buffer_pool keeps for the next request
+ */
+#define BUFFER_POOL_MAX_KEEP  16
+
+/**
+ * max number of merged configs cached per plugin, one for each
+ * combination of matching conditionals
+ */
+#define CONFIG_SNAPSHOTS_MAX  1024
+
+/**
+ * max number of urls for which the outcome of a url.rewrite* or
+ * url.redirect rule list is remembered, per rule list
+ */
+#define PCRE_RESULT_CACHE_MAX  1024
+
 /* both should be way smaller than SSIZE_MAX :) */
 #define MAX_READ_LIMIT (256*1024)
 #define MAX_WRITE_LIMIT (256*1024)
 
+/**
+ * with server.stream-request-body we stop reading the request body from
+ * the client while this much of it waits for the backend
+ */
+#define MAX_REQUEST_BODY_STREAM_BUFFER (256 * 1024)
+
 /**
  * max size of the HTTP request header
  *
@@ -26,6 +26,11 @@
 # include <fam.h>
 #endif
 
+#ifdef HAVE_SYS_INOTIFY_H
+# include <sys/inotify.h>
+# include <sys/vfs.h>
+#endif
+
 #include "sys-mmap.h"
 
 /* NetBSD 1.3.x needs it */
@@ -80,29 +85,64 @@ typedef struct {
 } fam_dir_entry;
 #endif
 
-/* the directory name is too long to always compare on it
- * - we need a hash
- * - the hash-key is used as sorting criteria for a tree
- * - a splay-tree is used as we can use the caching effect of it
+#ifdef HAVE_SYS_INOTIFY_H
+/* inotify watches the directories of the cached entries:
+ *
+ * - an event for a name in the directory invalidates the entries for that
+ *   name, and for the directory itself if its mtime changed
+ * - if the directory itself changes or goes away, its version and the
+ *   versions of the watched directories below it are incremented, which
+ *   invalidates all entries bound to them
+ *
+ * the parent directories are watched too, renaming one of them moves all
+ * directories below it.
+ *
+ * the entries are valid until one of these happens. The watch is released
+ * when the last entry (or directory) referencing the directory is gone.
+ *
+ * inotify only sees changes made through the local kernel: on network
+ * filesystems other clients change the files behind our back, the
+ * entries in such directories are stat()ed again every second like with
+ * the "simple" engine. So are symlinks: their target lives in a directory
+ * which isn't watched.
  */
+typedef struct stat_cache_notify_dir {
+	buffer *name;
+	struct stat_cache_notify_dir *parent;
+
+	int wd;          /* -1 once the kernel dropped the watch */
+	int version;
+	int aliased;     /* watched under more than one name, events by name are not precise */
+	int remote;      /* on a network filesystem, events don't cover changes by other clients */
+	size_t refcount; /* entries bound to the directory, and child directories */
+} stat_cache_notify_dir;
+
+#define STAT_CACHE_NOTIFY_MASK \
+	(IN_ATTRIB | IN_MODIFY | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | \
+	 IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+#endif
 
-/* we want to cleanup the stat-cache every few seconds, let's say 10
+/* the files are kept in a hash table keyed by the full name (and the
+ * follow-symlink setting), collisions are chained.
  *
- * - remove entries which are outdated since 30s
- * - remove entries which are fresh but havn't been used since 60s
- * - if we don't have a stat-cache entry for a directory, release it from the monitor
+ * all entries are also on a LRU list; every lookup moves the entry to the
+ * front, so the entries at the tail are the ones idle for the longest time:
+ *
+ * - stat_cache_trigger_cleanup() runs every loop iteration and removes a
+ *   bounded number of idle entries from the tail
+ * - server.stat-cache-max-entries bounds the table; a new entry reuses the
+ *   tail entry if the table is full
+ *
+ * the directories for FAM are in a splay-tree keyed by a hash of the name
  */
 
-#ifdef DEBUG_STAT_CACHE
-typedef struct {
-	int *ptr;
-
-	size_t used;
-	size_t size;
-} fake_keys;
+/* entries not looked up for this many seconds are removed; entries watched
+ * by inotify don't get stale and are kept longer */
+#define STAT_CACHE_MAX_IDLE 2
+#define STAT_CACHE_NOTIFY_MAX_IDLE 3600
 
-static fake_keys ctrl;
-#endif
+/* max. number of entries removed per loop iteration */
+#define STAT_CACHE_CLEANUP_BATCH 1024
 
 stat_cache *stat_cache_init(void) {
 	stat_cache *sc = NULL;
@@ -115,9 +155,9 @@ stat_cache *stat_cache_init(void) {
 #ifdef HAVE_FAM_H
 	sc->fam_fcce_ndx = -1;
 #endif
-
-#ifdef DEBUG_STAT_CACHE
-	ctrl.size = 0;
+#ifdef HAVE_SYS_INOTIFY_H
+	sc->notify_fd = -1;
+	sc->notify_fde_ndx = -1;
 #endif
 
 	return sc;
@@ -142,6 +182,8 @@ static void stat_cache_entry_free(void *data) {
 	buffer_free(sce->etag);
 	buffer_free(sce->name);
 	buffer_free(sce->content_type);
+	if (sce->content) chunk_shared_mem_unref(sce->content);
+	if (sce->fdref) chunk_file_fd_unref(sce->fdref);
 
 	free(sce);
 }
@@ -171,18 +213,171 @@ static void fam_dir_entry_free(FAMConnection *fc, void *data) {
 }
 #endif
 
+#if defined(HAVE_FAM_H) || defined(HAVE_SYS_INOTIFY_H)
+static int buffer_copy_dirname(buffer *dst, buffer *file) {
+	size_t i;
+
+	if (buffer_string_is_empty(file)) return -1;
+
+	for (i = buffer_string_length(file); i > 0; i--) {
+		if (file->ptr[i] == '/') {
+			buffer_copy_string_len(dst, file->ptr, i);
+			return 0;
+		}
+	}
+
+	return -1;
+}
+#endif
+
+#ifdef HAVE_SYS_INOTIFY_H
+static void stat_cache_notify_dir_release(stat_cache *sc, stat_cache_notify_dir *dir) {
+	stat_cache_notify_dir *parent;
+
+	force_assert(dir->refcount > 0);
+
+	if (--dir->refcount > 0) return;
+
+	parent = dir->parent;
+
+	if (-1 != dir->wd) {
+		sc->notify_dirs = splaytree_splay(sc->notify_dirs, dir->wd);
+		if (NULL != sc->notify_dirs && sc->notify_dirs->key == dir->wd) {
+			sc->notify_dirs = splaytree_delete(sc->notify_dirs, dir->wd);
+		}
+
+		inotify_rm_watch(sc->notify_fd, dir->wd);
+	}
+
+	buffer_free(dir->name);
+	free(dir);
+
+	if (NULL != parent) stat_cache_notify_dir_release(sc, parent);
+}
+
+static void stat_cache_notify_unbind(stat_cache *sc, stat_cache_entry *sce) {
+	if (NULL == sce->notify_dir) return;
+
+	stat_cache_notify_dir_release(sc, sce->notify_dir);
+	sce->notify_dir = NULL;
+}
+
+/* (re-)bind the entry to the watched directory, takes over the reference */
+static void stat_cache_notify_bind(stat_cache *sc, stat_cache_entry *sce, stat_cache_notify_dir *dir) {
+	struct stat lst;
+
+	stat_cache_notify_unbind(sc, sce);
+	if (NULL == dir) return;
+
+	sce->notify_dir = dir;
+	sce->dir_version = dir->version;
+	sce->notify_symlink = (0 == lstat(sce->name->ptr, &lst) && S_ISLNK(lst.st_mode));
+}
+
+/* the events of the directory don't cover all changes of the entry */
+static int stat_cache_notify_untrusted(stat_cache_entry *sce) {
+	return NULL != sce->notify_dir && (sce->notify_dir->remote || sce->notify_symlink);
+}
+
+/* the filesystem of the directory is shared with other hosts (or
+ * processes behind a FUSE daemon) which don't go through our inotify */
+static int stat_cache_notify_is_remote(const char *dir_name) {
+	struct statfs stfs;
+
+	if (-1 == statfs(dir_name, &stfs)) return 1;
+
+	switch ((unsigned int)stfs.f_type) {
+	case 0x6969:     /* NFS_SUPER_MAGIC */
+	case 0x517B:     /* SMB_SUPER_MAGIC */
+	case 0xFF534D42: /* CIFS_MAGIC_NUMBER */
+	case 0xFE534D42: /* SMB2_MAGIC_NUMBER */
+	case 0x73757245: /* CODA_SUPER_MAGIC */
+	case 0x5346414F: /* AFS_SUPER_MAGIC */
+	case 0x6B414653: /* AFS_FS_MAGIC */
+	case 0x00C36400: /* CEPH_SUPER_MAGIC */
+	case 0x01161970: /* GFS2_MAGIC */
+	case 0x7461636F: /* OCFS2_SUPER_MAGIC */
+	case 0x01021997: /* V9FS_MAGIC */
+	case 0x0BD00BD0: /* LL_SUPER_MAGIC (lustre) */
+	case 0x65735546: /* FUSE_SUPER_MAGIC */
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+/* watch the directory and return it with a reference held, NULL if it
+ * can't be watched (the entries in it are stat()ed on every lookup then) */
+static stat_cache_notify_dir *stat_cache_notify_watch(server *srv, buffer *dir_name) {
+	stat_cache *sc = srv->stat_cache;
+	stat_cache_notify_dir *dir;
+	int wd;
+
+	/* returns the existing watch descriptor if the directory is already watched */
+	if (-1 == (wd = inotify_add_watch(sc->notify_fd, dir_name->ptr, STAT_CACHE_NOTIFY_MASK))) {
+		if (errno == ENOSPC && !sc->notify_full) {
+			log_error_write(srv, __FILE__, __LINE__, "sb",
+				"inotify: out of watches, not caching files below:", dir_name);
+			sc->notify_full = 1;
+		}
+		return NULL;
+	}
+
+	sc->notify_dirs = splaytree_splay(sc->notify_dirs, wd);
+
+	if (NULL != sc->notify_dirs && sc->notify_dirs->key == wd) {
+		dir = sc->notify_dirs->data;
+
+		/* symlinked or bind mounted directory */
+		if (!buffer_is_equal(dir->name, dir_name)) dir->aliased = 1;
+	} else {
+		dir = calloc(1, sizeof(*dir));
+		force_assert(dir);
+
+		dir->name = buffer_init_buffer(dir_name);
+		dir->wd = wd;
+		dir->version = 1;
+		dir->remote = stat_cache_notify_is_remote(dir_name->ptr);
+
+		sc->notify_dirs = splaytree_insert(sc->notify_dirs, wd, dir);
+
+		if (0 == buffer_copy_dirname(sc->hash_key, dir_name)) {
+			buffer *parent_name = buffer_init_buffer(sc->hash_key);
+
+			dir->parent = stat_cache_notify_watch(srv, parent_name);
+			buffer_free(parent_name);
+		}
+	}
+
+	dir->refcount++;
+
+	return dir;
+}
+#endif
+
 void stat_cache_free(stat_cache *sc) {
-	while (sc->files) {
-		int osize;
-		splay_tree *node = sc->files;
+	while (sc->lru_head) {
+		stat_cache_entry *sce = sc->lru_head;
 
-		osize = sc->files->size;
+		sc->lru_head = sce->lru_next;
+#ifdef HAVE_SYS_INOTIFY_H
+		stat_cache_notify_unbind(sc, sce);
+#endif
+		stat_cache_entry_free(sce);
+	}
+
+	free(sc->files);
 
-		stat_cache_entry_free(node->data);
-		sc->files = splaytree_delete(sc->files, node->key);
+#ifdef HAVE_SYS_INOTIFY_H
+	force_assert(NULL == sc->notify_dirs);
+
+	if (-1 != sc->notify_fd) {
+		/* fd events already gone */
+		sc->notify_fde_ndx = -1;
 
-		force_assert(osize - 1 == splaytree_size(sc->files));
+		close(sc->notify_fd);
 	}
+#endif
 
 	buffer_free(sc->dir_name);
 	buffer_free(sc->hash_key);
@@ -214,6 +409,174 @@ void stat_cache_free(stat_cache *sc) {
 	free(sc);
 }
 
+/* DJB hash over the full name and the follow-symlink setting */
+static size_t stat_cache_hash(buffer *name, int follow_symlink) {
+	size_t hash = 5381;
+	size_t i, len = buffer_string_length(name);
+
+	for (i = 0; i < len; i++) {
+		hash = ((hash << 5) + hash) + (unsigned char)name->ptr[i];
+	}
+
+	return ((hash << 5) + hash) + (follow_symlink ? 1 : 0);
+}
+
+static stat_cache_entry *stat_cache_files_find(stat_cache *sc, buffer *name, int follow_symlink, size_t hash) {
+	stat_cache_entry *sce;
+
+	if (0 == sc->files_size) return NULL;
+
+	for (sce = sc->files[hash & (sc->files_size - 1)]; sce; sce = sce->hash_next) {
+		if (sce->hash == hash && sce->follow_symlink == follow_symlink && buffer_is_equal(name, sce->name)) {
+			return sce;
+		}
+	}
+
+	return NULL;
+}
+
+static void stat_cache_files_insert(stat_cache *sc, stat_cache_entry *sce) {
+	stat_cache_entry **bucket = &sc->files[sce->hash & (sc->files_size - 1)];
+
+	sce->hash_next = *bucket;
+	*bucket = sce;
+}
+
+static void stat_cache_files_remove(stat_cache *sc, stat_cache_entry *sce) {
+	stat_cache_entry **p = &sc->files[sce->hash & (sc->files_size - 1)];
+
+	while (*p != sce) {
+		force_assert(NULL != *p);
+		p = &(*p)->hash_next;
+	}
+
+	*p = sce->hash_next;
+	sce->hash_next = NULL;
+}
+
+static void stat_cache_files_resize(stat_cache *sc, size_t files_size) {
+	stat_cache_entry *sce;
+
+	free(sc->files);
+	sc->files_size = files_size;
+	sc->files = calloc(files_size, sizeof(*sc->files));
+	force_assert(sc->files);
+
+	for (sce = sc->lru_head; sce; sce = sce->lru_next) {
+		stat_cache_files_insert(sc, sce);
+	}
+}
+
+static void stat_cache_lru_unlink(stat_cache *sc, stat_cache_entry *sce) {
+	if (sce->lru_prev) sce->lru_prev->lru_next = sce->lru_next;
+	else sc->lru_head = sce->lru_next;
+
+	if (sce->lru_next) sce->lru_next->lru_prev = sce->lru_prev;
+	else sc->lru_tail = sce->lru_prev;
+
+	sce->lru_prev = sce->lru_next = NULL;
+}
+
+static void stat_cache_lru_push_front(stat_cache *sc, stat_cache_entry *sce) {
+	sce->lru_prev = NULL;
+	sce->lru_next = sc->lru_head;
+
+	if (sc->lru_head) sc->lru_head->lru_prev = sce;
+	else sc->lru_tail = sce;
+
+	sc->lru_head = sce;
+}
+
+static void stat_cache_content_unlink(stat_cache *sc, stat_cache_entry *sce) {
+	if (sce->content_prev) sce->content_prev->content_next = sce->content_next;
+	else sc->content_head = sce->content_next;
+
+	if (sce->content_next) sce->content_next->content_prev = sce->content_prev;
+	else sc->content_tail = sce->content_prev;
+
+	sce->content_prev = sce->content_next = NULL;
+}
+
+static void stat_cache_content_push_front(stat_cache *sc, stat_cache_entry *sce) {
+	sce->content_prev = NULL;
+	sce->content_next = sc->content_head;
+
+	if (sc->content_head) sc->content_head->content_prev = sce;
+	else sc->content_tail = sce;
+
+	sc->content_head = sce;
+}
+
+static void stat_cache_entry_drop_content(stat_cache *sc, stat_cache_entry *sce) {
+	if (NULL == sce->content) return;
+
+	stat_cache_content_unlink(sc, sce);
+	sc->content_bytes -= buffer_string_length(sce->content->mem);
+	chunk_shared_mem_unref(sce->content);
+	sce->content = NULL;
+}
+
+/* forget the cached fd and contents of the file; they are released once
+ * the chunks using them are done */
+static void stat_cache_entry_drop_file(stat_cache *sc, stat_cache_entry *sce) {
+	stat_cache_entry_drop_content(sc, sce);
+
+	if (NULL == sce->fdref) return;
+
+	chunk_file_fd_unref(sce->fdref);
+	sce->fdref = NULL;
+	sc->fds_used--;
+}
+
+static void stat_cache_entry_remove(stat_cache *sc, stat_cache_entry *sce) {
+	stat_cache_entry_drop_file(sc, sce);
+#ifdef HAVE_SYS_INOTIFY_H
+	stat_cache_notify_unbind(sc, sce);
+#endif
+	stat_cache_files_remove(sc, sce);
+	stat_cache_lru_unlink(sc, sce);
+	sc->files_used--;
+}
+
+/* create a new entry, or recycle the least recently used one if
+ * server.stat-cache-max-entries is reached.
+ *
+ * entries looked up in the current second are never recycled: the
+ * caller of the lookup might still hold them */
+static stat_cache_entry *stat_cache_entry_add(server *srv, buffer *name, int follow_symlink, size_t hash) {
+	stat_cache *sc = srv->stat_cache;
+	stat_cache_entry *sce = sc->lru_tail;
+
+	if (0 != srv->srvconf.stat_cache_max_entries &&
+	    sc->files_used >= srv->srvconf.stat_cache_max_entries &&
+	    NULL != sce && sce->access_ts != srv->cur_ts) {
+		stat_cache_entry_remove(sc, sce);
+
+		buffer_reset(sce->etag);
+		buffer_reset(sce->content_type);
+		memset(&sce->st, 0, sizeof(sce->st));
+		sce->stat_ts = 0;
+	} else {
+		sce = stat_cache_entry_init();
+
+		/* keep the load factor at or below 1 */
+		if (sc->files_used + 1 > sc->files_size) {
+			stat_cache_files_resize(sc, sc->files_size ? sc->files_size * 2 : 1024);
+		}
+	}
+
+	buffer_copy_buffer(sce->name, name);
+	sce->follow_symlink = follow_symlink;
+	sce->hash = hash;
+	sce->access_ts = srv->cur_ts;
+
+	stat_cache_files_insert(sc, sce);
+	stat_cache_lru_push_front(sc, sce);
+	sc->files_used++;
+
+	return sce;
+}
+
 #if defined(HAVE_XATTR)
 static int stat_cache_attr_get(buffer *buf, char *name) {
 	int attrlen;
@@ -241,6 +604,7 @@ static int stat_cache_attr_get(buffer *buf, char *name) {
 }
 #endif
 
+#ifdef HAVE_FAM_H
 /* the famous DJB hash function for strings */
 static uint32_t hashme(buffer *str) {
 	uint32_t hash = 5381;
@@ -254,7 +618,6 @@ static uint32_t hashme(buffer *str) {
 	return hash;
 }
 
-#ifdef HAVE_FAM_H
 handler_t stat_cache_handle_fdevent(server *srv, void *_fce, int revent) {
 	size_t i;
 	stat_cache *sc = srv->stat_cache;
@@ -325,23 +688,140 @@ handler_t stat_cache_handle_fdevent(server *srv, void *_fce, int revent) {
 
 	return HANDLER_GO_ON;
 }
+#endif
 
-static int buffer_copy_dirname(buffer *dst, buffer *file) {
-	size_t i;
+#ifdef HAVE_SYS_INOTIFY_H
+/* make the entries for name (with and without follow-symlink) stat() again */
+static void stat_cache_notify_invalidate(stat_cache *sc, buffer *name) {
+	int follow_symlink;
 
-	if (buffer_string_is_empty(file)) return -1;
+	for (follow_symlink = 0; follow_symlink < 2; follow_symlink++) {
+		stat_cache_entry *sce;
 
-	for (i = buffer_string_length(file); i > 0; i--) {
-		if (file->ptr[i] == '/') {
-			buffer_copy_string_len(dst, file->ptr, i);
-			return 0;
+		sce = stat_cache_files_find(sc, name, follow_symlink, stat_cache_hash(name, follow_symlink));
+		if (NULL != sce) sce->stat_ts = 0;
+	}
+}
+
+/* increment the version of all watched directories at or below prefix
+ * (all of them if prefix is NULL) */
+static void stat_cache_notify_invalidate_dirs(splay_tree *t, buffer *prefix) {
+	stat_cache_notify_dir *dir;
+
+	if (NULL == t) return;
+
+	stat_cache_notify_invalidate_dirs(t->left, prefix);
+	stat_cache_notify_invalidate_dirs(t->right, prefix);
+
+	dir = t->data;
+
+	if (NULL == prefix ||
+	    (buffer_string_length(dir->name) >= buffer_string_length(prefix) &&
+	     0 == memcmp(dir->name->ptr, prefix->ptr, buffer_string_length(prefix)) &&
+	     (buffer_string_length(dir->name) == buffer_string_length(prefix) ||
+	      dir->name->ptr[buffer_string_length(prefix)] == '/'))) {
+		dir->version++;
+	}
+}
+
+static void stat_cache_notify_event(stat_cache *sc, struct inotify_event *ev) {
+	stat_cache_notify_dir *dir;
+
+	if (ev->mask & IN_Q_OVERFLOW) {
+		/* events got lost */
+		stat_cache_notify_invalidate_dirs(sc->notify_dirs, NULL);
+		return;
+	}
+
+	sc->notify_dirs = splaytree_splay(sc->notify_dirs, ev->wd);
+
+	/* the watch was already released */
+	if (NULL == sc->notify_dirs || sc->notify_dirs->key != ev->wd) return;
+
+	dir = sc->notify_dirs->data;
+
+	if (ev->mask & IN_IGNORED) {
+		/* the kernel dropped the watch (directory deleted, fs unmounted) */
+		dir->version++;
+		dir->wd = -1;
+		sc->notify_dirs = splaytree_delete(sc->notify_dirs, ev->wd);
+		return;
+	}
+
+	if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+		/* everything below the directory is gone */
+		stat_cache_notify_invalidate_dirs(sc->notify_dirs, dir->name);
+		return;
+	}
+
+	if (0 == ev->len || dir->aliased) {
+		/* the directory itself changed */
+		dir->version++;
+		return;
+	}
+
+	buffer_copy_buffer(sc->hash_key, dir->name);
+	buffer_append_slash(sc->hash_key);
+	buffer_append_string(sc->hash_key, ev->name);
+
+	if ((ev->mask & IN_ISDIR) && (ev->mask & (IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO))) {
+		/* a directory was moved: everything below it is gone */
+		stat_cache_notify_invalidate_dirs(sc->notify_dirs, sc->hash_key);
+	}
+
+	stat_cache_notify_invalidate(sc, sc->hash_key);
+
+	if (ev->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)) {
+		/* the mtime of the directory changed */
+		buffer_copy_buffer(sc->hash_key, dir->name);
+		stat_cache_notify_invalidate(sc, sc->hash_key);
+		buffer_append_slash(sc->hash_key);
+		stat_cache_notify_invalidate(sc, sc->hash_key);
+	}
+}
+
+handler_t stat_cache_handle_inotify_fdevent(server *srv, void *_fce, int revent) {
+	stat_cache *sc = srv->stat_cache;
+	/* aligned for struct inotify_event */
+	uint64_t buf[4096 / sizeof(uint64_t)];
+	ssize_t len;
+
+	UNUSED(_fce);
+
+	if (revent & FDEVENT_IN) {
+		while ((len = read(sc->notify_fd, buf, sizeof(buf))) > 0) {
+			char *p = (char *)buf;
+
+			while (p < (char *)buf + len) {
+				struct inotify_event *ev = (struct inotify_event *)p;
+
+				stat_cache_notify_event(sc, ev);
+
+				p += sizeof(struct inotify_event) + ev->len;
+			}
+		}
+
+		if (-1 == len && errno != EAGAIN && errno != EINTR) {
+			log_error_write(srv, __FILE__, __LINE__, "ss",
+				"reading inotify events failed:", strerror(errno));
+			revent |= FDEVENT_ERR;
 		}
 	}
 
-	return -1;
+	if (revent & (FDEVENT_HUP | FDEVENT_ERR)) {
+		/* without events the entries can't be trusted: stat() on every lookup */
+		fdevent_event_del(srv->ev, &(sc->notify_fde_ndx), sc->notify_fd);
+		fdevent_unregister(srv->ev, sc->notify_fd);
+
+		close(sc->notify_fd);
+		sc->notify_fd = -1;
+	}
+
+	return HANDLER_GO_ON;
 }
 #endif
 
+
 #ifdef HAVE_LSTAT
 static int stat_cache_lstat(server *srv, buffer *dname, struct stat *lst) {
 	if (lstat(dname->ptr, lst) == 0) {
@@ -356,6 +836,17 @@ static int stat_cache_lstat(server *srv, buffer *dname, struct stat *lst) {
 }
 #endif
 
+/* a cache hit: return the entry or the cached error of a miss */
+static handler_t stat_cache_entry_hit(stat_cache_entry *sce, stat_cache_entry **ret_sce) {
+	if (0 != sce->stat_errno) {
+		errno = sce->stat_errno;
+		return HANDLER_ERROR;
+	}
+
+	*ret_sce = sce;
+	return HANDLER_GO_ON;
+}
+
 /***
  *
  *
@@ -369,6 +860,9 @@ handler_t stat_cache_get_entry(server *srv, connection *con, buffer *name, stat_
 #ifdef HAVE_FAM_H
 	fam_dir_entry *fam_dir = NULL;
 	int dir_ndx = -1;
+#endif
+#ifdef HAVE_SYS_INOTIFY_H
+	stat_cache_notify_dir *notify_dir = NULL;
 #endif
 	stat_cache_entry *sce = NULL;
 	stat_cache *sc;
@@ -376,11 +870,7 @@ handler_t stat_cache_get_entry(server *srv, connection *con, buffer *name, stat_
 	size_t k;
 	int fd;
 	struct stat lst;
-#ifdef DEBUG_STAT_CACHE
-	size_t i;
-#endif
-
-	int file_ndx;
+	size_t file_hash;
 
 	*ret_sce = NULL;
 
@@ -390,52 +880,48 @@ handler_t stat_cache_get_entry(server *srv, connection *con, buffer *name, stat_
 
 	sc = srv->stat_cache;
 
-	buffer_copy_buffer(sc->hash_key, name);
-	buffer_append_int(sc->hash_key, con->conf.follow_symlink);
+	file_hash = stat_cache_hash(name, con->conf.follow_symlink);
 
-	file_ndx = hashme(sc->hash_key);
-	sc->files = splaytree_splay(sc->files, file_ndx);
-
-#ifdef DEBUG_STAT_CACHE
-	for (i = 0; i < ctrl.used; i++) {
-		if (ctrl.ptr[i] == file_ndx) break;
-	}
-#endif
+	if (NULL != (sce = stat_cache_files_find(sc, name, con->conf.follow_symlink, file_hash))) {
+		/* we have seen this file already */
+		if (sce != sc->lru_head) {
+			stat_cache_lru_unlink(sc, sce);
+			stat_cache_lru_push_front(sc, sce);
+		}
+		sce->access_ts = srv->cur_ts;
 
-	if (sc->files && (sc->files->key == file_ndx)) {
-#ifdef DEBUG_STAT_CACHE
-		/* it was in the cache */
-		force_assert(i < ctrl.used);
+		/* don't stat() it again in the same second; this is also the
+		 * lifetime of misses the engine can't watch */
+		if (srv->srvconf.stat_cache_engine == STAT_CACHE_ENGINE_SIMPLE ||
+#ifdef HAVE_SYS_INOTIFY_H
+		    stat_cache_notify_untrusted(sce) ||
 #endif
-
-		/* we have seen this file already and
-		 * don't stat() it again in the same second */
-
-		sce = sc->files->data;
-
-		/* check if the name is the same, we might have a collision */
-
-		if (buffer_is_equal(name, sce->name)) {
-			if (srv->srvconf.stat_cache_engine == STAT_CACHE_ENGINE_SIMPLE) {
-				if (sce->stat_ts == srv->cur_ts) {
-					*ret_sce = sce;
-					return HANDLER_GO_ON;
-				}
+		    (0 != sce->stat_errno && srv->srvconf.stat_cache_engine != STAT_CACHE_ENGINE_NONE)) {
+			if (sce->stat_ts == srv->cur_ts) {
+				return stat_cache_entry_hit(sce, ret_sce);
 			}
-		} else {
-			/* collision, forget about the entry */
-			sce = NULL;
 		}
-	} else {
-#ifdef DEBUG_STAT_CACHE
-		if (i != ctrl.used) {
-			log_error_write(srv, __FILE__, __LINE__, "xSB",
-				file_ndx, "was already inserted but not found in cache, ", name);
+
+#ifdef HAVE_SYS_INOTIFY_H
+		/* valid until inotify reports a change */
+		if (srv->srvconf.stat_cache_engine == STAT_CACHE_ENGINE_INOTIFY) {
+			if (0 != sce->stat_ts && NULL != sce->notify_dir && !stat_cache_notify_untrusted(sce) &&
+			    sce->notify_dir->version == sce->dir_version && -1 != sc->notify_fd) {
+				return stat_cache_entry_hit(sce, ret_sce);
+			}
 		}
-		force_assert(i == ctrl.used);
 #endif
 	}
 
+#ifdef HAVE_SYS_INOTIFY_H
+	/* watch before the stat(), so changes in between are reported */
+	if (srv->srvconf.stat_cache_engine == STAT_CACHE_ENGINE_INOTIFY && -1 != sc->notify_fd) {
+		if (0 == buffer_copy_dirname(sc->dir_name, name)) {
+			notify_dir = stat_cache_notify_watch(srv, sc->dir_name);
+		}
+	}
+#endif
+
 #ifdef HAVE_FAM_H
 	/* dir-check */
 	if (srv->srvconf.stat_cache_engine == STAT_CACHE_ENGINE_FAM) {
@@ -461,8 +947,7 @@ handler_t stat_cache_get_entry(server *srv, connection *con, buffer *name, stat_
 				if ((NULL != sce) && (fam_dir->version == sce->dir_version)) {
 					/* the stat()-cache entry is still ok */
 
-					*ret_sce = sce;
-					return HANDLER_GO_ON;
+					return stat_cache_entry_hit(sce, ret_sce);
 				}
 			} else {
 				/* hash collision, forget about the entry */
@@ -479,7 +964,7 @@ handler_t stat_cache_get_entry(server *srv, connection *con, buffer *name, stat_
 	 *
 	 * */
 	if (-1 == stat(name->ptr, &st)) {
-		return HANDLER_ERROR;
+		goto stat_failed;
 	}
 
 
@@ -487,51 +972,34 @@ handler_t stat_cache_get_entry(server *srv, connection *con, buffer *name, stat_
 		/* fix broken stat/open for symlinks to reg files with appended slash on freebsd,osx */
 		if (name->ptr[buffer_string_length(name) - 1] == '/') {
 			errno = ENOTDIR;
-			return HANDLER_ERROR;
+			goto stat_failed;
 		}
 
 		/* try to open the file to check if we can read it */
 		if (-1 == (fd = open(name->ptr, O_RDONLY))) {
-			return HANDLER_ERROR;
+			goto stat_failed;
 		}
 		close(fd);
 	}
 
 	if (NULL == sce) {
+		sce = stat_cache_entry_add(srv, name, con->conf.follow_symlink, file_hash);
+	}
 
-		sce = stat_cache_entry_init();
-		buffer_copy_buffer(sce->name, name);
-
-		/* already splayed file_ndx */
-		if ((NULL != sc->files) && (sc->files->key == file_ndx)) {
-			/* hash collision: replace old entry */
-			stat_cache_entry_free(sc->files->data);
-			sc->files->data = sce;
-		} else {
-			int osize = splaytree_size(sc->files);
-
-			sc->files = splaytree_insert(sc->files, file_ndx, sce);
-			force_assert(osize + 1 == splaytree_size(sc->files));
-
-#ifdef DEBUG_STAT_CACHE
-			if (ctrl.size == 0) {
-				ctrl.size = 16;
-				ctrl.used = 0;
-				ctrl.ptr = malloc(ctrl.size * sizeof(*ctrl.ptr));
-			} else if (ctrl.size == ctrl.used) {
-				ctrl.size += 16;
-				ctrl.ptr = realloc(ctrl.ptr, ctrl.size * sizeof(*ctrl.ptr));
-			}
-
-			ctrl.ptr[ctrl.used++] = file_ndx;
+#ifdef HAVE_SYS_INOTIFY_H
+	stat_cache_notify_bind(sc, sce, notify_dir);
 #endif
-		}
-		force_assert(sc->files);
-		force_assert(sc->files->data == sce);
+
+	/* the cached fd and contents belong to the old file if it was replaced or changed */
+	if ((NULL != sce->fdref || NULL != sce->content) &&
+	    (sce->st.st_ino != st.st_ino || sce->st.st_dev != st.st_dev ||
+	     sce->st.st_mtime != st.st_mtime || sce->st.st_size != st.st_size)) {
+		stat_cache_entry_drop_file(sc, sce);
 	}
 
 	sce->st = st;
 	sce->stat_ts = srv->cur_ts;
+	sce->stat_errno = 0;
 
 	/* catch the obvious symlinks
 	 *
@@ -681,78 +1149,179 @@ handler_t stat_cache_get_entry(server *srv, connection *con, buffer *name, stat_
 	*ret_sce = sce;
 
 	return HANDLER_GO_ON;
+
+stat_failed:
+	/* remember that the file doesn't exist */
+	if ((errno == ENOENT || errno == ENOTDIR) &&
+	    srv->srvconf.stat_cache_engine != STAT_CACHE_ENGINE_NONE) {
+		int err = errno;
+
+		if (NULL == sce) {
+			sce = stat_cache_entry_add(srv, name, con->conf.follow_symlink, file_hash);
+		}
+
+		stat_cache_entry_drop_file(sc, sce);
+		memset(&sce->st, 0, sizeof(sce->st));
+		buffer_reset(sce->etag);
+		buffer_reset(sce->content_type);
+		sce->stat_ts = srv->cur_ts;
+		sce->stat_errno = err;
+#ifdef HAVE_LSTAT
+		sce->is_symlink = 0;
+#endif
+
+#if defined(HAVE_FAM_H) || defined(HAVE_SYS_INOTIFY_H)
+		sce->dir_version = 0;
+#endif
+#ifdef HAVE_FAM_H
+		/* the directory might not exist: only use a monitor that is already there */
+		if (srv->srvconf.stat_cache_engine == STAT_CACHE_ENGINE_FAM && NULL != fam_dir) {
+			sce->dir_version = fam_dir->version;
+		}
+#endif
+#ifdef HAVE_SYS_INOTIFY_H
+		/* inotify reports the file when it gets created (unless it is a dangling symlink) */
+		stat_cache_notify_bind(sc, sce, notify_dir);
+#endif
+
+		errno = err;
+		return HANDLER_ERROR;
+	}
+
+#ifdef HAVE_SYS_INOTIFY_H
+	if (NULL != notify_dir) {
+		/* keep errno for the caller */
+		int err = errno;
+		stat_cache_notify_dir_release(sc, notify_dir);
+		errno = err;
+	}
+#endif
+	return HANDLER_ERROR;
 }
 
 /**
- * remove stat() from cache which havn't been stat()ed for
- * more than 10 seconds
- *
+ * a reference to an open fd for the regular file of the entry, opened on
+ * first use and kept with the entry until it is removed or the file
+ * changes. Release it with chunk_file_fd_unref().
  *
- * walk though the stat-cache, collect the ids which are too old
- * and remove them in a second loop
+ * returns NULL if the file can't be opened or server.stat-cache-max-fds
+ * fds are cached already
  */
+chunk_file_fd *stat_cache_entry_get_fd(server *srv, stat_cache_entry *sce) {
+	stat_cache *sc = srv->stat_cache;
 
-static int stat_cache_tag_old_entries(server *srv, splay_tree *t, int *keys, size_t *ndx) {
-	stat_cache_entry *sce;
-
-	if (!t) return 0;
+	if (NULL == sce->fdref) {
+		int fd;
 
-	stat_cache_tag_old_entries(srv, t->left, keys, ndx);
-	stat_cache_tag_old_entries(srv, t->right, keys, ndx);
+		if (0 != sce->stat_errno || !S_ISREG(sce->st.st_mode)) return NULL;
+		if (sc->fds_used >= srv->srvconf.stat_cache_max_fds) return NULL;
 
-	sce = t->data;
+		if (-1 == (fd = open(sce->name->ptr, O_RDONLY|O_NOCTTY))) return NULL;
+		fd_close_on_exec(fd);
 
-	if (srv->cur_ts - sce->stat_ts > 2) {
-		keys[(*ndx)++] = t->key;
+		sce->fdref = chunk_file_fd_init(fd);
+		sc->fds_used++;
 	}
 
-	return 0;
+	chunk_file_fd_ref(sce->fdref);
+
+	return sce->fdref;
 }
 
-int stat_cache_trigger_cleanup(server *srv) {
-	stat_cache *sc;
-	size_t max_ndx = 0, i;
-	int *keys;
+/**
+ * the contents of a small regular file, read on first use and kept with
+ * the entry until it is removed or the file changes. The least recently
+ * used contents are dropped to stay below server.small-file-cache-memory.
+ * Files modified in the current second are not cached yet.
+ *
+ * the contents are only valid until the next stat-cache call; take a
+ * reference (e.g. with chunkqueue_append_shared_mem()) to keep them.
+ *
+ * returns NULL if the file is too large or can't be read
+ */
+chunk_shared_mem *stat_cache_entry_get_content(server *srv, stat_cache_entry *sce) {
+	stat_cache *sc = srv->stat_cache;
+	const off_t max_memory = (off_t)srv->srvconf.small_file_cache_memory << 10;
+	const off_t size = sce->st.st_size;
+	buffer *b;
+	off_t rd = 0;
+	int fd;
 
-	sc = srv->stat_cache;
+	if (NULL != sce->content) {
+		if (sce != sc->content_head) {
+			stat_cache_content_unlink(sc, sce);
+			stat_cache_content_push_front(sc, sce);
+		}
+		return sce->content;
+	}
 
-	if (!sc->files) return 0;
+	if (0 != sce->stat_errno || !S_ISREG(sce->st.st_mode)) return NULL;
+	if (0 == size || size > ((off_t)srv->srvconf.small_file_cache_max_size << 10) || size > max_memory) return NULL;
 
-	keys = calloc(1, sizeof(int) * sc->files->size);
+	/* the change check only sees the mtime in seconds: a file written in
+	 * this second might change again with the same mtime and size */
+	if (sce->st.st_mtime >= srv->cur_ts) return NULL;
 
-	stat_cache_tag_old_entries(srv, sc->files, keys, &max_ndx);
+	if (-1 == (fd = open(sce->name->ptr, O_RDONLY|O_NOCTTY))) return NULL;
 
-	for (i = 0; i < max_ndx; i++) {
-		int ndx = keys[i];
-		splay_tree *node;
+	b = buffer_init();
+	buffer_string_prepare_copy(b, size);
 
-		sc->files = splaytree_splay(sc->files, ndx);
+	while (rd < size) {
+		ssize_t r = read(fd, b->ptr + rd, size - rd);
 
-		node = sc->files;
+		if (r > 0) {
+			rd += r;
+		} else if (0 == r || errno != EINTR) {
+			break;
+		}
+	}
+	close(fd);
 
-		if (node && (node->key == ndx)) {
-#ifdef DEBUG_STAT_CACHE
-			size_t j;
-			int osize = splaytree_size(sc->files);
-			stat_cache_entry *sce = node->data;
-#endif
-			stat_cache_entry_free(node->data);
-			sc->files = splaytree_delete(sc->files, ndx);
+	if (rd != size) {
+		/* file changed since the stat() */
+		buffer_free(b);
+		return NULL;
+	}
+	buffer_commit(b, size);
 
-#ifdef DEBUG_STAT_CACHE
-			for (j = 0; j < ctrl.used; j++) {
-				if (ctrl.ptr[j] == ndx) {
-					ctrl.ptr[j] = ctrl.ptr[--ctrl.used];
-					break;
-				}
-			}
+	while (sc->content_bytes + size > max_memory) {
+		stat_cache_entry_drop_content(sc, sc->content_tail);
+	}
+
+	sce->content = chunk_shared_mem_init(b);
+	sc->content_bytes += size;
+	stat_cache_content_push_front(sc, sce);
+
+	return sce->content;
+}
+
+/**
+ * remove the entries which haven't been looked up for more than
+ * STAT_CACHE_MAX_IDLE seconds
+ *
+ * the LRU list is ordered by the last lookup, so the idle entries are at
+ * the tail. Only a batch of them is removed per call, this is called every
+ * loop iteration and a large cache is expired without latency spikes
+ */
+
+int stat_cache_trigger_cleanup(server *srv) {
+	stat_cache *sc = srv->stat_cache;
+	time_t max_idle = STAT_CACHE_MAX_IDLE;
+	size_t i;
 
-			force_assert(osize - 1 == splaytree_size(sc->files));
+#ifdef HAVE_SYS_INOTIFY_H
+	if (srv->srvconf.stat_cache_engine == STAT_CACHE_ENGINE_INOTIFY) max_idle = STAT_CACHE_NOTIFY_MAX_IDLE;
 #endif
-		}
-	}
 
-	free(keys);
+	for (i = 0; i < STAT_CACHE_CLEANUP_BATCH; i++) {
+		stat_cache_entry *sce = sc->lru_tail;
+
+		if (NULL == sce || srv->cur_ts - sce->access_ts <= max_idle) break;
+
+		stat_cache_entry_remove(sc, sce);
+		stat_cache_entry_free(sce);
+	}
 
 	return 0;
 }
@@ -7,7 +7,10 @@ stat_cache *stat_cache_init(void);
 void stat_cache_free(stat_cache *fc);
 
 handler_t stat_cache_get_entry(server *srv, connection *con, buffer *name, stat_cache_entry **fce);
+chunk_file_fd *stat_cache_entry_get_fd(server *srv, stat_cache_entry *sce);
+chunk_shared_mem *stat_cache_entry_get_content(server *srv, stat_cache_entry *sce);
 handler_t stat_cache_handle_fdevent(server *srv, void *_fce, int revent);
+handler_t stat_cache_handle_inotify_fdevent(server *srv, void *_fce, int revent);
 
 int stat_cache_trigger_cleanup(server *srv);
 #endif
@@ -0,0 +1,192 @@
+#include "strtrie.h"
+#include "buffer.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+static strtrie_node *strtrie_node_init(const char *label, size_t len) {
+	strtrie_node *node = calloc(1, sizeof(*node));
+	force_assert(NULL != node);
+
+	if (len > 0) {
+		node->label = malloc(len);
+		force_assert(NULL != node->label);
+		memcpy(node->label, label, len);
+	}
+	node->len = len;
+
+	return node;
+}
+
+static void strtrie_node_free(strtrie_node *node) {
+	size_t i;
+
+	for (i = 0; i < node->childs_used; i++) {
+		strtrie_node_free(node->childs[i]);
+	}
+	free(node->childs);
+	free(node->label);
+	free(node->ndx);
+	free(node);
+}
+
+/* position of the child starting with c, or where it would be inserted */
+static size_t strtrie_node_child(const strtrie_node *node, unsigned char c) {
+	size_t lo = 0, hi = node->childs_used;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		unsigned char m = (unsigned char)node->childs[mid]->label[0];
+
+		if (m == c) return mid;
+		if (m < c) lo = mid + 1; else hi = mid;
+	}
+
+	return lo;
+}
+
+/* i-th byte of the subject in the order and case the keys are stored in */
+static unsigned char strtrie_byte(const strtrie *t, const char *s, size_t len, size_t i) {
+	unsigned char c = (unsigned char)(t->reverse ? s[len - 1 - i] : s[i]);
+	return t->fold_case ? (unsigned char)tolower(c) : c;
+}
+
+strtrie *strtrie_init(int fold_case, int reverse) {
+	strtrie *t = calloc(1, sizeof(*t));
+	force_assert(NULL != t);
+
+	t->root = strtrie_node_init(NULL, 0);
+	t->fold_case = fold_case ? 1 : 0;
+	t->reverse = reverse ? 1 : 0;
+
+	return t;
+}
+
+void strtrie_free(strtrie *t) {
+	if (NULL == t) return;
+
+	strtrie_node_free(t->root);
+	free(t);
+}
+
+void strtrie_insert(strtrie *t, const char *key, size_t len, size_t ndx) {
+	strtrie_node *node = t->root;
+	char *k, *s;
+	size_t i;
+
+	k = malloc(len + 1);
+	force_assert(NULL != k);
+	for (i = 0; i < len; i++) k[i] = (char)strtrie_byte(t, key, len, i);
+	s = k;
+
+	while (len > 0) {
+		size_t pos = strtrie_node_child(node, (unsigned char)s[0]);
+		strtrie_node *child;
+		size_t common;
+
+		if (pos == node->childs_used || node->childs[pos]->label[0] != s[0]) {
+			/* new leaf */
+			child = strtrie_node_init(s, len);
+			node->childs = realloc(node->childs, (node->childs_used + 1) * sizeof(*node->childs));
+			force_assert(NULL != node->childs);
+			memmove(node->childs + pos + 1, node->childs + pos, (node->childs_used - pos) * sizeof(*node->childs));
+			node->childs[pos] = child;
+			node->childs_used++;
+
+			node = child;
+			break;
+		}
+
+		child = node->childs[pos];
+		for (common = 1; common < len && common < child->len && s[common] == child->label[common]; common++) ;
+
+		if (common < child->len) {
+			/* split the edge */
+			strtrie_node *mid = strtrie_node_init(child->label, common);
+
+			memmove(child->label, child->label + common, child->len - common);
+			child->len -= common;
+
+			mid->childs = malloc(sizeof(*mid->childs));
+			force_assert(NULL != mid->childs);
+			mid->childs[0] = child;
+			mid->childs_used = 1;
+
+			node->childs[pos] = mid;
+			child = mid;
+		}
+
+		node = child;
+		s += common;
+		len -= common;
+	}
+
+	node->ndx = realloc(node->ndx, (node->ndx_used + 1) * sizeof(*node->ndx));
+	force_assert(NULL != node->ndx);
+	node->ndx[node->ndx_used++] = ndx;
+	t->used++;
+
+	free(k);
+}
+
+/* the child of node whose edge matches the subject at off, or NULL */
+static const strtrie_node *strtrie_step(const strtrie *t, const strtrie_node *node, const char *s, size_t len, size_t off) {
+	const strtrie_node *child;
+	size_t pos, i;
+
+	if (off == len) return NULL;
+
+	pos = strtrie_node_child(node, strtrie_byte(t, s, len, off));
+	if (pos == node->childs_used) return NULL;
+
+	child = node->childs[pos];
+	if (child->len > len - off) return NULL;
+
+	for (i = 0; i < child->len; i++) {
+		if ((unsigned char)child->label[i] != strtrie_byte(t, s, len, off + i)) return NULL;
+	}
+
+	return child;
+}
+
+ssize_t strtrie_match_first(const strtrie *t, const char *s, size_t len) {
+	const strtrie_node *node = t->root;
+	ssize_t first = -1;
+	size_t off = 0;
+
+	if (0 == t->used) return -1;
+
+	/* starts at the root: the empty key matches everything */
+	do {
+		if (node->ndx_used > 0 && (first == -1 || node->ndx[0] < (size_t)first)) {
+			first = (ssize_t)node->ndx[0];
+		}
+		off += node->len;
+	} while (NULL != (node = strtrie_step(t, node, s, len, off)));
+
+	return first;
+}
+
+size_t strtrie_match_all(const strtrie *t, const char *s, size_t len, size_t **ndx, size_t *size) {
+	const strtrie_node *node = t->root;
+	size_t used = 0, off = 0;
+
+	if (0 == t->used) return 0;
+
+	/* starts at the root: the empty key matches everything */
+	do {
+		if (node->ndx_used > 0) {
+			if (used + node->ndx_used > *size) {
+				*size = used + node->ndx_used + 16;
+				*ndx = realloc(*ndx, *size * sizeof(**ndx));
+				force_assert(NULL != *ndx);
+			}
+			memcpy(*ndx + used, node->ndx, node->ndx_used * sizeof(*node->ndx));
+			used += node->ndx_used;
+		}
+		off += node->len;
+	} while (NULL != (node = strtrie_step(t, node, s, len, off)));
+
+	return used;
+}
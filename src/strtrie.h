@@ -0,0 +1,50 @@
+#ifndef _STRTRIE_H_
+#define _STRTRIE_H_
+
+#include "settings.h"
+
+#include <sys/types.h>
+
+/**
+ * set of strings for prefix (or suffix) lookups
+ *
+ * a radix tree: edges carry the common part of the keys below them, the
+ * childs of a node are sorted by the first byte of their edge. every key
+ * carries an index (usually its position in the config) and a lookup
+ * walks the subject once, collecting the keys that are a prefix of it.
+ */
+
+typedef struct strtrie_node {
+	char *label;
+	size_t len;
+
+	struct strtrie_node **childs;
+	size_t childs_used;
+
+	size_t *ndx; /* keys ending at this node, ascending */
+	size_t ndx_used;
+} strtrie_node;
+
+typedef struct {
+	strtrie_node *root;
+	size_t used; /* number of keys inserted */
+
+	unsigned short fold_case; /* compare case-insensitive (ASCII) */
+	unsigned short reverse;   /* match suffixes instead of prefixes */
+} strtrie;
+
+strtrie *strtrie_init(int fold_case, int reverse);
+void strtrie_free(strtrie *t);
+
+/* ndx has to ascend from one insert to the next */
+void strtrie_insert(strtrie *t, const char *key, size_t len, size_t ndx);
+
+/* smallest index of all keys that are a prefix (suffix) of s; -1 if none */
+ssize_t strtrie_match_first(const strtrie *t, const char *s, size_t len);
+
+/* appends the indices of all keys that are a prefix (suffix) of s to
+ * *ndx (grown as needed, *size is its capacity); returns their number.
+ * each node's indices are sorted, the result as a whole is not */
+size_t strtrie_match_all(const strtrie *t, const char *s, size_t len, size_t **ndx, size_t *size);
+
+#endif
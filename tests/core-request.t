@@ -8,7 +8,7 @@ BEGIN {
 
 use strict;
 use IO::Socket;
-use Test::More tests => 38;
+use Test::More tests => 40;
 use LightyTest;
 
 my $tf = LightyTest->new();
@@ -245,6 +245,31 @@ EOF
 $t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 411 } ];
 ok($tf->handle_http($t) == 0, 'Content-Length is empty');
 
+$t->{REQUEST}  = ( <<EOF
+POST /12345.txt HTTP/1.1
+Host: 123.example.org
+Content-Length: 5
+Transfer-Encoding: chunked
+Connection: close
+
+5
+12345
+0
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.1', 'HTTP-Status' => 400 } ];
+ok($tf->handle_http($t) == 0, 'Content-Length and Transfer-Encoding: chunked');
+
+$t->{REQUEST}  = ( <<EOF
+POST /12345.txt HTTP/1.1
+Host: 123.example.org
+Transfer-Encoding: gzip
+Connection: close
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.1', 'HTTP-Status' => 501 } ];
+ok($tf->handle_http($t) == 0, 'Transfer-Encoding other than chunked');
+
 print "\nLow-Level Request-Header Parsing - HTTP/1.1\n";
 $t->{REQUEST}  = ( <<EOF
 GET / HTTP/1.1
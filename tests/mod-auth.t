@@ -8,7 +8,7 @@ BEGIN {
 
 use strict;
 use IO::Socket;
-use Test::More tests => 17;
+use Test::More tests => 20;
 use LightyTest;
 
 my $tf = LightyTest->new();
@@ -166,6 +166,42 @@ EOF
 $t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 401 } ];
 ok($tf->handle_http($t) == 0, 'Digest-Auth: trailing WS');
 
+# rewrite the userfile in place, twice with the same mtime and size (as
+# htpasswd does within a second); a mtime in the future is always "now"
+sub rewrite_userfile {
+	my ($content, $mtime) = @_;
+	my $fn = $tf->{BASEDIR}.'/tests/tmp/lighttpd/lighttpd.user';
+	open(my $fh, '+<', $fn) or return 0;
+	print $fh $content;
+	close($fh);
+	utime($mtime, $mtime, $fn);
+	select(undef, undef, undef, 1.1); # the file is checked once per second
+	return 1;
+}
+
+my $mtime = time() + 10;
+
+rewrite_userfile("jan:abc\n", $mtime);
+$t->{REQUEST}  = ( <<EOF
+GET /server-config HTTP/1.0
+Authorization: Basic amFuOmFiYw==
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200 } ];
+ok($tf->handle_http($t) == 0, 'Basic-Auth: changed userfile reloaded');
+
+rewrite_userfile("jan:def\n", $mtime);
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 401 } ];
+ok($tf->handle_http($t) == 0, 'Basic-Auth: userfile changed again with the same mtime and size');
+
+$t->{REQUEST}  = ( <<EOF
+GET /server-config HTTP/1.0
+Authorization: Basic amFuOmRlZg==
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200 } ];
+ok($tf->handle_http($t) == 0, 'Basic-Auth: new password from the userfile');
+
 
 
 ok($tf->stop_proc == 0, "Stopping lighttpd");
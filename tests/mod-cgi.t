@@ -8,7 +8,7 @@ BEGIN {
 
 use strict;
 use IO::Socket;
-use Test::More tests => 18;
+use Test::More tests => 21;
 use LightyTest;
 
 my $tf = LightyTest->new();
@@ -138,5 +138,33 @@ EOF
 $t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 302, 'Location' => 'http://www.example.org/' } ];
 ok($tf->handle_http($t) == 0, 'broken header via perl cgi');
 
+$t->{REQUEST}  = ( <<EOF
+POST /get-post-len.pl HTTP/1.1
+Host: www.example.org
+Transfer-Encoding: chunked
+Connection: close
+
+3
+123
+2;ext=1
+45
+0
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.1', 'HTTP-Status' => 200, 'HTTP-Content' => "01\r\n5\r\n0\r\n\r\n" } ];
+ok($tf->handle_http($t) == 0, 'chunked request body');
+
+# the body goes through several closed and reopened tempfiles
+$t->{REQUEST}  = "POST /get-post-len.pl HTTP/1.0\nHost: www.example.org\nContent-Length: 300000\n\n" . ("a" x 300000);
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200, 'HTTP-Content' => '300000' } ];
+ok($tf->handle_http($t) == 0, 'request body larger than server.upload-temp-file-size');
+
+SKIP: {
+	my $fddir = "/proc/".$tf->{LIGHTTPD_PID}."/fd";
+	skip "no $fddir", 1 unless -d $fddir;
+	my @deleted = grep { my $l = readlink($_); defined $l && $l =~ /lighttpd-upload-.* \(deleted\)$/ } glob("$fddir/*");
+	ok(0 == @deleted, 'no fds of removed tempfiles kept open');
+}
+
 ok($tf->stop_proc == 0, "Stopping lighttpd");
 
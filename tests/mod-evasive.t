@@ -0,0 +1,78 @@
+#!/usr/bin/env perl
+BEGIN {
+	# add current source dir to the include-path
+	# we need this for make distcheck
+	(my $srcdir = $0) =~ s,/[^/]+$,/,;
+	unshift @INC, $srcdir;
+}
+
+use strict;
+use IO::Socket;
+use Test::More tests => 9;
+use LightyTest;
+
+my $tf = LightyTest->new();
+my $t;
+
+$tf->{CONFIGFILE} = 'mod-evasive.conf';
+
+ok($tf->start_proc == 0, "Starting lighttpd") or die();
+
+# a request waiting for its body keeps the connection counted
+my $slow = IO::Socket::INET->new(Proto => "tcp", PeerAddr => "127.0.0.1", PeerPort => $tf->{PORT});
+$slow->autoflush(1);
+print $slow "POST /ip.pl?conns HTTP/1.0\r\nHost: www.example.org\r\nContent-Length: 4\r\n\r\n";
+select(undef, undef, undef, 0.2);
+
+$t->{REQUEST} = ( <<EOF
+GET /index.html?conns HTTP/1.0
+Host: www.example.org
+EOF
+);
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 403 } ];
+ok($tf->handle_http($t) == 0, 'max-conns-per-ip reached');
+
+# finish the pending request, its connection isn't counted anymore
+print $slow "abcd";
+my ($line) = <$slow>; # up to the end, the connection is released then
+close($slow);
+ok(defined $line && $line =~ m#^HTTP/1\.0 200#, 'pending request answered');
+
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200 } ];
+ok($tf->handle_http($t) == 0, 'below max-conns-per-ip again');
+
+$t->{REQUEST} = ( <<EOF
+GET /index.html?rate HTTP/1.0
+Host: www.example.org
+EOF
+);
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200 } ];
+ok($tf->handle_http($t) == 0 && $tf->handle_http($t) == 0 && $tf->handle_http($t) == 0, 'burst-per-ip requests pass');
+
+# the bucket gets one token per second; a second passing in between
+# allows at most one more request
+sub get_status {
+	my $remote = IO::Socket::INET->new(Proto => "tcp", PeerAddr => "127.0.0.1", PeerPort => $tf->{PORT}) or return 0;
+	$remote->autoflush(1);
+	print $remote "GET $_[0] HTTP/1.0\r\nHost: www.example.org\r\n\r\n";
+	my $status = <$remote>;
+	close($remote);
+	return (defined $status && $status =~ m#^HTTP/1\.0 (\d+)#) ? $1 : 0;
+}
+
+my $status = get_status('/index.html?rate');
+$status = get_status('/index.html?rate') if $status == 200;
+ok($status == 429, 'burst exhausted');
+
+# a /32 subnet has its own bucket, the per-IP one is empty now
+ok(get_status('/index.html?subnet') == 200 && get_status('/index.html?subnet') == 200, 'subnet bucket separate from the per-IP bucket');
+
+$t->{REQUEST} = ( <<EOF
+GET /index.html HTTP/1.0
+Host: www.example.org
+EOF
+);
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200 } ];
+ok($tf->handle_http($t) == 0, 'no limits outside the conditionals');
+
+ok($tf->stop_proc == 0, "Stopping lighttpd");
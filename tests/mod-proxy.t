@@ -8,7 +8,7 @@ BEGIN {
 
 use strict;
 use IO::Socket;
-use Test::More tests => 9;
+use Test::More tests => 10;
 use LightyTest;
 
 my $tf_real = LightyTest->new();
@@ -53,6 +53,11 @@ EOF
 $t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200, 'Server' => 'Apache 1.3.29' } ];
 ok($tf_proxy->handle_http($t) == 0, 'drop Server from real server');
 
+# the proxy streams the body to the real server, it has to throttle the client
+$t->{REQUEST}  = "POST /get-post-len.pl HTTP/1.0\nHost: www.example.org\nContent-Length: 1048576\n\n" . ("a" x 1048576);
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 200, 'HTTP-Content' => '1048576' } ];
+ok($tf_proxy->handle_http($t) == 0, 'streamed request body');
+
 SKIP: {
 	skip "no PHP running on port 1026", 1 unless $tf_real->listening_on(1026);
 	$t->{REQUEST}  = ( <<EOF
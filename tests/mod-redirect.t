@@ -8,7 +8,7 @@ BEGIN {
 
 use strict;
 use IO::Socket;
-use Test::More tests => 7;
+use Test::More tests => 11;
 use LightyTest;
 
 my $tf = LightyTest->new();
@@ -32,6 +32,22 @@ EOF
 $t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 301, 'Location' => 'http://localhost:'.$tf->{PORT}.'/', 'Content-Length' => '0' } ];
 ok($tf->handle_http($t) == 0, 'external redirect should have a Content-Length: 0');
 
+$t->{REQUEST}  = ( <<EOF
+GET /redirect/prefilter/foo HTTP/1.0
+Host: vvv.example.org
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 301, 'Location' => 'http://localhost:'.$tf->{PORT}.'/unanchored/foo' } ];
+ok($tf->handle_http($t) == 0, 'first matching rule wins, with or without literal prefix');
+
+$t->{REQUEST}  = ( <<EOF
+GET /redirect/anchored/bar HTTP/1.0
+Host: vvv.example.org
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 301, 'Location' => 'http://localhost:'.$tf->{PORT}.'/anchored/bar' } ];
+ok($tf->handle_http($t) == 0, 'external redirect by literal prefix');
+
 $t->{REQUEST} = ( <<EOF
 GET /redirect/ HTTP/1.0
 Host: zzz.example.org
@@ -40,6 +56,22 @@ EOF
 $t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 301, 'Location' => 'http://localhost:'.$tf->{PORT}.'/zzz' } ];
 ok($tf->handle_http($t) == 0, 'external redirect with cond regsub');
 
+$t->{REQUEST} = ( <<EOF
+GET /redirect/ HTTP/1.0
+Host: cache1.example.org
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 301, 'Location' => 'http://localhost:'.$tf->{PORT}.'/cache1' } ];
+ok($tf->handle_http($t) == 0, 'external redirect with cond regsub, first capture');
+
+$t->{REQUEST} = ( <<EOF
+GET /redirect/ HTTP/1.0
+Host: cache2.example.org
+EOF
+ );
+$t->{RESPONSE} = [ { 'HTTP-Protocol' => 'HTTP/1.0', 'HTTP-Status' => 301, 'Location' => 'http://localhost:'.$tf->{PORT}.'/cache2' } ];
+ok($tf->handle_http($t) == 0, 'external redirect with cond regsub, cached per capture');
+
 $t->{REQUEST} = ( <<EOF
 GET /redirect/ HTTP/1.0
 Host: remoteip.example.org
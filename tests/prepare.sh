@@ -45,6 +45,7 @@ cp "${srcdir}/docroot/123/"*.txt \
    "${tmpdir}/servers/123.example.org/pages/"
 cp "${srcdir}/lighttpd.user" "${tmpdir}/"
 cp "${srcdir}/lighttpd.htpasswd" "${tmpdir}/"
+cp "${srcdir}/remoteip.list" "${tmpdir}/"
 cp "${srcdir}/var-include-sub.conf" "${tmpdir}/../"
 touch "${tmpdir}/servers/www.example.org/pages/image.jpg" \
       "${tmpdir}/servers/www.example.org/pages/image.JPG" \